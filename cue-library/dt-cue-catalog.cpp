@@ -0,0 +1,656 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <dt-cue-catalog.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include <stdio.h>
+
+namespace dtcue {
+
+namespace {
+
+const char catalog_magic[8] = { 'D', 'T', 'C', 'U', 'E', 'C', 'A', 'T' };
+const uint32_t catalog_version = 2;
+
+const char journal_magic[8] = { 'D', 'T', 'C', 'U', 'E', 'J', 'N', 'L' };
+const uint32_t journal_version = 1;
+
+// kinds of journal records
+const char journal_sheet_removed = 0;
+const char journal_sheet_added = 1;
+
+// separates tag name and value in index terms
+const char term_separator = '\x1F';
+
+void write_u32(std::ostream &output, uint32_t value)
+{
+	char data[4] = {
+		static_cast<char>(value & 0xFF),
+		static_cast<char>((value >> 8) & 0xFF),
+		static_cast<char>((value >> 16) & 0xFF),
+		static_cast<char>((value >> 24) & 0xFF)
+	};
+
+	output.write(data, sizeof(data));
+}
+
+void write_u16(std::ostream &output, uint16_t value)
+{
+	char data[2] = {
+		static_cast<char>(value & 0xFF),
+		static_cast<char>((value >> 8) & 0xFF)
+	};
+
+	output.write(data, sizeof(data));
+}
+
+void write_string(std::ostream &output, const std::string &value)
+{
+	write_u32(output, value.size());
+	output.write(value.data(), value.size());
+}
+
+uint32_t read_u32(std::istream &input)
+{
+	unsigned char data[4];
+
+	if (!input.read(reinterpret_cast<char*>(data), sizeof(data)))
+	{
+		throw std::runtime_error("Catalog file is truncated");
+	}
+
+	return (static_cast<uint32_t>(data[0])
+		| (static_cast<uint32_t>(data[1]) << 8)
+		| (static_cast<uint32_t>(data[2]) << 16)
+		| (static_cast<uint32_t>(data[3]) << 24));
+}
+
+uint16_t read_u16(std::istream &input)
+{
+	unsigned char data[2];
+
+	if (!input.read(reinterpret_cast<char*>(data), sizeof(data)))
+	{
+		throw std::runtime_error("Catalog file is truncated");
+	}
+
+	return (static_cast<uint16_t>(data[0]) | (static_cast<uint16_t>(data[1]) << 8));
+}
+
+std::string read_string(std::istream &input)
+{
+	std::string result;
+
+	result.resize(read_u32(input));
+
+	if ((!result.empty()) && (!input.read(&result[0], result.size())))
+	{
+		throw std::runtime_error("Catalog file is truncated");
+	}
+
+	return result;
+}
+
+uint32_t make_generation()
+{
+	std::random_device random;
+	uint32_t result;
+
+	// zero marks catalog which is not backed by any file
+	do
+	{
+		result = random();
+	} while (result == 0);
+
+	return result;
+}
+
+bool read_journal_header(std::istream &input, uint32_t generation)
+{
+	char header[sizeof(journal_magic) + 8];
+
+	if (!input.read(header, sizeof(header)))
+	{
+		return false;
+	}
+
+	std::istringstream fields(std::string(header + sizeof(journal_magic), header + sizeof(header)));
+
+	return (std::equal(journal_magic, journal_magic + sizeof(journal_magic), header)
+		&& (read_u32(fields) == journal_version)
+		&& (read_u32(fields) == generation));
+}
+
+// returns false at end of journal, including record cut by interrupted append
+bool read_journal_entry(std::istream &input, std::string &record)
+{
+	unsigned char size_data[4];
+
+	if (!input.read(reinterpret_cast<char*>(size_data), sizeof(size_data)))
+	{
+		return false;
+	}
+
+	record.resize(static_cast<uint32_t>(size_data[0])
+		| (static_cast<uint32_t>(size_data[1]) << 8)
+		| (static_cast<uint32_t>(size_data[2]) << 16)
+		| (static_cast<uint32_t>(size_data[3]) << 24));
+
+	return (record.empty() || input.read(&record[0], record.size()));
+}
+
+} // unnamed namespace
+
+bool catalog::posting::operator<(const posting &other) const
+{
+	if (sheet != other.sheet)
+	{
+		return (sheet < other.sheet);
+	}
+
+	return (track < other.track);
+}
+
+bool catalog::posting::operator==(const posting &other) const
+{
+	return ((sheet == other.sheet) && (track == other.track));
+}
+
+catalog::catalog()
+	: m_generation(0)
+{
+}
+
+std::string catalog::journal_filename(const std::string &filename)
+{
+	return filename + ".journal";
+}
+
+std::string catalog::make_term(const std::string &tag, const std::string &value)
+{
+	std::string result = tag;
+	result.push_back(term_separator);
+
+	for (auto iter = value.begin(); iter != value.end(); ++iter)
+	{
+		// only ASCII letters are folded, multibyte sequences are left as they are
+		if ((*iter >= 'A') && (*iter <= 'Z'))
+		{
+			result.push_back(*iter - 'A' + 'a');
+		}
+		else
+		{
+			result.push_back(*iter);
+		}
+	}
+
+	return result;
+}
+
+uint32_t catalog::add_sheet_id(const std::string &sheet_filename)
+{
+	remove_sheet(sheet_filename);
+
+	uint32_t sheet_id = m_sheets.size();
+	m_sheets.push_back(sheet_filename);
+	m_sheet_ids[sheet_filename] = sheet_id;
+	m_changed_sheets.insert(sheet_filename);
+
+	return sheet_id;
+}
+
+void catalog::add_posting(uint32_t sheet, const std::string &term, uint16_t track)
+{
+	auto iter = m_terms.insert(std::make_pair(term, std::vector<posting>())).first;
+	std::vector<posting> &postings = iter->second;
+
+	posting value;
+	value.sheet = sheet;
+	value.track = track;
+
+	if (postings.empty() || (postings.back().sheet != sheet))
+	{
+		m_sheet_terms[sheet].push_back(&(iter->first));
+	}
+
+	// sheet identifiers are never reused, so appending keeps postings sorted
+	if (postings.empty() || (!(postings.back() == value)))
+	{
+		postings.push_back(value);
+	}
+}
+
+void catalog::add_sheet(const std::string &sheet_filename, const cue &sheet)
+{
+	if (sheet.tracks.size() >= catalog_entry::all_tracks)
+	{
+		throw std::invalid_argument("Cue sheet '" + sheet_filename + "' contains too many tracks");
+	}
+
+	uint32_t sheet_id = add_sheet_id(sheet_filename);
+
+	for (auto tag = sheet.tags.begin(); tag != sheet.tags.end(); ++tag)
+	{
+		add_posting(sheet_id, make_term(tag->first, tag->second), catalog_entry::all_tracks);
+	}
+
+	for (size_t track_idx = 0; track_idx < sheet.tracks.size(); ++track_idx)
+	{
+		const track &current_track = sheet.tracks[track_idx];
+
+		for (auto tag = current_track.tags.begin(); tag != current_track.tags.end(); ++tag)
+		{
+			add_posting(sheet_id, make_term(tag->first, tag->second), track_idx);
+		}
+
+		for (auto file = current_track.files.begin(); file != current_track.files.end(); ++file)
+		{
+			add_posting(sheet_id, make_term("FILE", *file), track_idx);
+		}
+	}
+}
+
+void catalog::remove_sheet(const std::string &sheet_filename)
+{
+	auto sheet_id = m_sheet_ids.find(sheet_filename);
+	if (sheet_id == m_sheet_ids.end())
+	{
+		return;
+	}
+
+	posting first;
+	first.sheet = sheet_id->second;
+	first.track = 0;
+
+	posting last;
+	last.sheet = sheet_id->second;
+	last.track = catalog_entry::all_tracks;
+
+	auto sheet_terms = m_sheet_terms.find(sheet_id->second);
+	if (sheet_terms != m_sheet_terms.end())
+	{
+		for (auto term_ptr = sheet_terms->second.begin(); term_ptr != sheet_terms->second.end(); ++term_ptr)
+		{
+			auto term = m_terms.find(**term_ptr);
+			if (term == m_terms.end())
+			{
+				continue;
+			}
+
+			std::vector<posting> &postings = term->second;
+			postings.erase(std::lower_bound(postings.begin(), postings.end(), first), std::upper_bound(postings.begin(), postings.end(), last));
+
+			if (postings.empty())
+			{
+				m_terms.erase(term);
+			}
+		}
+
+		m_sheet_terms.erase(sheet_terms);
+	}
+
+	m_sheets[sheet_id->second].clear();
+	m_sheet_ids.erase(sheet_id);
+	m_changed_sheets.insert(sheet_filename);
+}
+
+bool catalog::has_sheet(const std::string &sheet_filename) const
+{
+	return (m_sheet_ids.find(sheet_filename) != m_sheet_ids.end());
+}
+
+std::vector<catalog_entry> catalog::make_entries(std::vector<posting> &postings) const
+{
+	std::sort(postings.begin(), postings.end());
+	postings.erase(std::unique(postings.begin(), postings.end()), postings.end());
+
+	std::vector<catalog_entry> result;
+	result.reserve(postings.size());
+
+	for (auto iter = postings.begin(); iter != postings.end(); ++iter)
+	{
+		catalog_entry entry;
+		entry.sheet = m_sheets[iter->sheet];
+		entry.track = iter->track;
+
+		result.push_back(entry);
+	}
+
+	return result;
+}
+
+std::vector<catalog_entry> catalog::find_exact(const std::string &tag, const std::string &value) const
+{
+	std::vector<posting> postings;
+
+	auto term = m_terms.find(make_term(tag, value));
+	if (term != m_terms.end())
+	{
+		postings = term->second;
+	}
+
+	return make_entries(postings);
+}
+
+std::vector<catalog_entry> catalog::find_prefix(const std::string &tag, const std::string &prefix) const
+{
+	std::vector<posting> postings;
+	std::string term_prefix = make_term(tag, prefix);
+
+	for (auto term = m_terms.lower_bound(term_prefix);
+		(term != m_terms.end()) && (term->first.compare(0, term_prefix.length(), term_prefix) == 0);
+		++term)
+	{
+		postings.insert(postings.end(), term->second.begin(), term->second.end());
+	}
+
+	return make_entries(postings);
+}
+
+void catalog::save(const std::string &filename)
+{
+	std::string temporary_filename = filename + ".partial";
+	uint32_t generation = make_generation();
+
+	{
+		std::ofstream output(temporary_filename.c_str(), std::ios::binary | std::ios::trunc);
+
+		// identifiers of removed sheets are dropped, remaining ones are renumbered in same order
+		std::vector<uint32_t> new_ids(m_sheets.size(), 0);
+		uint32_t live_sheets = 0;
+
+		for (size_t i = 0; i < m_sheets.size(); ++i)
+		{
+			if (!m_sheets[i].empty())
+			{
+				new_ids[i] = live_sheets++;
+			}
+		}
+
+		output.write(catalog_magic, sizeof(catalog_magic));
+		write_u32(output, catalog_version);
+		write_u32(output, generation);
+
+		write_u32(output, live_sheets);
+
+		for (auto sheet = m_sheets.begin(); sheet != m_sheets.end(); ++sheet)
+		{
+			if (!sheet->empty())
+			{
+				write_string(output, *sheet);
+			}
+		}
+
+		write_u32(output, m_terms.size());
+
+		for (auto term = m_terms.begin(); term != m_terms.end(); ++term)
+		{
+			write_string(output, term->first);
+			write_u32(output, term->second.size());
+
+			for (auto iter = term->second.begin(); iter != term->second.end(); ++iter)
+			{
+				write_u32(output, new_ids[iter->sheet]);
+				write_u16(output, iter->track);
+			}
+		}
+
+		output.flush();
+
+		if (!output)
+		{
+			remove(temporary_filename.c_str());
+			throw std::runtime_error("Failed to write catalog file '" + temporary_filename + "'");
+		}
+	}
+
+	if (rename(temporary_filename.c_str(), filename.c_str()) != 0)
+	{
+		remove(temporary_filename.c_str());
+		throw std::runtime_error("Failed to replace catalog file '" + filename + "'");
+	}
+
+	// journal of previous generation would be ignored anyway, removing it only saves space
+	remove(journal_filename(filename).c_str());
+
+	m_generation = generation;
+	m_changed_sheets.clear();
+}
+
+void catalog::write_journal_record(std::ostream &output, const std::string &sheet_filename) const
+{
+	write_string(output, sheet_filename);
+
+	auto sheet_id = m_sheet_ids.find(sheet_filename);
+	if (sheet_id == m_sheet_ids.end())
+	{
+		output.put(journal_sheet_removed);
+		return;
+	}
+
+	output.put(journal_sheet_added);
+
+	posting first;
+	first.sheet = sheet_id->second;
+	first.track = 0;
+
+	posting last;
+	last.sheet = sheet_id->second;
+	last.track = catalog_entry::all_tracks;
+
+	auto sheet_terms = m_sheet_terms.find(sheet_id->second);
+	if (sheet_terms == m_sheet_terms.end())
+	{
+		write_u32(output, 0);
+		return;
+	}
+
+	write_u32(output, sheet_terms->second.size());
+
+	for (auto term_ptr = sheet_terms->second.begin(); term_ptr != sheet_terms->second.end(); ++term_ptr)
+	{
+		const std::vector<posting> &postings = m_terms.find(**term_ptr)->second;
+		auto begin = std::lower_bound(postings.begin(), postings.end(), first);
+		auto end = std::upper_bound(postings.begin(), postings.end(), last);
+
+		write_string(output, **term_ptr);
+		write_u32(output, end - begin);
+
+		for (auto iter = begin; iter != end; ++iter)
+		{
+			write_u16(output, iter->track);
+		}
+	}
+}
+
+void catalog::read_journal_record(std::istream &input)
+{
+	std::string sheet_filename = read_string(input);
+
+	char kind;
+	if (!input.get(kind))
+	{
+		throw std::runtime_error("Catalog file is truncated");
+	}
+
+	if (kind == journal_sheet_removed)
+	{
+		remove_sheet(sheet_filename);
+		return;
+	}
+
+	if (kind != journal_sheet_added)
+	{
+		throw std::runtime_error("Catalog journal contains unknown record");
+	}
+
+	uint32_t sheet_id = add_sheet_id(sheet_filename);
+	uint32_t term_count = read_u32(input);
+
+	for (uint32_t i = 0; i < term_count; ++i)
+	{
+		std::string term = read_string(input);
+		uint32_t posting_count = read_u32(input);
+
+		for (uint32_t j = 0; j < posting_count; ++j)
+		{
+			add_posting(sheet_id, term, read_u16(input));
+		}
+	}
+}
+
+void catalog::append_changes(const std::string &filename)
+{
+	if (m_generation == 0)
+	{
+		throw std::runtime_error("Catalog has to be saved to or loaded from '" + filename + "' before appending changes");
+	}
+
+	if (m_changed_sheets.empty())
+	{
+		return;
+	}
+
+	std::string journal = journal_filename(filename);
+	bool has_header;
+
+	{
+		std::ifstream input(journal.c_str(), std::ios::binary);
+		has_header = read_journal_header(input, m_generation);
+	}
+
+	std::ofstream output;
+
+	if (has_header)
+	{
+		output.open(journal.c_str(), std::ios::binary | std::ios::app);
+	}
+	else
+	{
+		// journal is missing or belongs to another generation of catalog file
+		output.open(journal.c_str(), std::ios::binary | std::ios::trunc);
+		output.write(journal_magic, sizeof(journal_magic));
+		write_u32(output, journal_version);
+		write_u32(output, m_generation);
+	}
+
+	for (auto sheet = m_changed_sheets.begin(); sheet != m_changed_sheets.end(); ++sheet)
+	{
+		// records are length-prefixed, so record cut by interrupted append is skipped on load
+		std::ostringstream record;
+		write_journal_record(record, *sheet);
+
+		write_string(output, record.str());
+	}
+
+	output.flush();
+
+	if (!output)
+	{
+		throw std::runtime_error("Failed to write catalog journal '" + journal + "'");
+	}
+
+	m_changed_sheets.clear();
+}
+
+void catalog::load(const std::string &filename)
+{
+	std::ifstream input(filename.c_str(), std::ios::binary);
+	if (!input)
+	{
+		throw std::runtime_error("Failed to open catalog file '" + filename + "'");
+	}
+
+	char magic[sizeof(catalog_magic)];
+
+	if ((!input.read(magic, sizeof(magic)))
+		|| (!std::equal(magic, magic + sizeof(magic), catalog_magic))
+		|| (read_u32(input) != catalog_version))
+	{
+		throw std::runtime_error("File '" + filename + "' is not a valid catalog file");
+	}
+
+	catalog result;
+	result.m_generation = read_u32(input);
+
+	uint32_t sheet_count = read_u32(input);
+
+	for (uint32_t i = 0; i < sheet_count; ++i)
+	{
+		result.m_sheets.push_back(read_string(input));
+		result.m_sheet_ids[result.m_sheets.back()] = i;
+	}
+
+	uint32_t term_count = read_u32(input);
+
+	for (uint32_t i = 0; i < term_count; ++i)
+	{
+		std::string term_value = read_string(input);
+		uint32_t posting_count = read_u32(input);
+
+		auto term = result.m_terms.insert(result.m_terms.end(), std::make_pair(term_value, std::vector<posting>()));
+		term->second.reserve(posting_count);
+
+		for (uint32_t j = 0; j < posting_count; ++j)
+		{
+			posting value;
+			value.sheet = read_u32(input);
+			value.track = read_u16(input);
+
+			if (value.sheet >= sheet_count)
+			{
+				throw std::runtime_error("File '" + filename + "' is not a valid catalog file");
+			}
+
+			if (term->second.empty() || (term->second.back().sheet != value.sheet))
+			{
+				result.m_sheet_terms[value.sheet].push_back(&(term->first));
+			}
+
+			term->second.push_back(value);
+		}
+	}
+
+	std::ifstream journal(journal_filename(filename).c_str(), std::ios::binary);
+
+	// journal of another generation is already part of catalog file
+	if (journal && read_journal_header(journal, result.m_generation))
+	{
+		std::string record;
+
+		while (read_journal_entry(journal, record))
+		{
+			std::istringstream record_input(record);
+			result.read_journal_record(record_input);
+		}
+	}
+
+	result.m_changed_sheets.clear();
+
+	*this = std::move(result);
+}
+
+} // namespace dtcue
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_CATALOG_HPP
+#define DT_CUE_CATALOG_HPP
+
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <stdint.h>
+
+#include <dt-cue-library.hpp>
+
+namespace dtcue {
+
+struct catalog_entry
+{
+	// value of track for matches in global tags of cue sheet
+	static const unsigned int all_tracks = 0xFFFF;
+
+	std::string sheet;
+
+	// position of track in cue::tracks
+	unsigned int track;
+
+	catalog_entry()
+		: track(all_tracks)
+	{
+	}
+};
+
+// Inverted index over tags and file references of many cue sheets.
+// Tag names are matched exactly, values are matched case-insensitively for ASCII letters.
+// File references are indexed under name FILE.
+class catalog
+{
+public:
+	catalog();
+
+	// index keeps pointers to its own terms, copies would point into the source object;
+	// moved maps keep their nodes, so moving is safe
+	catalog(const catalog &other) = delete;
+	catalog& operator=(const catalog &other) = delete;
+	catalog(catalog &&other) = default;
+	catalog& operator=(catalog &&other) = default;
+
+	// replaces previously added sheet with same filename
+	void add_sheet(const std::string &sheet_filename, const cue &sheet);
+	void remove_sheet(const std::string &sheet_filename);
+	bool has_sheet(const std::string &sheet_filename) const;
+
+	std::vector<catalog_entry> find_exact(const std::string &tag, const std::string &value) const;
+	std::vector<catalog_entry> find_prefix(const std::string &tag, const std::string &prefix) const;
+
+	// file is replaced atomically, journal of appended changes is discarded
+	void save(const std::string &filename);
+
+	// appends sheets added or removed since last load, save or append to journal next to catalog file,
+	// so cost of update depends on changed sheets only; journal grows until next save.
+	// Catalog has to be loaded from or saved to same file first.
+	void append_changes(const std::string &filename);
+
+	// reads catalog file and replays its journal;
+	// whole index is kept in memory, so every process doing lookups pays for reading all of it
+	void load(const std::string &filename);
+
+private:
+	struct posting
+	{
+		uint32_t sheet;
+		uint16_t track;
+
+		bool operator<(const posting &other) const;
+		bool operator==(const posting &other) const;
+	};
+
+	typedef std::map<std::string, std::vector<posting> > term_map;
+
+	static std::string make_term(const std::string &tag, const std::string &value);
+
+	static std::string journal_filename(const std::string &filename);
+
+	uint32_t add_sheet_id(const std::string &sheet_filename);
+	void add_posting(uint32_t sheet, const std::string &term, uint16_t track);
+	void write_journal_record(std::ostream &output, const std::string &sheet_filename) const;
+	void read_journal_record(std::istream &input);
+	std::vector<catalog_entry> make_entries(std::vector<posting> &postings) const;
+
+	term_map m_terms;
+
+	std::vector<std::string> m_sheets;
+	std::map<std::string, uint32_t> m_sheet_ids;
+
+	// terms of each sheet, required for removing sheet without scanning whole index
+	std::map<uint32_t, std::vector<const std::string*> > m_sheet_terms;
+
+	// generation of catalog file this object was loaded from or saved to, journal is replayed only for same generation
+	uint32_t m_generation;
+
+	// sheets added or removed since last load, save or append
+	std::set<std::string> m_changed_sheets;
+};
+
+} // namespace dtcue
+
+#endif /* DT_CUE_CATALOG_HPP */
@@ -0,0 +1,497 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <dt-cue-discid.hpp>
+#include <dt-cue-plan.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <stdio.h>
+
+namespace dtcue {
+
+namespace {
+
+const char * const index_header = "dt-cue disc index 1";
+
+// lead-in preceding the first track on every disc
+const uint32_t leadin_frames = 150;
+
+class sha1
+{
+public:
+	sha1()
+		: m_length(0)
+	{
+		m_state[0] = 0x67452301;
+		m_state[1] = 0xEFCDAB89;
+		m_state[2] = 0x98BADCFE;
+		m_state[3] = 0x10325476;
+		m_state[4] = 0xC3D2E1F0;
+	}
+
+	void update(const std::string &data)
+	{
+		for (auto iter = data.begin(); iter != data.end(); ++iter)
+		{
+			m_block[m_length % 64] = static_cast<unsigned char>(*iter);
+			++m_length;
+
+			if (m_length % 64 == 0)
+			{
+				process_block();
+			}
+		}
+	}
+
+	std::string finish()
+	{
+		uint64_t bit_length = m_length * 8;
+
+		update(std::string(1, '\x80'));
+
+		while (m_length % 64 != 56)
+		{
+			update(std::string(1, '\0'));
+		}
+
+		for (int shift = 56; shift >= 0; shift -= 8)
+		{
+			update(std::string(1, static_cast<char>((bit_length >> shift) & 0xFF)));
+		}
+
+		std::string result;
+
+		for (size_t i = 0; i < 5; ++i)
+		{
+			for (int shift = 24; shift >= 0; shift -= 8)
+			{
+				result.push_back(static_cast<char>((m_state[i] >> shift) & 0xFF));
+			}
+		}
+
+		return result;
+	}
+
+private:
+	static uint32_t rotate(uint32_t value, unsigned int bits)
+	{
+		return ((value << bits) | (value >> (32 - bits)));
+	}
+
+	void process_block()
+	{
+		uint32_t words[80];
+
+		for (size_t i = 0; i < 16; ++i)
+		{
+			words[i] = (static_cast<uint32_t>(m_block[i * 4]) << 24)
+				| (static_cast<uint32_t>(m_block[i * 4 + 1]) << 16)
+				| (static_cast<uint32_t>(m_block[i * 4 + 2]) << 8)
+				| static_cast<uint32_t>(m_block[i * 4 + 3]);
+		}
+
+		for (size_t i = 16; i < 80; ++i)
+		{
+			words[i] = rotate(words[i - 3] ^ words[i - 8] ^ words[i - 14] ^ words[i - 16], 1);
+		}
+
+		uint32_t a = m_state[0];
+		uint32_t b = m_state[1];
+		uint32_t c = m_state[2];
+		uint32_t d = m_state[3];
+		uint32_t e = m_state[4];
+
+		for (size_t i = 0; i < 80; ++i)
+		{
+			uint32_t f;
+			uint32_t k;
+
+			if (i < 20)
+			{
+				f = (b & c) | ((~b) & d);
+				k = 0x5A827999;
+			}
+			else if (i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ED9EBA1;
+			}
+			else if (i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8F1BBCDC;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xCA62C1D6;
+			}
+
+			uint32_t temp = rotate(a, 5) + f + e + k + words[i];
+			e = d;
+			d = c;
+			c = rotate(b, 30);
+			b = a;
+			a = temp;
+		}
+
+		m_state[0] += a;
+		m_state[1] += b;
+		m_state[2] += c;
+		m_state[3] += d;
+		m_state[4] += e;
+	}
+
+	uint32_t m_state[5];
+	unsigned char m_block[64];
+	uint64_t m_length;
+};
+
+// MusicBrainz replaces characters of base64 which aren't allowed in URLs
+std::string encode_musicbrainz_base64(const std::string &data)
+{
+	const char * const alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789._";
+	std::string result;
+
+	for (size_t i = 0; i < data.size(); i += 3)
+	{
+		uint32_t value = static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << 16;
+
+		if (i + 1 < data.size())
+		{
+			value |= static_cast<uint32_t>(static_cast<unsigned char>(data[i + 1])) << 8;
+		}
+
+		if (i + 2 < data.size())
+		{
+			value |= static_cast<unsigned char>(data[i + 2]);
+		}
+
+		result.push_back(alphabet[(value >> 18) & 0x3F]);
+		result.push_back(alphabet[(value >> 12) & 0x3F]);
+		result.push_back((i + 1 < data.size()) ? alphabet[(value >> 6) & 0x3F] : '-');
+		result.push_back((i + 2 < data.size()) ? alphabet[value & 0x3F] : '-');
+	}
+
+	return result;
+}
+
+unsigned int sum_digits(uint32_t value)
+{
+	unsigned int result = 0;
+
+	for (; value != 0; value /= 10)
+	{
+		result += value % 10;
+	}
+
+	return result;
+}
+
+} // unnamed namespace
+
+std::vector<uint32_t> disc_toc::track_lengths() const
+{
+	std::vector<uint32_t> result;
+	result.reserve(track_offsets.size());
+
+	for (size_t i = 0; i < track_offsets.size(); ++i)
+	{
+		result.push_back(((i + 1 < track_offsets.size()) ? track_offsets[i + 1] : leadout_offset) - track_offsets[i]);
+	}
+
+	return result;
+}
+
+disc_toc make_disc_toc(const cue &cuesheet, const std::map<std::string, uint64_t> &file_frames)
+{
+	// on disc every track starts at its INDEX 01 and lasts until INDEX 01 of the next track
+	split_plan plan = make_split_plan(cuesheet, gap_action::append, 75);
+
+	if (plan.ranges.empty() || (cuesheet.tracks.size() > 99))
+	{
+		throw std::runtime_error("Cue sheet doesn't describe audio disc");
+	}
+
+	disc_toc result;
+
+	try
+	{
+		result.first_track = std::stoul(cuesheet.tracks.front().track_index);
+	}
+	catch (const std::exception &)
+	{
+		throw std::runtime_error("Track with index " + cuesheet.tracks.front().track_index + " doesn't have a number");
+	}
+
+	if ((result.first_track == 0) || (result.first_track + cuesheet.tracks.size() - 1 > 99))
+	{
+		throw std::runtime_error("Cue sheet doesn't describe audio disc");
+	}
+
+	// audio preceding INDEX 01 of the first track is hidden pregap of the first track
+	uint64_t position = plan.ranges.front().start;
+	uint32_t current_track = cuesheet.tracks.size();
+
+	result.track_offsets.reserve(cuesheet.tracks.size());
+
+	for (auto range = plan.ranges.begin(); range != plan.ranges.end(); ++range)
+	{
+		if (range->track != current_track)
+		{
+			result.track_offsets.push_back(position);
+			current_track = range->track;
+		}
+
+		uint64_t end = range->end;
+
+		if (end == split_plan::until_end)
+		{
+			auto length = file_frames.find(plan.files[range->file]);
+			if (length == file_frames.end())
+			{
+				throw std::runtime_error("Length of file '" + plan.files[range->file] + "' is unknown");
+			}
+
+			end = length->second;
+		}
+
+		if (end < range->start)
+		{
+			throw std::runtime_error("Track with index " + cuesheet.tracks[range->track].track_index + " ends beyond end of file '" + plan.files[range->file] + "'");
+		}
+
+		position += end - range->start;
+	}
+
+	// red book limits audio disc to less than 100 minutes
+	if (position >= 100 * 60 * 75)
+	{
+		throw std::runtime_error("Cue sheet doesn't describe audio disc");
+	}
+
+	result.leadout_offset = position;
+
+	return result;
+}
+
+std::string make_freedb_disc_id(const disc_toc &toc)
+{
+	unsigned int checksum = 0;
+
+	for (auto offset = toc.track_offsets.begin(); offset != toc.track_offsets.end(); ++offset)
+	{
+		checksum += sum_digits((*offset + leadin_frames) / 75);
+	}
+
+	uint32_t seconds = (toc.leadout_offset + leadin_frames) / 75 - (toc.track_offsets.front() + leadin_frames) / 75;
+
+	char buffer[9];
+	snprintf(buffer, sizeof(buffer), "%08x", static_cast<unsigned int>(((checksum % 0xFF) << 24) | (seconds << 8) | toc.track_offsets.size()));
+
+	return buffer;
+}
+
+std::string make_musicbrainz_disc_id(const disc_toc &toc)
+{
+	char buffer[9];
+	std::string text;
+
+	snprintf(buffer, sizeof(buffer), "%02X", toc.first_track);
+	text += buffer;
+
+	snprintf(buffer, sizeof(buffer), "%02X", static_cast<unsigned int>(toc.first_track + toc.track_offsets.size() - 1));
+	text += buffer;
+
+	snprintf(buffer, sizeof(buffer), "%08X", toc.leadout_offset + leadin_frames);
+	text += buffer;
+
+	// offsets of all 99 possible tracks, missing tracks are 0
+	for (size_t i = 0; i < 99; ++i)
+	{
+		snprintf(buffer, sizeof(buffer), "%08X", (i < toc.track_offsets.size()) ? (toc.track_offsets[i] + leadin_frames) : 0);
+		text += buffer;
+	}
+
+	sha1 digest;
+	digest.update(text);
+
+	return encode_musicbrainz_base64(digest.finish());
+}
+
+bool similar_track_lengths(const std::vector<uint32_t> &lhs, const std::vector<uint32_t> &rhs, uint32_t tolerance_frames)
+{
+	if (lhs.size() != rhs.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < lhs.size(); ++i)
+	{
+		if (((lhs[i] > rhs[i]) ? (lhs[i] - rhs[i]) : (rhs[i] - lhs[i])) > tolerance_frames)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void disc_index::load(const std::string &filename)
+{
+	std::ifstream input_file(filename.c_str());
+	std::string file_line;
+
+	if (!input_file)
+	{
+		return;
+	}
+
+	if ((!std::getline(input_file, file_line)) || (file_line != index_header))
+	{
+		throw std::runtime_error("File '" + filename + "' isn't a disc index");
+	}
+
+	while (std::getline(input_file, file_line))
+	{
+		std::istringstream stream(file_line);
+		std::string lengths;
+		disc_record record;
+
+		if ((stream >> record.musicbrainz_id >> record.freedb_id >> lengths)
+			&& (stream.get() == ' ')
+			&& std::getline(stream, record.location))
+		{
+			std::istringstream lengths_stream(lengths);
+			std::string length;
+
+			while (std::getline(lengths_stream, length, ','))
+			{
+				record.track_lengths.push_back(std::stoul(length));
+			}
+
+			add(record);
+		}
+	}
+}
+
+void disc_index::save(const std::string &filename) const
+{
+	std::string temporary_filename = filename + ".new";
+
+	{
+		std::ofstream output_file(temporary_filename.c_str());
+
+		output_file << index_header << '\n';
+
+		for (auto record = m_records.begin(); record != m_records.end(); ++record)
+		{
+			output_file << record->musicbrainz_id << ' ' << record->freedb_id << ' ';
+
+			for (auto length = record->track_lengths.begin(); length != record->track_lengths.end(); ++length)
+			{
+				output_file << ((length != record->track_lengths.begin()) ? "," : "") << *length;
+			}
+
+			output_file << ' ' << record->location << '\n';
+		}
+
+		output_file.flush();
+
+		if (!output_file)
+		{
+			throw std::runtime_error("Failed to write disc index '" + temporary_filename + "'");
+		}
+	}
+
+	if (rename(temporary_filename.c_str(), filename.c_str()) != 0)
+	{
+		throw std::runtime_error("Failed to replace disc index '" + filename + "'");
+	}
+}
+
+void disc_index::add(const disc_record &record)
+{
+	auto same_disc = m_by_musicbrainz_id.equal_range(record.musicbrainz_id);
+
+	for (auto existing = same_disc.first; existing != same_disc.second; ++existing)
+	{
+		if (m_records[existing->second].location == record.location)
+		{
+			return;
+		}
+	}
+
+	m_records.push_back(record);
+
+	m_by_musicbrainz_id.insert(std::make_pair(record.musicbrainz_id, m_records.size() - 1));
+	m_by_track_count.insert(std::make_pair(record.track_lengths.size(), m_records.size() - 1));
+}
+
+const disc_record* disc_index::find(const disc_toc &toc, uint32_t tolerance_frames, const std::string &excluded_location, bool &exact) const
+{
+	auto same_disc = m_by_musicbrainz_id.equal_range(make_musicbrainz_disc_id(toc));
+
+	for (auto candidate = same_disc.first; candidate != same_disc.second; ++candidate)
+	{
+		if (m_records[candidate->second].location != excluded_location)
+		{
+			exact = true;
+			return &(m_records[candidate->second]);
+		}
+	}
+
+	std::vector<uint32_t> lengths = toc.track_lengths();
+	auto candidates = m_by_track_count.equal_range(lengths.size());
+
+	for (auto candidate = candidates.first; candidate != candidates.second; ++candidate)
+	{
+		if ((m_records[candidate->second].location != excluded_location)
+			&& similar_track_lengths(m_records[candidate->second].track_lengths, lengths, tolerance_frames))
+		{
+			exact = false;
+			return &(m_records[candidate->second]);
+		}
+	}
+
+	return NULL;
+}
+
+size_t disc_index::size() const
+{
+	return m_records.size();
+}
+
+disc_record disc_index::make_record(const disc_toc &toc, const std::string &location)
+{
+	disc_record result;
+
+	result.musicbrainz_id = make_musicbrainz_disc_id(toc);
+	result.freedb_id = make_freedb_disc_id(toc);
+	result.track_lengths = toc.track_lengths();
+	result.location = location;
+
+	return result;
+}
+
+} // namespace dtcue
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_DISCID_HPP
+#define DT_CUE_DISCID_HPP
+
+#include <string>
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+#include <dt-cue-library.hpp>
+
+namespace dtcue {
+
+// Table of contents of audio CD. Positions are in CD frames, 1/75 of second,
+// counted from start of disc without 2 seconds lead-in.
+struct disc_toc
+{
+	unsigned int first_track;
+
+	// INDEX 01 of every track
+	std::vector<uint32_t> track_offsets;
+
+	uint32_t leadout_offset;
+
+	disc_toc()
+		: first_track(1),
+		leadout_offset(0)
+	{
+	}
+
+	std::vector<uint32_t> track_lengths() const;
+};
+
+// Builds table of contents from INDEX points of cue sheet. Length in CD frames of every file
+// referred by cue sheet is needed for the last track of that file, it's taken from audio headers.
+// Throws std::runtime_error if some length is missing or cue sheet isn't a layout of single audio disc.
+disc_toc make_disc_toc(const cue &cuesheet, const std::map<std::string, uint64_t> &file_frames);
+
+// 8 lowercase hex digits, as used by FreeDB and CDDB
+std::string make_freedb_disc_id(const disc_toc &toc);
+
+// 28 characters of SHA-1 in modified base64, as used by MusicBrainz
+std::string make_musicbrainz_disc_id(const disc_toc &toc);
+
+// true if discs have same number of tracks and lengths of tracks differ by at most given number of frames,
+// which matches rips of same disc made with different read offsets or drives
+bool similar_track_lengths(const std::vector<uint32_t> &lhs, const std::vector<uint32_t> &rhs, uint32_t tolerance_frames);
+
+struct disc_record
+{
+	std::string musicbrainz_id;
+	std::string freedb_id;
+	std::vector<uint32_t> track_lengths;
+
+	// directory holding the album
+	std::string location;
+};
+
+// Index of albums of library, looked up by disc ID first and by track lengths after that.
+class disc_index
+{
+public:
+	disc_index() = default;
+
+	// records of file are added to index, missing file is treated as empty one
+	void load(const std::string &filename);
+	void save(const std::string &filename) const;
+
+	// record of same disc at same location is added only once
+	void add(const disc_record &record);
+
+	// returns NULL if there is no such disc; records at excluded location, i.e. of the album itself, are skipped.
+	// exact is set if disc ID matches, otherwise only lengths of tracks are similar
+	const disc_record* find(const disc_toc &toc, uint32_t tolerance_frames, const std::string &excluded_location, bool &exact) const;
+
+	size_t size() const;
+
+	static disc_record make_record(const disc_toc &toc, const std::string &location);
+
+private:
+	std::vector<disc_record> m_records;
+
+	// positions in m_records
+	std::multimap<std::string, size_t> m_by_musicbrainz_id;
+	std::multimap<size_t, size_t> m_by_track_count;
+};
+
+} // namespace dtcue
+
+#endif /* DT_CUE_DISCID_HPP */
@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <dt-cue-embedded.hpp>
+#include <dt-cue-flac.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include <string.h>
+
+#include <stdint.h>
+
+namespace dtcue {
+
+namespace {
+
+const size_t ape_tag_footer_size = 32;
+const size_t id3v1_tag_size = 128;
+
+uint32_t read_le32(const unsigned char *data)
+{
+	return ((static_cast<uint32_t>(data[3]) << 24) | (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[1]) << 8) | data[0]);
+}
+
+bool equal_ignoring_case(const std::string &lhs, const std::string &rhs)
+{
+	return ((lhs.length() == rhs.length())
+		&& std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](unsigned char x, unsigned char y) { return (std::toupper(x) == std::toupper(y)); }));
+}
+
+// text item of APEv2 tag at the end of file, before ID3v1 tag if it's present
+std::experimental::optional<std::string> read_ape_tag_item(const std::string &filename, const std::string &key)
+{
+	std::ifstream input(filename.c_str(), std::ios::binary);
+	if (!input)
+	{
+		throw std::runtime_error("Failed to open file '" + filename + "'");
+	}
+
+	input.seekg(0, std::ios::end);
+	std::streamoff file_size = input.tellg();
+
+	unsigned char footer[ape_tag_footer_size];
+	std::streamoff footer_position = file_size - ape_tag_footer_size;
+
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		if ((footer_position < 0)
+			|| (!input.seekg(footer_position))
+			|| (!input.read(reinterpret_cast<char*>(footer), sizeof(footer))))
+		{
+			return std::experimental::optional<std::string>();
+		}
+
+		if (memcmp(footer, "APETAGEX", 8) == 0)
+		{
+			break;
+		}
+
+		// the only other tag which may follow APEv2 tag
+		if ((attempt != 0) || (file_size < static_cast<std::streamoff>(id3v1_tag_size + ape_tag_footer_size)))
+		{
+			return std::experimental::optional<std::string>();
+		}
+
+		footer_position -= id3v1_tag_size;
+	}
+
+	if (memcmp(footer, "APETAGEX", 8) != 0)
+	{
+		return std::experimental::optional<std::string>();
+	}
+
+	// size includes items and footer, but not header
+	uint32_t tag_size = read_le32(footer + 12);
+	uint32_t item_count = read_le32(footer + 16);
+
+	if ((tag_size < ape_tag_footer_size) || (tag_size - ape_tag_footer_size > static_cast<uint64_t>(footer_position)))
+	{
+		throw std::runtime_error("File '" + filename + "' has invalid APEv2 tag");
+	}
+
+	std::string items(tag_size - ape_tag_footer_size, '\0');
+
+	if ((!items.empty())
+		&& ((!input.seekg(footer_position - static_cast<std::streamoff>(items.size())))
+			|| (!input.read(&items[0], items.size()))))
+	{
+		throw std::runtime_error("Failed to read APEv2 tag of file '" + filename + "'");
+	}
+
+	const unsigned char *data = reinterpret_cast<const unsigned char*>(items.data());
+	size_t position = 0;
+
+	for (uint32_t i = 0; (i < item_count) && (position + 8 < items.size()); ++i)
+	{
+		uint32_t value_size = read_le32(data + position);
+		uint32_t flags = read_le32(data + position + 4);
+
+		size_t key_end = items.find('\0', position + 8);
+		if (key_end == std::string::npos)
+		{
+			break;
+		}
+
+		std::string item_key = items.substr(position + 8, key_end - (position + 8));
+		size_t value_position = key_end + 1;
+
+		if (value_size > items.size() - value_position)
+		{
+			break;
+		}
+
+		// bits 1-2 hold type of value, 0 is UTF-8 text
+		if (((flags & 0x06) == 0) && equal_ignoring_case(item_key, key))
+		{
+			return items.substr(value_position, value_size);
+		}
+
+		position = value_position + value_size;
+	}
+
+	return std::experimental::optional<std::string>();
+}
+
+time_point make_time_point(uint64_t samples, unsigned int sample_rate)
+{
+	// one CD frame is 1/75 of second
+	uint64_t frames = samples * 75 / sample_rate;
+
+	std::stringstream minutes;
+	std::stringstream seconds;
+	std::stringstream remaining_frames;
+
+	minutes << std::setfill('0') << std::setw(2) << (frames / (75 * 60));
+	seconds << std::setfill('0') << std::setw(2) << ((frames / 75) % 60);
+	remaining_frames << std::setfill('0') << std::setw(2) << (frames % 75);
+
+	time_point result;
+	result.minutes = minutes.str();
+	result.seconds = seconds.str();
+	result.frames = remaining_frames.str();
+
+	return result;
+}
+
+cue convert_flac_cue_sheet(const flac_metadata &metadata, const std::string &filename)
+{
+	const flac_cue_sheet &cue_sheet = *(metadata.cue_sheet);
+	cue result;
+
+	if (!cue_sheet.media_catalog_number.empty())
+	{
+		result.tags["CATALOG"] = cue_sheet.media_catalog_number;
+	}
+
+	// binary cue sheet has no text, take album tags of image instead
+	std::map<std::string, std::string> tag_names = {
+		{ "ALBUM",       "TITLE" },
+		{ "ARTIST",      "PERFORMER" },
+		{ "ALBUMARTIST", "PERFORMER" },
+		{ "DATE",        "DATE" },
+		{ "GENRE",       "GENRE" }
+	};
+
+	for (auto name = tag_names.begin(); name != tag_names.end(); ++name)
+	{
+		auto tag = metadata.tags.find(name->first);
+
+		if (tag != metadata.tags.end())
+		{
+			result.tags[name->second] = tag->second;
+		}
+	}
+
+	// the last track is lead-out
+	for (size_t i = 0; i + 1 < cue_sheet.tracks.size(); ++i)
+	{
+		const flac_cue_track &flac_track = cue_sheet.tracks[i];
+		track converted;
+
+		std::stringstream track_index;
+		track_index << std::setfill('0') << std::setw(2) << flac_track.number;
+
+		converted.track_index = track_index.str();
+		converted.type = flac_track.audio ? track_type::audio : track_type::mode1_2352;
+		converted.files.push_back(filename);
+
+		if (flac_track.pre_emphasis)
+		{
+			converted.flags |= track_flags::flag_pre;
+		}
+
+		if (!flac_track.isrc.empty())
+		{
+			converted.tags["ISRC"] = flac_track.isrc;
+		}
+
+		for (auto flac_index = flac_track.indices.begin(); flac_index != flac_track.indices.end(); ++flac_index)
+		{
+			file_time_point index;
+			index.time = make_time_point(flac_track.offset + flac_index->offset, metadata.stream_info.sample_rate);
+
+			if (flac_index->number > track_indices::max_number)
+			{
+				std::stringstream err;
+				err << "Track with index " << converted.track_index << " has invalid index number " << flac_index->number;
+				throw std::runtime_error(err.str());
+			}
+
+			converted.indices.set(flac_index->number, index);
+		}
+
+		if (converted.indices.find(1) == converted.indices.end())
+		{
+			std::stringstream err;
+			err << "Track with index " << converted.track_index << " doesn't have index 01";
+			throw std::runtime_error(err.str());
+		}
+
+		result.tracks.push_back(converted);
+	}
+
+	return result;
+}
+
+// embedded cue sheet refers to file it was made for, which is usually named differently
+void refer_to_file(cue &cuesheet, const std::string &filename)
+{
+	std::set<std::string> referred_files;
+
+	for (auto track = cuesheet.tracks.begin(); track != cuesheet.tracks.end(); ++track)
+	{
+		referred_files.insert(track->files.begin(), track->files.end());
+	}
+
+	if (referred_files.size() > 1)
+	{
+		throw std::runtime_error("Cue sheet embedded into file '" + filename + "' refers to several files");
+	}
+
+	for (auto track = cuesheet.tracks.begin(); track != cuesheet.tracks.end(); ++track)
+	{
+		std::fill(track->files.begin(), track->files.end(), filename);
+	}
+}
+
+} // unnamed namespace
+
+std::experimental::optional<cue> read_embedded_cue(const std::string &filename)
+{
+	char magic[4];
+
+	{
+		std::ifstream input(filename.c_str(), std::ios::binary);
+
+		if ((!input) || (!input.read(magic, sizeof(magic))))
+		{
+			throw std::runtime_error("Failed to read file '" + filename + "'");
+		}
+	}
+
+	std::experimental::optional<std::string> text;
+
+	if ((memcmp(magic, "fLaC", 4) == 0) || (memcmp(magic, "ID3", 3) == 0))
+	{
+		flac_metadata metadata = read_flac_metadata(filename);
+
+		auto tag = metadata.tags.find("CUESHEET");
+
+		if (tag != metadata.tags.end())
+		{
+			text = tag->second;
+		}
+		else if (metadata.cue_sheet)
+		{
+			if (metadata.stream_info.sample_rate == 0)
+			{
+				throw std::runtime_error("File '" + filename + "' doesn't have valid STREAMINFO block");
+			}
+
+			return convert_flac_cue_sheet(metadata, filename);
+		}
+	}
+	else if ((memcmp(magic, "wvpk", 4) == 0) || (memcmp(magic, "MAC ", 4) == 0))
+	{
+		text = read_ape_tag_item(filename, "Cuesheet");
+	}
+	else
+	{
+		throw std::runtime_error("File '" + filename + "' is neither FLAC, nor WavPack, nor Monkey's Audio file");
+	}
+
+	if (!text)
+	{
+		return std::experimental::optional<cue>();
+	}
+
+	cue result = parse_cue_string(*text);
+
+	refer_to_file(result, filename);
+
+	return result;
+}
+
+} // namespace dtcue
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_EMBEDDED_HPP
+#define DT_CUE_EMBEDDED_HPP
+
+#include <string>
+
+#include <experimental/optional>
+
+#include <dt-cue-library.hpp>
+
+namespace dtcue {
+
+// Reads cue sheet embedded into FLAC, WavPack or Monkey's Audio file, only metadata blocks and tags are read.
+// FLAC cue sheet is taken from CUESHEET Vorbis comment or from CUESHEET metadata block,
+// WavPack and Monkey's Audio cue sheet is taken from "Cuesheet" item of APEv2 tag.
+// Every FILE of returned cue sheet refers to given file, empty value is returned if file has no cue sheet.
+std::experimental::optional<cue> read_embedded_cue(const std::string &filename);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_EMBEDDED_HPP */
@@ -0,0 +1,749 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <dt-cue-flac.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dtcue {
+
+namespace {
+
+struct crc_tables
+{
+	uint8_t crc8[256];
+	uint16_t crc16[256];
+
+	crc_tables()
+	{
+		for (unsigned int i = 0; i < 256; ++i)
+		{
+			uint8_t value8 = i;
+			uint16_t value16 = i << 8;
+
+			for (int bit = 0; bit < 8; ++bit)
+			{
+				value8 = (value8 & 0x80) ? ((value8 << 1) ^ 0x07) : (value8 << 1);
+				value16 = (value16 & 0x8000) ? ((value16 << 1) ^ 0x8005) : (value16 << 1);
+			}
+
+			crc8[i] = value8;
+			crc16[i] = value16;
+		}
+	}
+};
+
+const crc_tables crc_table;
+
+uint8_t calculate_crc8(const unsigned char *data, size_t size)
+{
+	uint8_t result = 0;
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		result = crc_table.crc8[result ^ data[i]];
+	}
+
+	return result;
+}
+
+inline uint16_t update_crc16(uint16_t crc, unsigned char value)
+{
+	return ((crc << 8) ^ crc_table.crc16[(crc >> 8) ^ value]);
+}
+
+uint32_t read_be16(const unsigned char *data)
+{
+	return ((static_cast<uint32_t>(data[0]) << 8) | data[1]);
+}
+
+uint32_t read_be24(const unsigned char *data)
+{
+	return ((static_cast<uint32_t>(data[0]) << 16) | (static_cast<uint32_t>(data[1]) << 8) | data[2]);
+}
+
+uint32_t read_le32(const unsigned char *data)
+{
+	return ((static_cast<uint32_t>(data[3]) << 24) | (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[1]) << 8) | data[0]);
+}
+
+uint64_t read_be64(const unsigned char *data)
+{
+	uint64_t result = 0;
+
+	for (int i = 0; i < 8; ++i)
+	{
+		result = (result << 8) | data[i];
+	}
+
+	return result;
+}
+
+// fixed-size string field padded by zeroes
+std::string read_padded_string(const unsigned char *data, size_t size)
+{
+	size_t length = 0;
+
+	while ((length < size) && (data[length] != 0))
+	{
+		++length;
+	}
+
+	return std::string(reinterpret_cast<const char*>(data), length);
+}
+
+void parse_vorbis_comments(const std::string &block, std::map<std::string, std::string> &tags)
+{
+	const unsigned char *data = reinterpret_cast<const unsigned char*>(block.data());
+	size_t size = block.size();
+
+	if (size < 8)
+	{
+		return;
+	}
+
+	// skip vendor string
+	size_t position = 4 + static_cast<size_t>(read_le32(data));
+
+	if (position + 4 > size)
+	{
+		return;
+	}
+
+	uint32_t count = read_le32(data + position);
+	position += 4;
+
+	for (uint32_t i = 0; (i < count) && (position + 4 <= size); ++i)
+	{
+		size_t length = read_le32(data + position);
+		position += 4;
+
+		if (length > size - position)
+		{
+			return;
+		}
+
+		std::string comment = block.substr(position, length);
+		position += length;
+
+		size_t separator = comment.find('=');
+		if (separator == std::string::npos)
+		{
+			continue;
+		}
+
+		std::string name = comment.substr(0, separator);
+		std::transform(name.begin(), name.end(), name.begin(), [](unsigned char ch) { return std::toupper(ch); });
+
+		tags.insert(std::make_pair(name, comment.substr(separator + 1)));
+	}
+}
+
+void parse_seek_table(const std::string &block, std::vector<flac_seek_point> &seek_points)
+{
+	const unsigned char *data = reinterpret_cast<const unsigned char*>(block.data());
+
+	for (size_t position = 0; position + 18 <= block.size(); position += 18)
+	{
+		flac_seek_point point;
+		point.sample_number = read_be64(data + position);
+		point.offset = read_be64(data + position + 8);
+		point.frame_samples = read_be16(data + position + 16);
+
+		// placeholder points are used for reserving space only
+		if (point.sample_number != UINT64_MAX)
+		{
+			seek_points.push_back(point);
+		}
+	}
+}
+
+bool parse_cue_sheet(const std::string &block, flac_cue_sheet &cue_sheet)
+{
+	const unsigned char *data = reinterpret_cast<const unsigned char*>(block.data());
+	size_t size = block.size();
+
+	if (size < 396)
+	{
+		return false;
+	}
+
+	cue_sheet.media_catalog_number = read_padded_string(data, 128);
+	cue_sheet.lead_in = read_be64(data + 128);
+	cue_sheet.is_cd = ((data[136] & 0x80) != 0);
+
+	unsigned int track_count = data[395];
+	size_t position = 396;
+
+	for (unsigned int i = 0; i < track_count; ++i)
+	{
+		if (position + 36 > size)
+		{
+			return false;
+		}
+
+		flac_cue_track track;
+		track.offset = read_be64(data + position);
+		track.number = data[position + 8];
+		track.isrc = read_padded_string(data + position + 9, 12);
+		track.audio = ((data[position + 21] & 0x80) == 0);
+		track.pre_emphasis = ((data[position + 21] & 0x40) != 0);
+
+		unsigned int index_count = data[position + 35];
+		position += 36;
+
+		for (unsigned int j = 0; j < index_count; ++j)
+		{
+			if (position + 12 > size)
+			{
+				return false;
+			}
+
+			flac_cue_index index;
+			index.offset = read_be64(data + position);
+			index.number = data[position + 8];
+
+			track.indices.push_back(index);
+			position += 12;
+		}
+
+		cue_sheet.tracks.push_back(track);
+	}
+
+	return true;
+}
+
+struct frame_header
+{
+	bool variable_block_size;
+	uint32_t block_size;
+
+	// size of coded frame or sample number, which starts at byte 4
+	size_t number_size;
+
+	// including CRC-8
+	size_t size;
+};
+
+bool parse_frame_header(const unsigned char *data, size_t available, frame_header &header)
+{
+	if ((available < 6)
+		|| (data[0] != 0xFF)
+		|| ((data[1] & 0xFE) != 0xF8))
+	{
+		return false;
+	}
+
+	unsigned int block_size_code = data[2] >> 4;
+	unsigned int sample_rate_code = data[2] & 0x0F;
+	unsigned int channel_assignment = data[3] >> 4;
+	unsigned int sample_size_code = (data[3] >> 1) & 0x07;
+
+	if ((block_size_code == 0)
+		|| (sample_rate_code == 0x0F)
+		|| (channel_assignment > 10)
+		|| (sample_size_code == 3)
+		|| ((data[3] & 0x01) != 0))
+	{
+		return false;
+	}
+
+	// number is coded same way as UTF-8, extended up to 7 bytes
+	size_t number_size = 1;
+
+	if (data[4] & 0x80)
+	{
+		if (data[4] == 0xFF)
+		{
+			return false;
+		}
+
+		while ((number_size < 8) && (data[4] & (0x80 >> number_size)))
+		{
+			++number_size;
+		}
+
+		if ((number_size == 1) || (number_size > 7))
+		{
+			return false;
+		}
+	}
+
+	size_t position = 4 + number_size;
+
+	if (position > available)
+	{
+		return false;
+	}
+
+	for (size_t i = 5; i < position; ++i)
+	{
+		if ((data[i] & 0xC0) != 0x80)
+		{
+			return false;
+		}
+	}
+
+	uint32_t block_size = 0;
+
+	if (block_size_code == 1)
+	{
+		block_size = 192;
+	}
+	else if (block_size_code <= 5)
+	{
+		block_size = 576 << (block_size_code - 2);
+	}
+	else if (block_size_code == 6)
+	{
+		if (position + 1 > available)
+		{
+			return false;
+		}
+
+		block_size = data[position] + 1;
+		position += 1;
+	}
+	else if (block_size_code == 7)
+	{
+		if (position + 2 > available)
+		{
+			return false;
+		}
+
+		block_size = read_be16(data + position) + 1;
+		position += 2;
+	}
+	else
+	{
+		block_size = 256 << (block_size_code - 8);
+	}
+
+	if (sample_rate_code == 12)
+	{
+		position += 1;
+	}
+	else if ((sample_rate_code == 13) || (sample_rate_code == 14))
+	{
+		position += 2;
+	}
+
+	if ((position + 1 > available)
+		|| (calculate_crc8(data, position) != data[position]))
+	{
+		return false;
+	}
+
+	header.variable_block_size = ((data[1] & 0x01) != 0);
+	header.block_size = block_size;
+	header.number_size = number_size;
+	header.size = position + 1;
+
+	return true;
+}
+
+void append_coded_number(std::string &output, uint64_t value)
+{
+	if (value < 0x80)
+	{
+		output.push_back(static_cast<char>(value));
+		return;
+	}
+
+	// number of continuation bytes, each of them holds 6 bits
+	size_t continuation_bytes = 1;
+
+	while ((continuation_bytes < 6) && (value >= (static_cast<uint64_t>(1) << (6 * continuation_bytes + (6 - continuation_bytes)))))
+	{
+		++continuation_bytes;
+	}
+
+	unsigned char first_byte = static_cast<unsigned char>(0xFF00 >> (continuation_bytes + 1));
+	first_byte |= static_cast<unsigned char>(value >> (6 * continuation_bytes));
+
+	output.push_back(static_cast<char>(first_byte));
+
+	for (size_t i = continuation_bytes; i > 0; --i)
+	{
+		output.push_back(static_cast<char>(0x80 | ((value >> (6 * (i - 1))) & 0x3F)));
+	}
+}
+
+class mapped_file
+{
+public:
+	explicit mapped_file(const std::string &filename)
+		: m_data(NULL),
+		m_size(0)
+	{
+		int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			throw std::runtime_error("Failed to open file '" + filename + "': " + strerror(errno));
+		}
+
+		struct stat statbuf;
+
+		if (fstat(fd, &statbuf) != 0)
+		{
+			int error = errno;
+			close(fd);
+			throw std::runtime_error("Failed to read file '" + filename + "': " + strerror(error));
+		}
+
+		m_size = statbuf.st_size;
+
+		if (m_size != 0)
+		{
+			void *data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data == MAP_FAILED)
+			{
+				int error = errno;
+				close(fd);
+				throw std::runtime_error("Failed to read file '" + filename + "': " + strerror(error));
+			}
+
+			m_data = static_cast<const unsigned char*>(data);
+
+			// frames are read once from start to end
+			madvise(data, m_size, MADV_SEQUENTIAL);
+		}
+
+		close(fd);
+	}
+
+	~mapped_file()
+	{
+		if (m_data != NULL)
+		{
+			munmap(const_cast<unsigned char*>(m_data), m_size);
+		}
+	}
+
+	mapped_file(const mapped_file &other) = delete;
+	mapped_file& operator=(const mapped_file &other) = delete;
+
+	const unsigned char* data() const
+	{
+		return m_data;
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+private:
+	const unsigned char *m_data;
+	size_t m_size;
+};
+
+} // unnamed namespace
+
+flac_metadata read_flac_metadata(const std::string &filename)
+{
+	std::ifstream input(filename.c_str(), std::ios::binary);
+	if (!input)
+	{
+		throw std::runtime_error("Failed to open file '" + filename + "'");
+	}
+
+	unsigned char header[10];
+
+	if (!input.read(reinterpret_cast<char*>(header), 4))
+	{
+		throw std::runtime_error("File '" + filename + "' is not a valid FLAC file");
+	}
+
+	// some taggers put ID3v2 tag in front of FLAC stream
+	if (memcmp(header, "ID3", 3) == 0)
+	{
+		if (!input.read(reinterpret_cast<char*>(header + 4), 6))
+		{
+			throw std::runtime_error("File '" + filename + "' is not a valid FLAC file");
+		}
+
+		// tag size is stored as syncsafe integer and doesn't include 10 bytes of header
+		std::streamoff tag_size = ((header[6] & 0x7F) << 21) | ((header[7] & 0x7F) << 14) | ((header[8] & 0x7F) << 7) | (header[9] & 0x7F);
+
+		if ((!input.seekg(tag_size, std::ios::cur))
+			|| (!input.read(reinterpret_cast<char*>(header), 4)))
+		{
+			throw std::runtime_error("File '" + filename + "' is not a valid FLAC file");
+		}
+	}
+
+	if (memcmp(header, "fLaC", 4) != 0)
+	{
+		throw std::runtime_error("File '" + filename + "' is not a valid FLAC file");
+	}
+
+	flac_metadata result;
+	bool has_stream_info = false;
+	bool last_block = false;
+
+	while (!last_block)
+	{
+		unsigned char block_header[4];
+
+		if (!input.read(reinterpret_cast<char*>(block_header), sizeof(block_header)))
+		{
+			throw std::runtime_error("File '" + filename + "' is not a valid FLAC file");
+		}
+
+		last_block = ((block_header[0] & 0x80) != 0);
+		unsigned int block_type = block_header[0] & 0x7F;
+		uint32_t block_size = read_be24(block_header + 1);
+
+		if ((block_type == 0) && (block_size == 34))
+		{
+			unsigned char data[34];
+
+			if (!input.read(reinterpret_cast<char*>(data), sizeof(data)))
+			{
+				throw std::runtime_error("File '" + filename + "' is not a valid FLAC file");
+			}
+
+			flac_stream_info &info = result.stream_info;
+
+			info.min_block_size  = read_be16(data);
+			info.max_block_size  = read_be16(data + 2);
+			info.min_frame_size  = read_be24(data + 4);
+			info.max_frame_size  = read_be24(data + 7);
+			info.sample_rate     = (static_cast<unsigned int>(data[10]) << 12) | (static_cast<unsigned int>(data[11]) << 4) | (data[12] >> 4);
+			info.channels        = ((data[12] >> 1) & 0x07) + 1;
+			info.bits_per_sample = (((data[12] & 0x01) << 4) | (data[13] >> 4)) + 1;
+			info.total_samples   = (static_cast<uint64_t>(data[13] & 0x0F) << 32) | (static_cast<uint64_t>(read_be16(data + 14)) << 16) | read_be16(data + 16);
+			info.md5_signature.assign(reinterpret_cast<const char*>(data + 18), 16);
+
+			has_stream_info = true;
+		}
+		else if ((block_type == 3) || (block_type == 4) || (block_type == 5))
+		{
+			std::string block(block_size, '\0');
+
+			if ((block_size != 0) && (!input.read(&block[0], block_size)))
+			{
+				throw std::runtime_error("File '" + filename + "' is not a valid FLAC file");
+			}
+
+			flac_cue_sheet cue_sheet;
+
+			if (block_type == 3)
+			{
+				parse_seek_table(block, result.seek_points);
+			}
+			else if (block_type == 4)
+			{
+				parse_vorbis_comments(block, result.tags);
+			}
+			else if (parse_cue_sheet(block, cue_sheet))
+			{
+				result.cue_sheet = cue_sheet;
+			}
+		}
+		else if (!input.seekg(block_size, std::ios::cur))
+		{
+			throw std::runtime_error("File '" + filename + "' is not a valid FLAC file");
+		}
+	}
+
+	if ((!has_stream_info) || (result.stream_info.sample_rate == 0))
+	{
+		throw std::runtime_error("File '" + filename + "' doesn't have valid STREAMINFO block");
+	}
+
+	result.audio_offset = input.tellg();
+
+	return result;
+}
+
+std::vector<flac_frame> scan_flac_frames(const std::string &filename, const flac_metadata &metadata)
+{
+	mapped_file file(filename);
+
+	const unsigned char *data = file.data();
+	size_t end = file.size();
+
+	// ID3v1 tag may be appended after the last frame
+	size_t tag_position = ((end >= 128) && (memcmp(data + end - 128, "TAG", 3) == 0)) ? (end - 128) : end;
+
+	frame_header current;
+
+	if ((metadata.audio_offset >= end)
+		|| (!parse_frame_header(data + metadata.audio_offset, end - metadata.audio_offset, current)))
+	{
+		throw std::runtime_error("File '" + filename + "' doesn't have FLAC frame after metadata");
+	}
+
+	std::vector<flac_frame> result;
+
+	if (metadata.stream_info.max_frame_size != 0)
+	{
+		result.reserve((end - metadata.audio_offset) / metadata.stream_info.max_frame_size + 1);
+	}
+
+	size_t frame_start = metadata.audio_offset;
+	uint64_t first_sample = 0;
+	uint16_t crc = 0;
+	uint16_t tag_crc = 1;
+
+	for (size_t position = frame_start; position < end; ++position)
+	{
+		// next frame may start only where CRC-16 of data since start of current frame, including its footer, is zero
+		if ((crc == 0)
+			&& (data[position] == 0xFF)
+			&& (position > frame_start + current.size + 2))
+		{
+			frame_header next;
+
+			if (parse_frame_header(data + position, end - position, next)
+				&& (next.variable_block_size == current.variable_block_size))
+			{
+				flac_frame frame;
+				frame.offset = frame_start;
+				frame.size = position - frame_start;
+				frame.first_sample = first_sample;
+				frame.block_size = current.block_size;
+
+				result.push_back(frame);
+
+				first_sample += current.block_size;
+				frame_start = position;
+				current = next;
+			}
+		}
+
+		if (position == tag_position)
+		{
+			tag_crc = crc;
+		}
+
+		crc = update_crc16(crc, data[position]);
+	}
+
+	size_t frame_end = end;
+
+	if (crc != 0)
+	{
+		if ((tag_crc != 0) || (tag_position <= frame_start))
+		{
+			throw std::runtime_error("Last FLAC frame of file '" + filename + "' is damaged or truncated");
+		}
+
+		frame_end = tag_position;
+	}
+
+	flac_frame frame;
+	frame.offset = frame_start;
+	frame.size = frame_end - frame_start;
+	frame.first_sample = first_sample;
+	frame.block_size = current.block_size;
+
+	result.push_back(frame);
+
+	return result;
+}
+
+std::string renumber_flac_frame(const std::string &frame, uint64_t first_sample)
+{
+	const unsigned char *data = reinterpret_cast<const unsigned char*>(frame.data());
+	frame_header header;
+
+	if (!parse_frame_header(data, frame.size(), header) || (frame.size() < header.size + 2))
+	{
+		throw std::invalid_argument("Data doesn't start with a valid FLAC frame");
+	}
+
+	std::string result;
+	result.reserve(frame.size() + 8);
+
+	result.push_back(static_cast<char>(0xFF));
+	result.push_back(static_cast<char>(0xF9));
+	result.append(frame, 2, 2);
+
+	append_coded_number(result, first_sample);
+
+	// optional block size and sample rate fields, without CRC-8
+	result.append(frame, 4 + header.number_size, header.size - 1 - (4 + header.number_size));
+	result.push_back(static_cast<char>(calculate_crc8(reinterpret_cast<const unsigned char*>(result.data()), result.size())));
+
+	// subframes, without CRC-16
+	result.append(frame, header.size, frame.size() - header.size - 2);
+
+	uint16_t crc = 0;
+
+	for (auto iter = result.begin(); iter != result.end(); ++iter)
+	{
+		crc = update_crc16(crc, static_cast<unsigned char>(*iter));
+	}
+
+	result.push_back(static_cast<char>(crc >> 8));
+	result.push_back(static_cast<char>(crc & 0xFF));
+
+	return result;
+}
+
+std::string make_flac_stream_info_block(const flac_stream_info &stream_info, bool last_block)
+{
+	unsigned char data[4 + 34];
+
+	data[0] = last_block ? 0x80 : 0x00;
+	data[1] = 0;
+	data[2] = 0;
+	data[3] = 34;
+
+	data[4]  = (stream_info.min_block_size >> 8) & 0xFF;
+	data[5]  = stream_info.min_block_size & 0xFF;
+	data[6]  = (stream_info.max_block_size >> 8) & 0xFF;
+	data[7]  = stream_info.max_block_size & 0xFF;
+	data[8]  = (stream_info.min_frame_size >> 16) & 0xFF;
+	data[9]  = (stream_info.min_frame_size >> 8) & 0xFF;
+	data[10] = stream_info.min_frame_size & 0xFF;
+	data[11] = (stream_info.max_frame_size >> 16) & 0xFF;
+	data[12] = (stream_info.max_frame_size >> 8) & 0xFF;
+	data[13] = stream_info.max_frame_size & 0xFF;
+
+	data[14] = (stream_info.sample_rate >> 12) & 0xFF;
+	data[15] = (stream_info.sample_rate >> 4) & 0xFF;
+	data[16] = ((stream_info.sample_rate & 0x0F) << 4) | (((stream_info.channels - 1) & 0x07) << 1) | (((stream_info.bits_per_sample - 1) >> 4) & 0x01);
+	data[17] = (((stream_info.bits_per_sample - 1) & 0x0F) << 4) | ((stream_info.total_samples >> 32) & 0x0F);
+	data[18] = (stream_info.total_samples >> 24) & 0xFF;
+	data[19] = (stream_info.total_samples >> 16) & 0xFF;
+	data[20] = (stream_info.total_samples >> 8) & 0xFF;
+	data[21] = stream_info.total_samples & 0xFF;
+
+	memset(data + 22, 0, 16);
+	memcpy(data + 22, stream_info.md5_signature.data(), std::min<size_t>(stream_info.md5_signature.size(), 16));
+
+	return std::string(reinterpret_cast<const char*>(data), sizeof(data));
+}
+
+} // namespace dtcue
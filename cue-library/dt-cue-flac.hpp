@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_FLAC_HPP
+#define DT_CUE_FLAC_HPP
+
+#include <string>
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+#include <experimental/optional>
+
+namespace dtcue {
+
+struct flac_stream_info
+{
+	unsigned int min_block_size;
+	unsigned int max_block_size;
+	unsigned int min_frame_size;
+	unsigned int max_frame_size;
+
+	unsigned int sample_rate;
+	unsigned int channels;
+	unsigned int bits_per_sample;
+
+	// 0 if it's unknown
+	uint64_t total_samples;
+
+	// 16 bytes, all zeroes if it's unknown
+	std::string md5_signature;
+
+	flac_stream_info()
+		: min_block_size(0),
+		max_block_size(0),
+		min_frame_size(0),
+		max_frame_size(0),
+		sample_rate(0),
+		channels(0),
+		bits_per_sample(0),
+		total_samples(0),
+		md5_signature(16, '\0')
+	{
+	}
+};
+
+// contents of CUESHEET metadata block, positions are in samples
+struct flac_cue_index
+{
+	uint64_t offset;
+	unsigned int number;
+
+	flac_cue_index()
+		: offset(0),
+		number(0)
+	{
+	}
+};
+
+struct flac_cue_track
+{
+	uint64_t offset;
+	unsigned int number;
+	std::string isrc;
+	bool audio;
+	bool pre_emphasis;
+
+	// relative to offset of track
+	std::vector<flac_cue_index> indices;
+
+	flac_cue_track()
+		: offset(0),
+		number(0),
+		audio(true),
+		pre_emphasis(false)
+	{
+	}
+};
+
+struct flac_cue_sheet
+{
+	std::string media_catalog_number;
+	uint64_t lead_in;
+	bool is_cd;
+
+	// includes lead-out track
+	std::vector<flac_cue_track> tracks;
+
+	flac_cue_sheet()
+		: lead_in(0),
+		is_cd(false)
+	{
+	}
+};
+
+struct flac_seek_point
+{
+	uint64_t sample_number;
+
+	// relative to the first frame
+	uint64_t offset;
+
+	uint32_t frame_samples;
+
+	flac_seek_point()
+		: sample_number(0),
+		offset(0),
+		frame_samples(0)
+	{
+	}
+};
+
+struct flac_metadata
+{
+	flac_stream_info stream_info;
+
+	// Vorbis comments, names are converted to upper case, the first value of every name is kept
+	std::map<std::string, std::string> tags;
+
+	std::experimental::optional<flac_cue_sheet> cue_sheet;
+
+	// SEEKTABLE without placeholder points, empty if file has no seek table
+	std::vector<flac_seek_point> seek_points;
+
+	// position of the first frame in file
+	uint64_t audio_offset;
+
+	flac_metadata()
+		: audio_offset(0)
+	{
+	}
+};
+
+struct flac_frame
+{
+	// position and size of whole frame in file, including header and CRC-16 footer
+	uint64_t offset;
+	uint32_t size;
+
+	uint64_t first_sample;
+	uint32_t block_size;
+
+	flac_frame()
+		: offset(0),
+		size(0),
+		first_sample(0),
+		block_size(0)
+	{
+	}
+};
+
+// reads metadata blocks preceding audio, skipping ID3v2 tag if it's present,
+// blocks other than STREAMINFO, SEEKTABLE, VORBIS_COMMENT and CUESHEET are skipped without reading
+flac_metadata read_flac_metadata(const std::string &filename);
+
+// finds every frame of file by its sync code, header CRC-8 and frame CRC-16 without decoding audio
+std::vector<flac_frame> scan_flac_frames(const std::string &filename, const flac_metadata &metadata);
+
+// returns copy of frame using variable block size strategy, whose header holds given number of the first sample,
+// both CRCs are recomputed and audio data is left as it is
+std::string renumber_flac_frame(const std::string &frame, uint64_t first_sample);
+
+// STREAMINFO metadata block including its 4-byte header
+std::string make_flac_stream_info_block(const flac_stream_info &stream_info, bool last_block);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_FLAC_HPP */
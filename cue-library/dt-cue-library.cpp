@@ -19,11 +19,13 @@
  */
 
 #include <dt-cue-library.hpp>
+#include <dt-cue-scan.hpp>
 
 #include <algorithm>
 #include <cctype>
 #include <stdexcept>
 #include <fstream>
+#include <iterator>
 #include <sstream>
 #include <string>
 #include <type_traits>
@@ -63,29 +65,33 @@ track_flags& operator&=(track_flags &lhs, track_flags rhs)
 	return lhs;
 }
 
-cue parse_cue_file(const std::string &filename)
-{
-	struct stat statbuf;
+namespace {
 
-	if ((stat(filename.c_str(), &statbuf) == -1)
-		|| (!S_ISREG(statbuf.st_mode)))
+// true if line starts with keyword followed by space or tab, which every regular expression for keyword requires
+bool has_keyword(const char *keyword_begin, const char *line_end, const char *keyword)
+{
+	for ( ; *keyword != '\0'; ++keyword, ++keyword_begin)
 	{
-		throw std::invalid_argument("File '" + filename + "' is not a valid regular file");
+		if ((keyword_begin == line_end) || (*keyword_begin != *keyword))
+		{
+			return false;
+		}
 	}
 
-	std::ifstream input_file(filename.c_str());
+	return ((keyword_begin != line_end) && ((*keyword_begin == ' ') || (*keyword_begin == '\t')));
+}
+
+cue parse_cue_content(const std::string &content)
+{
 	std::string file_line;
 
-	{ // Make sure BOM mark is ignored
-		char a, b, c;
-		a = input_file.get();
-		b = input_file.get();
-		c = input_file.get();
+	const char *position = content.data();
+	const char *content_end = content.data() + content.size();
 
-		if ((a != (char)0xEF) || (b != (char)0xBB) || (c != (char)0xBF))
-		{
-			input_file.seekg(0);
-		}
+	// Make sure BOM mark is ignored
+	if (content.compare(0, 3, "\xEF\xBB\xBF") == 0)
+	{
+		position += 3;
 	}
 
 	cue result;
@@ -130,13 +136,38 @@ cue parse_cue_file(const std::string &filename)
 	track obtained_track;
 	std::map<std::string, std::string> tags;
 
-	while (std::getline(input_file, file_line))
+	while (position != content_end)
 	{
+		// lines may end with LF, CR LF or CR
+		const char *line_end = find_line_break(position, content_end);
+
+		file_line.assign(position, line_end);
+		position = line_end;
+
+		if (position != content_end)
+		{
+			position += ((*position == '\r') && (position + 1 != content_end) && (position[1] == '\n')) ? 2 : 1;
+		}
+
 #ifndef NDEBUG
 		printf("Line: %s\n", file_line.c_str());
 #endif /* NDEBUG */
 
-		if (std::regex_match(file_line, results, regex_title))
+		// regular expressions are tried only for lines which have their keyword and quotes
+		const char *line_begin = file_line.data();
+		line_end = file_line.data() + file_line.size();
+
+		const char *keyword = skip_blanks(line_begin, line_end);
+
+		if (keyword == line_end)
+		{
+			// line is empty or contains only spaces and tabs
+			continue;
+		}
+
+		bool quoted = (find_char(keyword, line_end, '"') != line_end);
+
+		if (quoted && has_keyword(keyword, line_end, "TITLE") && std::regex_match(file_line, results, regex_title))
 		{
 #ifndef NDEBUG
 			printf("\tGot title: %s\n", results[1].str().c_str());
@@ -144,7 +175,7 @@ cue parse_cue_file(const std::string &filename)
 
 			tags["TITLE"] = results[1].str();
 		}
-		else if (std::regex_match(file_line, results, regex_performer))
+		else if (quoted && has_keyword(keyword, line_end, "PERFORMER") && std::regex_match(file_line, results, regex_performer))
 		{
 #ifndef NDEBUG
 			printf("\tGot performer: %s\n", results[1].str().c_str());
@@ -152,7 +183,7 @@ cue parse_cue_file(const std::string &filename)
 
 			tags["PERFORMER"] = results[1].str();
 		}
-		else if (std::regex_match(file_line, results, regex_file))
+		else if (quoted && has_keyword(keyword, line_end, "FILE") && std::regex_match(file_line, results, regex_file))
 		{
 #ifndef NDEBUG
 			printf("\tGot file: %s\n", results[1].str().c_str());
@@ -166,7 +197,7 @@ cue parse_cue_file(const std::string &filename)
 				obtained_track.files.push_back(last_file_name);
 			}
 		}
-		else if (std::regex_match(file_line, results, regex_track))
+		else if (has_keyword(keyword, line_end, "TRACK") && std::regex_match(file_line, results, regex_track))
 		{
 #ifndef NDEBUG
 			printf("\tGot track: %s, type %s\n", results[1].str().c_str(), results[2].str().c_str());
@@ -211,7 +242,7 @@ cue parse_cue_file(const std::string &filename)
 			obtained_track.type = iter->second;
 			obtained_track.files.push_back(last_file_name);
 		}
-		else if (std::regex_match(file_line, results, regex_index))
+		else if (has_keyword(keyword, line_end, "INDEX") && std::regex_match(file_line, results, regex_index))
 		{
 #ifndef NDEBUG
 			printf("\tGot index: %s, value %s:%s:%s\n", results[1].str().c_str(), results[2].str().c_str(), results[3].str().c_str(), results[4].str().c_str());
@@ -228,9 +259,18 @@ cue parse_cue_file(const std::string &filename)
 			index.time.seconds = results[3].str();
 			index.time.frames = results[4].str();
 
-			obtained_track.indices[std::stoul(results[1].str())] = index;
+			unsigned long number = std::stoul(results[1].str());
+
+			if (number > track_indices::max_number)
+			{
+				std::stringstream err;
+				err << "Track with index " << obtained_track.track_index << " has invalid index number " << results[1].str();
+				throw std::runtime_error(err.str());
+			}
+
+			obtained_track.indices.set(number, index);
 		}
-		else if (std::regex_match(file_line, results, regex_cdtextfile))
+		else if (quoted && has_keyword(keyword, line_end, "CDTEXTFILE") && std::regex_match(file_line, results, regex_cdtextfile))
 		{
 #ifndef NDEBUG
 			printf("\tGot cdtextfile: %s\n", results[1].str().c_str());
@@ -238,7 +278,7 @@ cue parse_cue_file(const std::string &filename)
 
 			result.cdtextfile = results[1].str();
 		}
-		else if (std::regex_match(file_line, results, regex_flags))
+		else if (has_keyword(keyword, line_end, "FLAGS") && std::regex_match(file_line, results, regex_flags))
 		{
 #ifndef NDEBUG
 			printf("\tGot flags: %s\n", results[1].str().c_str());
@@ -268,7 +308,7 @@ cue parse_cue_file(const std::string &filename)
 				}
 			}
 		}
-		else if (std::regex_match(file_line, results, regex_pregap))
+		else if (has_keyword(keyword, line_end, "PREGAP") && std::regex_match(file_line, results, regex_pregap))
 		{
 #ifndef NDEBUG
 			printf("\tGot pregap, value %s:%s:%s\n", results[1].str().c_str(), results[2].str().c_str(), results[3].str().c_str());
@@ -286,7 +326,7 @@ cue parse_cue_file(const std::string &filename)
 
 			obtained_track.pregap = index;
 		}
-		else if (std::regex_match(file_line, results, regex_postgap))
+		else if (has_keyword(keyword, line_end, "POSTGAP") && std::regex_match(file_line, results, regex_postgap))
 		{
 #ifndef NDEBUG
 			printf("\tGot postgap, value %s:%s:%s\n", results[1].str().c_str(), results[2].str().c_str(), results[3].str().c_str());
@@ -304,7 +344,7 @@ cue parse_cue_file(const std::string &filename)
 
 			obtained_track.postgap = index;
 		}
-		else if (std::regex_match(file_line, results, regex_comment_quoted))
+		else if (quoted && has_keyword(keyword, line_end, "REM") && std::regex_match(file_line, results, regex_comment_quoted))
 		{
 #ifndef NDEBUG
 			printf("\tGot comment quoted:\n\tName: %s\n\tValue: %s\n", results[1].str().c_str(), results[2].str().c_str());
@@ -312,7 +352,7 @@ cue parse_cue_file(const std::string &filename)
 
 			tags[results[1].str()] = results[2].str();
 		}
-		else if (std::regex_match(file_line, results, regex_comment_plain))
+		else if (has_keyword(keyword, line_end, "REM") && std::regex_match(file_line, results, regex_comment_plain))
 		{
 #ifndef NDEBUG
 			printf("\tGot comment:\n\tName: %s\n\tValue: %s\n", results[1].str().c_str(), results[2].str().c_str());
@@ -320,7 +360,7 @@ cue parse_cue_file(const std::string &filename)
 
 			tags[results[1].str()] = results[2].str();
 		}
-		else if (std::regex_match(file_line, results, regex_else_quoted))
+		else if (quoted && std::regex_match(file_line, results, regex_else_quoted))
 		{
 #ifndef NDEBUG
 			printf("\tGot something else with quotes:\n\tName: %s\n\tValue: %s\n", results[1].str().c_str(), results[2].str().c_str());
@@ -367,4 +407,111 @@ cue parse_cue_file(const std::string &filename)
 	return result;
 }
 
+} // unnamed namespace
+
+track_indices::track_indices()
+{
+	m_present[0] = 0;
+	m_present[1] = 0;
+}
+
+bool track_indices::empty() const
+{
+	return m_points.empty();
+}
+
+size_t track_indices::size() const
+{
+	return m_points.size();
+}
+
+track_indices::const_iterator track_indices::begin() const
+{
+	return m_points.begin();
+}
+
+track_indices::const_iterator track_indices::end() const
+{
+	return m_points.end();
+}
+
+track_indices::const_iterator track_indices::find(unsigned int number) const
+{
+	if (!contains(number))
+	{
+		return m_points.end();
+	}
+
+	return m_points.begin() + rank(number);
+}
+
+const file_time_point& track_indices::at(unsigned int number) const
+{
+	if (!contains(number))
+	{
+		throw std::out_of_range("Track doesn't have index " + std::to_string(number));
+	}
+
+	return m_points[rank(number)].second;
+}
+
+void track_indices::set(unsigned int number, const file_time_point &point)
+{
+	if (number > max_number)
+	{
+		throw std::invalid_argument("Index number " + std::to_string(number) + " is out of range");
+	}
+
+	size_t position = rank(number);
+
+	if (contains(number))
+	{
+		m_points[position].second = point;
+		return;
+	}
+
+	m_points.insert(m_points.begin() + position, std::make_pair(number, point));
+	m_present[number / 64] |= (static_cast<uint64_t>(1) << (number % 64));
+}
+
+size_t track_indices::rank(unsigned int number) const
+{
+	uint64_t below = (static_cast<uint64_t>(1) << (number % 64)) - 1;
+
+	if (number < 64)
+	{
+		return __builtin_popcountll(m_present[0] & below);
+	}
+
+	return __builtin_popcountll(m_present[0]) + __builtin_popcountll(m_present[1] & below);
+}
+
+bool track_indices::contains(unsigned int number) const
+{
+	return ((number <= max_number) && ((m_present[number / 64] >> (number % 64)) & 1));
+}
+
+cue parse_cue_file(const std::string &filename)
+{
+	struct stat statbuf;
+
+	if ((stat(filename.c_str(), &statbuf) == -1)
+		|| (!S_ISREG(statbuf.st_mode)))
+	{
+		throw std::invalid_argument("File '" + filename + "' is not a valid regular file");
+	}
+
+	std::ifstream input_file(filename.c_str(), std::ios::binary);
+
+	// whole cue sheet is read at once, so that lines are found by vector scanning
+	std::string content((std::istreambuf_iterator<char>(input_file)), std::istreambuf_iterator<char>());
+
+	return parse_cue_content(content);
+}
+
+cue parse_cue_string(const std::string &content)
+{
+	return parse_cue_content(content);
+}
+
 } // namespace dtcue
@@ -23,8 +23,11 @@
 
 #include <string>
 #include <map>
+#include <utility>
 #include <vector>
 
+#include <stdint.h>
+
 #include <experimental/optional>
 
 namespace dtcue {
@@ -74,19 +77,55 @@ struct file_time_point
 	}
 };
 
-struct track
+// INDEX points of track sorted by their numbers, 0-99.
+// Points are kept in single array, bitmap of present numbers gives position of every point without searching.
+class track_indices
 {
-	std::map<std::string, std::string> tags;
+public:
+	typedef std::pair<unsigned int, file_time_point> value_type;
+	typedef std::vector<value_type>::const_iterator const_iterator;
+
+	static const unsigned int max_number = 99;
+
+	track_indices();
+
+	bool empty() const;
+	size_t size() const;
+
+	const_iterator begin() const;
+	const_iterator end() const;
+
+	// returns end() if there is no such point
+	const_iterator find(unsigned int number) const;
+
+	// throws std::out_of_range if there is no such point
+	const file_time_point& at(unsigned int number) const;
+
+	// adds point or replaces existing one, throws std::invalid_argument if number is greater than max_number
+	void set(unsigned int number, const file_time_point &point);
+
+private:
+	// number of present points with smaller number
+	size_t rank(unsigned int number) const;
+	bool contains(unsigned int number) const;
+
+	uint64_t m_present[2];
+	std::vector<value_type> m_points;
+};
 
+struct track
+{
 	std::string track_index;
 	track_type type;
-
 	track_flags flags;
-	std::experimental::optional<time_point> pregap;
-	std::experimental::optional<time_point> postgap;
 
 	std::vector<std::string> files;
-	std::map<unsigned int, file_time_point> indices;
+	track_indices indices;
+
+	std::map<std::string, std::string> tags;
+
+	std::experimental::optional<time_point> pregap;
+	std::experimental::optional<time_point> postgap;
 
 	track()
 		: type(track_type::unknown),
@@ -106,6 +145,9 @@ struct cue
 
 cue parse_cue_file(const std::string &filename);
 
+// parses cue sheet already loaded into memory, for example one embedded into audio file
+cue parse_cue_string(const std::string &content);
+
 } // namespace dtcue
 
 #endif /* DT_CUE_LIBRARY_HPP */
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <dt-cue-plan.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace dtcue {
+
+namespace {
+
+// one CD frame is 1/75 of second
+uint64_t time_point_to_frames(const time_point &point, const track &owner)
+{
+	unsigned long minutes = std::stoul(point.minutes);
+	unsigned long seconds = std::stoul(point.seconds);
+	unsigned long frames = std::stoul(point.frames);
+
+	if ((seconds >= 60) || (frames >= 75))
+	{
+		std::stringstream err;
+		err << "Track with index " << owner.track_index << " has invalid timestamp " << point.minutes << ':' << point.seconds << ':' << point.frames;
+		throw std::runtime_error(err.str());
+	}
+
+	return ((static_cast<uint64_t>(minutes) * 60 + seconds) * 75 + frames);
+}
+
+const file_time_point& get_index1(const track &owner)
+{
+	auto index1 = owner.indices.find(1);
+
+	if (index1 == owner.indices.end())
+	{
+		std::stringstream err;
+		err << "Track with index " << owner.track_index << " doesn't have index 01";
+		throw std::runtime_error(err.str());
+	}
+
+	return index1->second;
+}
+
+class plan_builder
+{
+public:
+	explicit plan_builder(unsigned int sample_rate)
+	{
+		m_plan.sample_rate = sample_rate;
+	}
+
+	uint32_t file(const std::string &filename)
+	{
+		auto found = std::find(m_plan.files.begin(), m_plan.files.end(), filename);
+
+		if (found != m_plan.files.end())
+		{
+			return (found - m_plan.files.begin());
+		}
+
+		m_plan.files.push_back(filename);
+		return (m_plan.files.size() - 1);
+	}
+
+	// positions are in CD frames
+	void add_range(uint32_t track, uint32_t file, uint64_t start)
+	{
+		split_range range;
+		range.track = track;
+		range.file = file;
+		range.start = scale(start);
+		range.end = split_plan::until_end;
+
+		m_plan.ranges.push_back(range);
+	}
+
+	std::vector<split_range>& ranges()
+	{
+		return m_plan.ranges;
+	}
+
+	uint64_t scale(uint64_t frames) const
+	{
+		return (frames * m_plan.sample_rate / 75);
+	}
+
+	split_plan& plan()
+	{
+		return m_plan;
+	}
+
+private:
+	split_plan m_plan;
+};
+
+} // unnamed namespace
+
+split_plan make_split_plan(const cue &cuesheet, gap_action action, unsigned int sample_rate)
+{
+	if (sample_rate == 0)
+	{
+		throw std::invalid_argument("Sample rate of split plan may not be 0");
+	}
+
+	plan_builder builder(sample_rate);
+
+	size_t range_count = 0;
+
+	for (auto current = cuesheet.tracks.begin(); current != cuesheet.tracks.end(); ++current)
+	{
+		// track may also take files preceding INDEX 01 of the next track
+		range_count += current->files.size() * 2;
+	}
+
+	builder.ranges().reserve(range_count);
+
+	for (size_t track_position = 0; track_position < cuesheet.tracks.size(); ++track_position)
+	{
+		const track &current = cuesheet.tracks[track_position];
+		const track *next = (track_position + 1 < cuesheet.tracks.size()) ? &(cuesheet.tracks[track_position + 1]) : NULL;
+
+		if (current.type != track_type::audio)
+		{
+			std::stringstream err;
+			err << "Track with index " << current.track_index << " has unsupported type";
+			throw std::runtime_error(err.str());
+		}
+
+		const file_time_point &index1 = get_index1(current);
+		auto index0 = current.indices.find(0);
+
+		const file_time_point *start = &index1;
+
+		switch (action)
+		{
+		case gap_action::discard:
+		case gap_action::append:
+			break;
+
+		case gap_action::prepend:
+			if (index0 != current.indices.end())
+			{
+				start = &(index0->second);
+			}
+			break;
+
+		case gap_action::prepend_first_then_append:
+			if ((index0 != current.indices.end()) && (track_position == 0))
+			{
+				start = &(index0->second);
+			}
+			break;
+		}
+
+		size_t first_range = builder.ranges().size();
+
+		builder.add_range(track_position, builder.file(current.files.at(start->file_index)), time_point_to_frames(start->time, current));
+
+		for (size_t file_index = start->file_index + 1; file_index < current.files.size(); ++file_index)
+		{
+			builder.add_range(track_position, builder.file(current.files[file_index]), 0);
+		}
+
+		if (next != NULL)
+		{
+			const file_time_point &next_index1 = get_index1(*next);
+			auto next_index0 = next->indices.find(0);
+			const file_time_point *boundary = &next_index1;
+
+			switch (action)
+			{
+			case gap_action::discard:
+			case gap_action::prepend:
+				if (next_index0 != next->indices.end())
+				{
+					boundary = &(next_index0->second);
+				}
+				break;
+
+			case gap_action::append:
+			case gap_action::prepend_first_then_append:
+				// pregap of next track may start in files preceding its INDEX 01
+				if (next_index1.file_index != 0)
+				{
+					size_t file_index = 0;
+
+					if (builder.ranges().back().file == builder.file(next->files[0]))
+					{
+						file_index = 1;
+					}
+
+					for ( ; file_index <= next_index1.file_index; ++file_index)
+					{
+						builder.add_range(track_position, builder.file(next->files[file_index]), 0);
+					}
+				}
+				break;
+			}
+
+			uint32_t boundary_file = builder.file(next->files.at(boundary->file_index));
+			uint64_t boundary_frames = time_point_to_frames(boundary->time, *next);
+
+			if (builder.ranges().back().file != boundary_file)
+			{
+				std::stringstream err;
+
+				if (boundary_frames == 0)
+				{
+					err << "Track with index " << next->track_index << " has invalid starting timestamp";
+				}
+				else
+				{
+					err << "Track with index " << next->track_index << " doesn't continue at same file as previous track";
+				}
+
+				throw std::runtime_error(err.str());
+			}
+
+			if (boundary_frames == 0)
+			{
+				// next track starts together with the last file
+				builder.ranges().pop_back();
+			}
+			else
+			{
+				builder.ranges().back().end = builder.scale(boundary_frames);
+			}
+		}
+
+		if (builder.ranges().size() == first_range)
+		{
+			std::stringstream err;
+			err << "Track with index " << current.track_index << " is empty";
+			throw std::runtime_error(err.str());
+		}
+	}
+
+	return std::move(builder.plan());
+}
+
+} // namespace dtcue
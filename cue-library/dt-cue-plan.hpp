@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_PLAN_HPP
+#define DT_CUE_PLAN_HPP
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <dt-cue-library.hpp>
+
+namespace dtcue {
+
+// what to do with pregap of track, audio between its INDEX 00 and INDEX 01
+enum class gap_action
+{
+	discard,
+	prepend,
+	append,
+	prepend_first_then_append
+};
+
+// Part of single source file played by track.
+struct split_range
+{
+	// position of track in cue::tracks
+	uint32_t track;
+
+	// position of file in split_plan::files
+	uint32_t file;
+
+	// first position and position after the last one
+	uint64_t start;
+	uint64_t end;
+};
+
+struct split_plan
+{
+	// value of split_range::end for ranges lasting until end of file
+	static const uint64_t until_end = UINT64_MAX;
+
+	unsigned int sample_rate;
+
+	// every file referred by cue sheet, listed once
+	std::vector<std::string> files;
+
+	// ranges of every track are adjacent and ordered as they're played, tracks are ordered as in cue sheet
+	std::vector<split_range> ranges;
+
+	split_plan()
+		: sample_rate(0)
+	{
+	}
+};
+
+// Computes parts of source files making every track of cue sheet, taking given handling of pregaps into account.
+// Positions are in units of 1/sample_rate of second, sample rate 75 gives positions in CD frames.
+// Throws std::runtime_error if cue sheet has data tracks or its INDEX points can't be split.
+split_plan make_split_plan(const cue &cuesheet, gap_action action, unsigned int sample_rate);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_PLAN_HPP */
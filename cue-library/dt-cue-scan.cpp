@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <dt-cue-scan.hpp>
+
+#include <stdint.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DT_CUE_SCAN_X86
+#include <immintrin.h>
+#endif /* x86 */
+
+namespace dtcue {
+
+namespace {
+
+struct scan_kernels
+{
+	const char *name;
+
+	const char* (*find_line_break)(const char *begin, const char *end);
+	const char* (*skip_blanks)(const char *begin, const char *end);
+	const char* (*find_char)(const char *begin, const char *end, char value);
+	bool (*is_ascii)(const char *begin, const char *end);
+};
+
+// scalar versions also finish tails of ranges which are shorter than vector
+
+const char* find_line_break_scalar(const char *begin, const char *end)
+{
+	while ((begin != end) && (*begin != '\n') && (*begin != '\r'))
+	{
+		++begin;
+	}
+
+	return begin;
+}
+
+const char* skip_blanks_scalar(const char *begin, const char *end)
+{
+	while ((begin != end) && ((*begin == ' ') || (*begin == '\t')))
+	{
+		++begin;
+	}
+
+	return begin;
+}
+
+const char* find_char_scalar(const char *begin, const char *end, char value)
+{
+	while ((begin != end) && (*begin != value))
+	{
+		++begin;
+	}
+
+	return begin;
+}
+
+bool is_ascii_scalar(const char *begin, const char *end)
+{
+	for ( ; begin != end; ++begin)
+	{
+		if (static_cast<unsigned char>(*begin) & 0x80)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#ifdef DT_CUE_SCAN_X86
+
+// every vector version compares whole vector at once and turns result into bit mask, one bit per byte
+
+__attribute__((target("sse2")))
+const char* find_line_break_sse2(const char *begin, const char *end)
+{
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i carriage_return = _mm_set1_epi8('\r');
+
+	for ( ; end - begin >= 16; begin += 16)
+	{
+		__m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(data, newline), _mm_cmpeq_epi8(data, carriage_return)));
+
+		if (mask != 0)
+		{
+			return begin + __builtin_ctz(mask);
+		}
+	}
+
+	return find_line_break_scalar(begin, end);
+}
+
+__attribute__((target("sse2")))
+const char* skip_blanks_sse2(const char *begin, const char *end)
+{
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+
+	for ( ; end - begin >= 16; begin += 16)
+	{
+		__m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		unsigned int mask = (~_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(data, space), _mm_cmpeq_epi8(data, tab)))) & 0xFFFF;
+
+		if (mask != 0)
+		{
+			return begin + __builtin_ctz(mask);
+		}
+	}
+
+	return skip_blanks_scalar(begin, end);
+}
+
+__attribute__((target("sse2")))
+const char* find_char_sse2(const char *begin, const char *end, char value)
+{
+	const __m128i pattern = _mm_set1_epi8(value);
+
+	for ( ; end - begin >= 16; begin += 16)
+	{
+		__m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(data, pattern));
+
+		if (mask != 0)
+		{
+			return begin + __builtin_ctz(mask);
+		}
+	}
+
+	return find_char_scalar(begin, end, value);
+}
+
+__attribute__((target("sse2")))
+bool is_ascii_sse2(const char *begin, const char *end)
+{
+	for ( ; end - begin >= 16; begin += 16)
+	{
+		// high bits of bytes are collected directly
+		if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(begin))) != 0)
+		{
+			return false;
+		}
+	}
+
+	return is_ascii_scalar(begin, end);
+}
+
+__attribute__((target("avx2")))
+const char* find_line_break_avx2(const char *begin, const char *end)
+{
+	const __m256i newline = _mm256_set1_epi8('\n');
+	const __m256i carriage_return = _mm256_set1_epi8('\r');
+
+	for ( ; end - begin >= 32; begin += 32)
+	{
+		__m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(data, newline), _mm256_cmpeq_epi8(data, carriage_return)));
+
+		if (mask != 0)
+		{
+			return begin + __builtin_ctz(mask);
+		}
+	}
+
+	return find_line_break_sse2(begin, end);
+}
+
+__attribute__((target("avx2")))
+const char* skip_blanks_avx2(const char *begin, const char *end)
+{
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i tab = _mm256_set1_epi8('\t');
+
+	for ( ; end - begin >= 32; begin += 32)
+	{
+		__m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(data, space), _mm256_cmpeq_epi8(data, tab))));
+
+		if (mask != 0)
+		{
+			return begin + __builtin_ctz(mask);
+		}
+	}
+
+	return skip_blanks_sse2(begin, end);
+}
+
+__attribute__((target("avx2")))
+const char* find_char_avx2(const char *begin, const char *end, char value)
+{
+	const __m256i pattern = _mm256_set1_epi8(value);
+
+	for ( ; end - begin >= 32; begin += 32)
+	{
+		__m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(data, pattern));
+
+		if (mask != 0)
+		{
+			return begin + __builtin_ctz(mask);
+		}
+	}
+
+	return find_char_sse2(begin, end, value);
+}
+
+__attribute__((target("avx2")))
+bool is_ascii_avx2(const char *begin, const char *end)
+{
+	for ( ; end - begin >= 32; begin += 32)
+	{
+		if (_mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin))) != 0)
+		{
+			return false;
+		}
+	}
+
+	return is_ascii_sse2(begin, end);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+const char* find_line_break_avx512bw(const char *begin, const char *end)
+{
+	const __m512i newline = _mm512_set1_epi8('\n');
+	const __m512i carriage_return = _mm512_set1_epi8('\r');
+
+	for ( ; end - begin >= 64; begin += 64)
+	{
+		__m512i data = _mm512_loadu_si512(begin);
+		uint64_t mask = _mm512_cmpeq_epi8_mask(data, newline) | _mm512_cmpeq_epi8_mask(data, carriage_return);
+
+		if (mask != 0)
+		{
+			return begin + __builtin_ctzll(mask);
+		}
+	}
+
+	return find_line_break_avx2(begin, end);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+const char* skip_blanks_avx512bw(const char *begin, const char *end)
+{
+	const __m512i space = _mm512_set1_epi8(' ');
+	const __m512i tab = _mm512_set1_epi8('\t');
+
+	for ( ; end - begin >= 64; begin += 64)
+	{
+		__m512i data = _mm512_loadu_si512(begin);
+		uint64_t mask = ~(_mm512_cmpeq_epi8_mask(data, space) | _mm512_cmpeq_epi8_mask(data, tab));
+
+		if (mask != 0)
+		{
+			return begin + __builtin_ctzll(mask);
+		}
+	}
+
+	return skip_blanks_avx2(begin, end);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+const char* find_char_avx512bw(const char *begin, const char *end, char value)
+{
+	const __m512i pattern = _mm512_set1_epi8(value);
+
+	for ( ; end - begin >= 64; begin += 64)
+	{
+		uint64_t mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(begin), pattern);
+
+		if (mask != 0)
+		{
+			return begin + __builtin_ctzll(mask);
+		}
+	}
+
+	return find_char_avx2(begin, end, value);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+bool is_ascii_avx512bw(const char *begin, const char *end)
+{
+	for ( ; end - begin >= 64; begin += 64)
+	{
+		if (_mm512_movepi8_mask(_mm512_loadu_si512(begin)) != 0)
+		{
+			return false;
+		}
+	}
+
+	return is_ascii_avx2(begin, end);
+}
+
+#endif /* DT_CUE_SCAN_X86 */
+
+scan_kernels select_kernels()
+{
+#ifdef DT_CUE_SCAN_X86
+	__builtin_cpu_init();
+
+	// tails shorter than vector are handled by narrower versions, so each level requires the previous ones
+	if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse2"))
+	{
+		return scan_kernels { "avx512bw", find_line_break_avx512bw, skip_blanks_avx512bw, find_char_avx512bw, is_ascii_avx512bw };
+	}
+
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse2"))
+	{
+		return scan_kernels { "avx2", find_line_break_avx2, skip_blanks_avx2, find_char_avx2, is_ascii_avx2 };
+	}
+
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return scan_kernels { "sse2", find_line_break_sse2, skip_blanks_sse2, find_char_sse2, is_ascii_sse2 };
+	}
+#endif /* DT_CUE_SCAN_X86 */
+
+	return scan_kernels { "scalar", find_line_break_scalar, skip_blanks_scalar, find_char_scalar, is_ascii_scalar };
+}
+
+const scan_kernels& kernels()
+{
+	// CPU is checked once, when the first kernel is used
+	static const scan_kernels selected = select_kernels();
+
+	return selected;
+}
+
+} // unnamed namespace
+
+const char* find_line_break(const char *begin, const char *end)
+{
+	return kernels().find_line_break(begin, end);
+}
+
+const char* skip_blanks(const char *begin, const char *end)
+{
+	return kernels().skip_blanks(begin, end);
+}
+
+const char* find_char(const char *begin, const char *end, char value)
+{
+	return kernels().find_char(begin, end, value);
+}
+
+bool is_ascii(const char *begin, const char *end)
+{
+	return kernels().is_ascii(begin, end);
+}
+
+const char* scan_kernels_name()
+{
+	return kernels().name;
+}
+
+} // namespace dtcue
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_SCAN_HPP
+#define DT_CUE_SCAN_HPP
+
+namespace dtcue {
+
+// Scanning kernels used by parser. Implementation using the widest vector instructions supported
+// by CPU is chosen at runtime, so that the same build runs on any CPU of its architecture.
+// All functions scan range [begin, end) and return end if nothing is found.
+
+// first '\n' or '\r'
+const char* find_line_break(const char *begin, const char *end);
+
+// first character which is neither space nor tab
+const char* skip_blanks(const char *begin, const char *end);
+
+// first occurrence of value, for example quote delimiting string
+const char* find_char(const char *begin, const char *end, char value);
+
+// true if there are no bytes above 0x7F
+bool is_ascii(const char *begin, const char *end);
+
+// instruction set of chosen implementation: "avx512bw", "avx2", "sse2" or "scalar"
+const char* scan_kernels_name();
+
+} // namespace dtcue
+
+#endif /* DT_CUE_SCAN_HPP */
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <dt-cue-virtual.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#include <string.h>
+
+namespace dtcue {
+
+namespace {
+
+const size_t id3v1_tag_size = 128;
+
+// position after the last frame, ID3v1 tag may follow it
+uint64_t find_audio_end(const std::string &filename)
+{
+	std::ifstream input(filename.c_str(), std::ios::binary);
+	if (!input)
+	{
+		throw std::runtime_error("Failed to open file '" + filename + "'");
+	}
+
+	input.seekg(0, std::ios::end);
+	uint64_t file_size = input.tellg();
+
+	char tag[3];
+
+	if ((file_size >= id3v1_tag_size)
+		&& input.seekg(file_size - id3v1_tag_size)
+		&& input.read(tag, sizeof(tag))
+		&& (memcmp(tag, "TAG", 3) == 0))
+	{
+		return (file_size - id3v1_tag_size);
+	}
+
+	return file_size;
+}
+
+} // unnamed namespace
+
+flac_image_index::flac_image_index(const std::string &filename)
+	: m_filename(filename),
+	m_metadata(read_flac_metadata(filename)),
+	m_uses_seek_table(false)
+{
+	if (!load_seek_table(find_audio_end(filename)))
+	{
+		m_frames = scan_flac_frames(filename, m_metadata);
+	}
+}
+
+const std::string& flac_image_index::filename() const
+{
+	return m_filename;
+}
+
+const flac_metadata& flac_image_index::metadata() const
+{
+	return m_metadata;
+}
+
+const std::vector<flac_frame>& flac_image_index::frames() const
+{
+	return m_frames;
+}
+
+bool flac_image_index::uses_seek_table() const
+{
+	return m_uses_seek_table;
+}
+
+uint64_t flac_image_index::total_samples() const
+{
+	return (m_frames.back().first_sample + m_frames.back().block_size);
+}
+
+const flac_frame& flac_image_index::find_frame(uint64_t sample) const
+{
+	auto next = std::upper_bound(m_frames.begin(), m_frames.end(), sample, [](uint64_t value, const flac_frame &frame) { return (value < frame.first_sample); });
+
+	if ((next == m_frames.begin()) || (sample >= total_samples()))
+	{
+		throw std::out_of_range("Sample " + std::to_string(sample) + " is beyond end of file '" + m_filename + "'");
+	}
+
+	return *(next - 1);
+}
+
+bool flac_image_index::load_seek_table(uint64_t audio_end)
+{
+	const std::vector<flac_seek_point> &points = m_metadata.seek_points;
+	uint64_t next_sample = 0;
+
+	// table is usable only if it has point for every frame, and the last one reaches end of stream
+	if (points.empty() || (m_metadata.stream_info.total_samples == 0))
+	{
+		return false;
+	}
+
+	for (auto point = points.begin(); point != points.end(); ++point)
+	{
+		if ((point->sample_number != next_sample)
+			|| (point->frame_samples == 0)
+			|| ((point != points.begin()) && (point->offset <= (point - 1)->offset))
+			|| ((point == points.begin()) && (point->offset != 0)))
+		{
+			return false;
+		}
+
+		next_sample += point->frame_samples;
+	}
+
+	if ((next_sample != m_metadata.stream_info.total_samples)
+		|| (m_metadata.audio_offset + points.back().offset >= audio_end))
+	{
+		return false;
+	}
+
+	m_frames.reserve(points.size());
+
+	for (auto point = points.begin(); point != points.end(); ++point)
+	{
+		uint64_t end = (point + 1 != points.end()) ? (m_metadata.audio_offset + (point + 1)->offset) : audio_end;
+
+		flac_frame frame;
+		frame.offset = m_metadata.audio_offset + point->offset;
+		frame.size = end - frame.offset;
+		frame.first_sample = point->sample_number;
+		frame.block_size = point->frame_samples;
+
+		m_frames.push_back(frame);
+	}
+
+	m_uses_seek_table = true;
+
+	return true;
+}
+
+std::vector<virtual_track> make_virtual_tracks(const cue &cuesheet, gap_action action, const flac_image_index &image)
+{
+	split_plan plan = make_split_plan(cuesheet, action, image.metadata().stream_info.sample_rate);
+
+	std::vector<virtual_track> result;
+	result.reserve(cuesheet.tracks.size());
+
+	for (auto range = plan.ranges.begin(); range != plan.ranges.end(); ++range)
+	{
+		if ((!result.empty()) && (result.back().track == range->track))
+		{
+			throw std::runtime_error("Track with index " + cuesheet.tracks[range->track].track_index + " spans several files");
+		}
+
+		uint64_t end = (range->end != split_plan::until_end) ? range->end : image.total_samples();
+
+		if ((end > image.total_samples()) || (range->start >= end))
+		{
+			throw std::runtime_error("Track with index " + cuesheet.tracks[range->track].track_index + " doesn't fit into file '" + image.filename() + "'");
+		}
+
+		const flac_frame &first = image.find_frame(range->start);
+		const flac_frame &last = image.find_frame(end - 1);
+
+		virtual_track track;
+		track.track = range->track;
+		track.byte_offset = first.offset;
+		track.byte_size = last.offset + last.size - first.offset;
+		track.skip_samples = range->start - first.first_sample;
+		track.trim_samples = last.first_sample + last.block_size - end;
+		track.first_sample = range->start;
+		track.total_samples = end - range->start;
+
+		result.push_back(track);
+	}
+
+	return result;
+}
+
+} // namespace dtcue
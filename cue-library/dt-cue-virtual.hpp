@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2016-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_VIRTUAL_HPP
+#define DT_CUE_VIRTUAL_HPP
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <dt-cue-library.hpp>
+#include <dt-cue-flac.hpp>
+#include <dt-cue-plan.hpp>
+
+namespace dtcue {
+
+// Position of every frame of FLAC image. It's taken from SEEKTABLE if the table has point for every frame,
+// otherwise frames are found by scanning whole image once.
+class flac_image_index
+{
+public:
+	explicit flac_image_index(const std::string &filename);
+
+	const std::string& filename() const;
+	const flac_metadata& metadata() const;
+	const std::vector<flac_frame>& frames() const;
+
+	// true if frames were taken from SEEKTABLE
+	bool uses_seek_table() const;
+
+	uint64_t total_samples() const;
+
+	// frame holding given sample, throws std::out_of_range if sample is beyond end of image
+	const flac_frame& find_frame(uint64_t sample) const;
+
+private:
+	bool load_seek_table(uint64_t audio_end);
+
+	std::string m_filename;
+	flac_metadata m_metadata;
+	std::vector<flac_frame> m_frames;
+	bool m_uses_seek_table;
+};
+
+// Track of image which can be streamed without splitting: frames [byte_offset, byte_offset + byte_size)
+// of image hold whole track, decoder has to drop skip_samples at beginning and trim_samples at end of them.
+// Decoder may be initialized with metadata of image, that is the first audio_offset bytes of it.
+struct virtual_track
+{
+	// position of track in cue::tracks
+	uint32_t track;
+
+	uint64_t byte_offset;
+	uint64_t byte_size;
+
+	uint64_t skip_samples;
+	uint64_t trim_samples;
+
+	// position and length of track in image
+	uint64_t first_sample;
+	uint64_t total_samples;
+};
+
+// Computes ranges of image holding every track of cue sheet, which has to describe this image only.
+// Throws std::runtime_error if some track spans several files or ends beyond end of image.
+std::vector<virtual_track> make_virtual_tracks(const cue &cuesheet, gap_action action, const flac_image_index &image);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_VIRTUAL_HPP */
@@ -19,13 +19,184 @@
  */
 
 #include "cue-action.hpp"
+#include "cue-checksum.hpp"
+#include "cue-io.hpp"
+#include "cue-wave.hpp"
 
+#include <dt-cue-scan.hpp>
+
+#include <algorithm>
+#include <sstream>
 #include <typeinfo>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 namespace dtcue {
 
+namespace {
+
+// on failure sinks which were already started are closed
+bool open_sinks(const std::vector<std::string> &sink_commands, std::vector<FILE*> &sinks)
+{
+	for (auto sink_command = sink_commands.begin(); sink_command != sink_commands.end(); ++sink_command)
+	{
+		FILE *sink = popen(sink_command->c_str(), "we");
+		if (sink == NULL)
+		{
+			for (auto iter = sinks.begin(); iter != sinks.end(); ++iter)
+			{
+				pclose(*iter);
+			}
+
+			sinks.clear();
+			return false;
+		}
+
+		sinks.push_back(sink);
+	}
+
+	return true;
+}
+
+bool write_sinks(const std::vector<FILE*> &sinks, const char *data, size_t size)
+{
+	bool result = true;
+
+	for (auto sink = sinks.begin(); sink != sinks.end(); ++sink)
+	{
+		if (fwrite(data, 1, size, *sink) != size)
+		{
+			result = false;
+		}
+	}
+
+	return result;
+}
+
+bool write_sinks_header(const std::vector<FILE*> &sinks, const wave_format &format)
+{
+	bool result = true;
+
+	for (auto sink = sinks.begin(); sink != sinks.end(); ++sink)
+	{
+		if (!write_wave_header(*sink, format))
+		{
+			result = false;
+		}
+	}
+
+	return result;
+}
+
+bool close_sinks(std::vector<FILE*> &sinks)
+{
+	bool result = true;
+
+	for (auto sink = sinks.begin(); sink != sinks.end(); ++sink)
+	{
+		if (pclose(*sink) != 0)
+		{
+			result = false;
+		}
+	}
+
+	sinks.clear();
+
+	return result;
+}
+
+// additional sinks are shown as if they were fed by tee
+std::string print_sinks(const std::vector<std::string> &sink_commands)
+{
+	std::string result;
+
+	if (sink_commands.size() > 1)
+	{
+		result += "tee";
+
+		for (auto sink_command = std::next(sink_commands.begin()); sink_command != sink_commands.end(); ++sink_command)
+		{
+			result += " >( " + *sink_command + " )";
+		}
+
+		result += " | ";
+	}
+
+	return result + sink_commands.front();
+}
+
+} // unnamed namespace
+
+std::string escape_single_quote(const std::string &input)
+{
+	std::string result;
+	result.reserve(input.size());
+
+	const char *position = input.data();
+	const char *end = input.data() + input.size();
+
+	for (;;)
+	{
+		const char *quote = find_char(position, end, '\'');
+
+		result.append(position, quote);
+
+		if (quote == end)
+		{
+			break;
+		}
+
+		result.append("\'\\\'\'");
+		position = quote + 1;
+	}
+
+	return result;
+}
+
+uint64_t hash_string(const std::string &value)
+{
+	uint64_t result = 0xcbf29ce484222325ULL;
+
+	for (auto iter = value.begin(); iter != value.end(); ++iter)
+	{
+		result ^= static_cast<unsigned char>(*iter);
+		result *= 0x100000001b3ULL;
+	}
+
+	return result;
+}
+
+command::command()
+	: m_usage(resource_usage::light),
+	m_reads_source(false)
+{
+}
+
+resource_usage command::usage() const
+{
+	return m_usage;
+}
+
+bool command::reads_source() const
+{
+	return m_reads_source;
+}
+
+void command::set_usage(resource_usage usage, bool reads_source)
+{
+	m_usage = usage;
+	m_reads_source = reads_source;
+}
+
+std::string command::script() const
+{
+	return std::string();
+}
+
 bool command_comparator::operator() (const std::shared_ptr<command> &x, const std::shared_ptr<command> &y) const
 {
 	if ((!x) || (!y))
@@ -53,9 +224,7 @@ external_command::external_command(const std::string &command_string)
 
 bool external_command::run() const
 {
-	system(m_command_string.c_str());
-
-	return true;
+	return (system(m_command_string.c_str()) == 0);
 }
 
 std::string external_command::print() const
@@ -63,6 +232,11 @@ std::string external_command::print() const
 	return m_command_string;
 }
 
+std::string external_command::script() const
+{
+	return m_command_string;
+}
+
 bool external_command::compare(const command &other) const
 {
 	const external_command &other_cmd = dynamic_cast<const external_command&>(other);
@@ -70,4 +244,555 @@ bool external_command::compare(const command &other) const
 	return (m_command_string < other_cmd.m_command_string);
 }
 
+move_command::move_command(const std::string &source_filename, const std::string &target_filename)
+	: command(),
+	m_source_filename(source_filename),
+	m_target_filename(target_filename)
+{
+}
+
+std::string move_command::temporary_filename() const
+{
+	std::string result = m_target_filename;
+	size_t separator = result.rfind('/');
+
+	result.insert((separator != std::string::npos) ? (separator + 1) : 0, ".");
+	result.append(".partial");
+
+	return result;
+}
+
+bool move_command::run() const
+{
+	// finished track is written to disk before it's reported as done,
+	// and it isn't kept in page cache since it's unlikely to be read soon
+	if (rename(m_source_filename.c_str(), m_target_filename.c_str()) == 0)
+	{
+		return sync_and_drop_file(m_target_filename);
+	}
+
+	if (errno != EXDEV)
+	{
+		return false;
+	}
+
+	std::string temporary_filename = this->temporary_filename();
+
+	int source = open(m_source_filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (source == -1)
+	{
+		return false;
+	}
+
+	int target = open(temporary_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (target == -1)
+	{
+		close(source);
+		return false;
+	}
+
+	advise_sequential_read(source, 0, 0);
+
+	bool result = true;
+	std::vector<char> buffer(64 * 1024);
+
+	for (;;)
+	{
+		ssize_t count = read(source, buffer.data(), buffer.size());
+		if (count <= 0)
+		{
+			result = (count == 0);
+			break;
+		}
+
+		if (write(target, buffer.data(), count) != count)
+		{
+			result = false;
+			break;
+		}
+	}
+
+	// source is removed after copying
+	advise_read_done(source, 0, 0);
+	close(source);
+
+	if (!sync_and_drop_file(target))
+	{
+		result = false;
+	}
+
+	if (close(target) != 0)
+	{
+		result = false;
+	}
+
+	if (result && (rename(temporary_filename.c_str(), m_target_filename.c_str()) == 0))
+	{
+		unlink(m_source_filename.c_str());
+		return true;
+	}
+
+	unlink(temporary_filename.c_str());
+	return false;
+}
+
+std::string move_command::print() const
+{
+	return "mv \'" + escape_single_quote(m_source_filename) + "\' \'" + escape_single_quote(m_target_filename) + "\'";
+}
+
+std::string move_command::script() const
+{
+	return print();
+}
+
+bool move_command::compare(const command &other) const
+{
+	const move_command &other_cmd = dynamic_cast<const move_command&>(other);
+
+	if (m_source_filename != other_cmd.m_source_filename)
+	{
+		return (m_source_filename < other_cmd.m_source_filename);
+	}
+
+	return (m_target_filename < other_cmd.m_target_filename);
+}
+
+drop_cache_command::drop_cache_command(const std::string &filename)
+	: command(),
+	m_filename(filename)
+{
+}
+
+bool drop_cache_command::run() const
+{
+	// only a hint, failure affects nothing but speed
+	drop_file_cache(m_filename);
+
+	return true;
+}
+
+std::string drop_cache_command::print() const
+{
+	return "# drop '" + escape_single_quote(m_filename) + "' from page cache";
+}
+
+std::string drop_cache_command::script() const
+{
+	// GNU dd drops cache of whole file when nothing is copied
+	return "{ dd if='" + escape_single_quote(m_filename) + "' iflag=nocache count=0 status=none || true; }";
+}
+
+bool drop_cache_command::compare(const command &other) const
+{
+	const drop_cache_command &other_cmd = dynamic_cast<const drop_cache_command&>(other);
+
+	return (m_filename < other_cmd.m_filename);
+}
+
+pipe_command::pipe_command(const std::vector<std::string> &source_commands, const std::string &sink_command)
+	: command(),
+	m_source_commands(source_commands),
+	m_sink_commands(1, sink_command)
+{
+}
+
+void pipe_command::add_sink(const std::string &sink_command)
+{
+	m_sink_commands.push_back(sink_command);
+}
+
+void pipe_command::set_checksum(const std::shared_ptr<pcm_checksum> &checksum)
+{
+	m_checksum = checksum;
+}
+
+bool pipe_command::run() const
+{
+	std::vector<FILE*> sinks;
+
+	if (!open_sinks(m_sink_commands, sinks))
+	{
+		return false;
+	}
+
+	bool result = true;
+	bool header_written = false;
+	wave_format sink_format;
+	std::vector<char> buffer(64 * 1024);
+
+	for (auto source_command = m_source_commands.begin(); result && (source_command != m_source_commands.end()); ++source_command)
+	{
+		FILE *source = popen(source_command->c_str(), "re");
+		if (source == NULL)
+		{
+			result = false;
+			break;
+		}
+
+		wave_format format;
+
+		if (!read_wave_header(source, format))
+		{
+			fprintf(stderr, "Failed to read WAV header from output of command: %s\n", source_command->c_str());
+			result = false;
+		}
+		else if (!header_written)
+		{
+			sink_format = format;
+			header_written = true;
+			result = write_sinks_header(sinks, sink_format);
+
+			if (m_checksum)
+			{
+				m_checksum->begin(sink_format);
+			}
+		}
+		else if (!sink_format.same_samples(format))
+		{
+			fprintf(stderr, "Sample format differs from previous parts for command: %s\n", source_command->c_str());
+			result = false;
+		}
+
+		// if size of data is known, copy only data and skip anything after it
+		uint64_t remaining = format.data_size;
+
+		while (result)
+		{
+			size_t portion = buffer.size();
+
+			if ((format.data_size != 0) && (remaining < portion))
+			{
+				portion = remaining;
+			}
+
+			if (portion == 0)
+			{
+				break;
+			}
+
+			size_t count = fread(buffer.data(), 1, portion, source);
+			if (count == 0)
+			{
+				break;
+			}
+
+			if (!write_sinks(sinks, buffer.data(), count))
+			{
+				result = false;
+			}
+
+			if (m_checksum)
+			{
+				m_checksum->update(buffer.data(), count);
+			}
+
+			remaining -= count;
+		}
+
+		// drain the rest of output in order to let the source process finish normally
+		while (fread(buffer.data(), 1, buffer.size(), source) > 0)
+		{
+		}
+
+		if (pclose(source) != 0)
+		{
+			result = false;
+		}
+	}
+
+	if (!close_sinks(sinks))
+	{
+		result = false;
+	}
+
+	if (m_checksum)
+	{
+		m_checksum->finish();
+	}
+
+	return result;
+}
+
+std::string pipe_command::print() const
+{
+	std::string result = "(";
+
+	for (auto source_command = m_source_commands.begin(); source_command != m_source_commands.end(); ++source_command)
+	{
+		result += " " + *source_command + ";";
+	}
+
+	result += " ) | " + print_sinks(m_sink_commands);
+
+	return result;
+}
+
+std::string pipe_command::script() const
+{
+	if (m_source_commands.size() != 1)
+	{
+		return std::string();
+	}
+
+	if (m_sink_commands.size() == 1)
+	{
+		return m_source_commands.front() + " | " + m_sink_commands.front();
+	}
+
+	// shell doesn't wait for process substitutions, so additional sinks read named pipes and are waited for explicitly
+	std::stringstream result;
+
+	result << "sinks=$(mktemp -d) && mkfifo";
+
+	for (size_t i = 1; i < m_sink_commands.size(); ++i)
+	{
+		result << " \"$sinks/" << i << "\"";
+	}
+
+	result << " && {";
+
+	for (size_t i = 1; i < m_sink_commands.size(); ++i)
+	{
+		result << " " << m_sink_commands[i] << " < \"$sinks/" << i << "\" & sink" << i << "=$!;";
+	}
+
+	result << " " << m_source_commands.front() << " | tee";
+
+	for (size_t i = 1; i < m_sink_commands.size(); ++i)
+	{
+		result << " \"$sinks/" << i << "\"";
+	}
+
+	result << " | " << m_sink_commands.front();
+
+	for (size_t i = 1; i < m_sink_commands.size(); ++i)
+	{
+		result << " && wait $sink" << i;
+	}
+
+	result << "; }; status=$?; rm -rf \"$sinks\"; [ $status -eq 0 ]";
+
+	return result.str();
+}
+
+bool pipe_command::compare(const command &other) const
+{
+	const pipe_command &other_cmd = dynamic_cast<const pipe_command&>(other);
+
+	if (m_source_commands != other_cmd.m_source_commands)
+	{
+		return (m_source_commands < other_cmd.m_source_commands);
+	}
+
+	return (m_sink_commands < other_cmd.m_sink_commands);
+}
+
+stream_split_command::stream_split_command(const std::string &source_command)
+	: command(),
+	m_source_command(source_command)
+{
+}
+
+void stream_split_command::add_output(uint64_t start_frame,
+	std::experimental::optional<uint64_t> end_frame,
+	const std::vector<std::string> &sink_commands,
+	const std::shared_ptr<pcm_checksum> &checksum)
+{
+	output new_output;
+	new_output.start_frame = start_frame;
+	new_output.end_frame = end_frame;
+	new_output.sink_commands = sink_commands;
+	new_output.checksum = checksum;
+
+	m_outputs.push_back(new_output);
+
+	std::stable_sort(m_outputs.begin(), m_outputs.end(), [](const output &lhs, const output &rhs)
+		{
+			return (lhs.start_frame < rhs.start_frame);
+		});
+}
+
+bool stream_split_command::run() const
+{
+	FILE *source = popen(m_source_command.c_str(), "re");
+	if (source == NULL)
+	{
+		return false;
+	}
+
+	bool result = true;
+	wave_format format;
+
+	if (!read_wave_header(source, format))
+	{
+		fprintf(stderr, "Failed to read WAV header from output of command: %s\n", m_source_command.c_str());
+		result = false;
+	}
+
+	// byte ranges of outputs, end of 0 means end of stream
+	std::vector<std::pair<uint64_t, uint64_t> > ranges;
+	std::vector<std::vector<FILE*> > sinks(m_outputs.size());
+	std::vector<bool> finished(m_outputs.size(), false);
+
+	for (auto iter = m_outputs.begin(); iter != m_outputs.end(); ++iter)
+	{
+		uint64_t start = iter->start_frame * format.sample_rate / 75 * format.block_align;
+		uint64_t end = 0;
+
+		if (iter->end_frame)
+		{
+			end = (*(iter->end_frame)) * format.sample_rate / 75 * format.block_align;
+		}
+
+		ranges.push_back(std::make_pair(start, end));
+	}
+
+	std::vector<char> buffer(64 * 1024);
+	uint64_t position = 0;
+
+	while (result)
+	{
+		size_t portion = buffer.size();
+
+		// if size of data is known, chunks following it aren't audio
+		if ((format.data_size != 0) && (format.data_size - position < portion))
+		{
+			portion = format.data_size - position;
+		}
+
+		if (portion == 0)
+		{
+			break;
+		}
+
+		size_t count = fread(buffer.data(), 1, portion, source);
+		if (count == 0)
+		{
+			break;
+		}
+
+		uint64_t chunk_end = position + count;
+
+		for (size_t i = 0; result && (i < m_outputs.size()); ++i)
+		{
+			if (finished[i] || (ranges[i].first >= chunk_end))
+			{
+				continue;
+			}
+
+			if (sinks[i].empty())
+			{
+				if ((!open_sinks(m_outputs[i].sink_commands, sinks[i])) || (!write_sinks_header(sinks[i], format)))
+				{
+					result = false;
+					break;
+				}
+
+				if (m_outputs[i].checksum)
+				{
+					m_outputs[i].checksum->begin(format);
+				}
+			}
+
+			uint64_t from = std::max(position, ranges[i].first);
+			uint64_t to = chunk_end;
+
+			if ((ranges[i].second != 0) && (ranges[i].second < to))
+			{
+				to = ranges[i].second;
+			}
+
+			if ((from < to) && (!write_sinks(sinks[i], buffer.data() + (from - position), to - from)))
+			{
+				result = false;
+			}
+
+			if ((from < to) && m_outputs[i].checksum)
+			{
+				m_outputs[i].checksum->update(buffer.data() + (from - position), to - from);
+			}
+
+			if ((ranges[i].second != 0) && (ranges[i].second <= chunk_end))
+			{
+				finished[i] = true;
+
+				if (!close_sinks(sinks[i]))
+				{
+					result = false;
+				}
+			}
+		}
+
+		position = chunk_end;
+	}
+
+	// drain the rest of output in order to let the source process finish normally
+	while (fread(buffer.data(), 1, buffer.size(), source) > 0)
+	{
+	}
+
+	if (pclose(source) != 0)
+	{
+		result = false;
+	}
+
+	for (size_t i = 0; i < m_outputs.size(); ++i)
+	{
+		if (m_outputs[i].checksum)
+		{
+			m_outputs[i].checksum->finish();
+		}
+
+		if (!sinks[i].empty())
+		{
+			if (!close_sinks(sinks[i]))
+			{
+				result = false;
+			}
+
+			if (ranges[i].second != 0)
+			{
+				fprintf(stderr, "Track ending at frame %llu lies beyond end of stream produced by command: %s\n", static_cast<unsigned long long>(*(m_outputs[i].end_frame)), m_source_command.c_str());
+				result = false;
+			}
+		}
+		else if (!finished[i])
+		{
+			fprintf(stderr, "Track starting at frame %llu lies beyond end of stream produced by command: %s\n", static_cast<unsigned long long>(m_outputs[i].start_frame), m_source_command.c_str());
+			result = false;
+		}
+	}
+
+	return result;
+}
+
+std::string stream_split_command::print() const
+{
+	std::stringstream result;
+
+	result << m_source_command << " | split";
+
+	for (auto iter = m_outputs.begin(); iter != m_outputs.end(); ++iter)
+	{
+		result << " [" << iter->start_frame << ":";
+
+		if (iter->end_frame)
+		{
+			result << *(iter->end_frame);
+		}
+
+		result << "] " << print_sinks(iter->sink_commands);
+	}
+
+	return result.str();
+}
+
+bool stream_split_command::compare(const command &other) const
+{
+	const stream_split_command &other_cmd = dynamic_cast<const stream_split_command&>(other);
+
+	return (m_source_command < other_cmd.m_source_command);
+}
+
 } // namespace dtcue
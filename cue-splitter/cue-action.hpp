@@ -23,26 +23,58 @@
 
 #include <string>
 #include <memory>
+#include <vector>
+
+#include <stdint.h>
 
 #include <dt-cue-library.hpp>
 
 namespace dtcue {
 
+std::string escape_single_quote(const std::string &input);
+
+// FNV-1a, 64 bit
+uint64_t hash_string(const std::string &value);
+
 struct command_comparator;
+class pcm_checksum;
+
+// kind of resources which mostly limit speed of command
+enum class resource_usage
+{
+	light,
+	io_bound,
+	cpu_bound
+};
 
 class command
 {
 public:
+	command();
 	virtual ~command() = default;
 
 	virtual bool run() const = 0;
 	virtual std::string print() const = 0;
 
+	// shell command with same effect, used for exporting plan into build files;
+	// empty string if command can only be run by this program
+	virtual std::string script() const;
+
+	// used by scheduler for limiting number of concurrently running commands of each kind
+	resource_usage usage() const;
+	bool reads_source() const;
+
+	void set_usage(resource_usage usage, bool reads_source);
+
 protected:
 	// compare with instance of same class only
 	virtual bool compare(const command &other) const = 0;
 
 	friend class command_comparator;
+
+private:
+	resource_usage m_usage;
+	bool m_reads_source;
 };
 
 struct command_comparator: public std::binary_function<std::shared_ptr<command>, std::shared_ptr<command>, bool>
@@ -57,6 +89,7 @@ public:
 
 	virtual bool run() const;
 	virtual std::string print() const;
+	virtual std::string script() const;
 
 protected:
 	virtual bool compare(const command &other) const;
@@ -65,6 +98,107 @@ private:
 	std::string m_command_string;
 };
 
+// Moves file into its final location. If target is located on another filesystem,
+// file is copied next to target under temporary name first and renamed after that,
+// thus target never appears partially written.
+class move_command: public command
+{
+public:
+	move_command(const std::string &source_filename, const std::string &target_filename);
+
+	std::string temporary_filename() const;
+
+	virtual bool run() const;
+	virtual std::string print() const;
+	virtual std::string script() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	std::string m_source_filename;
+	std::string m_target_filename;
+};
+
+// Drops source file from page cache once all jobs reading it are finished,
+// so that big images don't evict pages used by other processes.
+class drop_cache_command: public command
+{
+public:
+	explicit drop_cache_command(const std::string &filename);
+
+	virtual bool run() const;
+	virtual std::string print() const;
+	virtual std::string script() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	std::string m_filename;
+};
+
+// Runs every source command one after another and feeds their concatenated audio into sink commands.
+// Each source is expected to write WAV stream to its standard output, sinks receive WAV stream from standard input.
+// Every sink is fed from the same buffer, thus audio is decoded only once for any number of sinks.
+class pipe_command: public command
+{
+public:
+	pipe_command(const std::vector<std::string> &source_commands, const std::string &sink_command);
+
+	void add_sink(const std::string &sink_command);
+
+	// checksum of audio fed into sinks is computed if set
+	void set_checksum(const std::shared_ptr<pcm_checksum> &checksum);
+
+	virtual bool run() const;
+	virtual std::string print() const;
+
+	// WAV streams of several sources can't be concatenated by shell, so only single source is exported
+	virtual std::string script() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	std::vector<std::string> m_source_commands;
+	std::vector<std::string> m_sink_commands;
+	std::shared_ptr<pcm_checksum> m_checksum;
+};
+
+// Runs single source command writing WAV stream to its standard output
+// and cuts this stream into tracks on the fly, feeding every track into its own sink command.
+// Track boundaries are specified in CD frames, 1/75 of second.
+class stream_split_command: public command
+{
+public:
+	explicit stream_split_command(const std::string &source_command);
+
+	// every sink of output receives same audio, checksum of it is computed if it's set
+	void add_output(uint64_t start_frame,
+		std::experimental::optional<uint64_t> end_frame,
+		const std::vector<std::string> &sink_commands,
+		const std::shared_ptr<pcm_checksum> &checksum = std::shared_ptr<pcm_checksum>());
+
+	virtual bool run() const;
+	virtual std::string print() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	struct output
+	{
+		uint64_t start_frame;
+		std::experimental::optional<uint64_t> end_frame;
+		std::vector<std::string> sink_commands;
+		std::shared_ptr<pcm_checksum> checksum;
+	};
+
+	std::string m_source_command;
+	std::vector<output> m_outputs;
+};
+
 } // namespace dtcue
 
 #endif /* DT_CUE_ACTION_HPP */
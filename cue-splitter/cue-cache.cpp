@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-cache.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace dtcue {
+
+namespace {
+
+struct cache_entry
+{
+	std::string filename;
+	uint64_t size;
+	struct timespec modification_time;
+};
+
+bool is_older(const cache_entry &lhs, const cache_entry &rhs)
+{
+	if (lhs.modification_time.tv_sec != rhs.modification_time.tv_sec)
+	{
+		return (lhs.modification_time.tv_sec < rhs.modification_time.tv_sec);
+	}
+
+	return (lhs.modification_time.tv_nsec < rhs.modification_time.tv_nsec);
+}
+
+const char * const temporary_suffix = ".partial";
+
+// temporary files without owner, e.g. left by older versions, are removed once they're this old
+const time_t orphan_temporary_age = 24 * 60 * 60;
+
+bool has_suffix(const std::string &name, const char *suffix)
+{
+	return ((name.length() > strlen(suffix))
+		&& (name.compare(name.length() - strlen(suffix), std::string::npos, suffix) == 0));
+}
+
+// temporary file is named "<entry>.<pid>.<counter>.partial", process which created it is checked
+bool is_stale_temporary(const std::string &name, const struct stat &statbuf)
+{
+	std::string stem = name.substr(0, name.length() - strlen(temporary_suffix));
+
+	size_t counter_separator = stem.rfind('.');
+	size_t pid_separator = (counter_separator != std::string::npos) ? stem.rfind('.', counter_separator - 1) : std::string::npos;
+
+	if ((pid_separator != std::string::npos)
+		&& (counter_separator > pid_separator + 1)
+		&& (stem.find_first_not_of("0123456789", pid_separator + 1) == counter_separator))
+	{
+		pid_t owner = std::stol(stem.substr(pid_separator + 1, counter_separator - pid_separator - 1));
+
+		if (owner == getpid())
+		{
+			return false;
+		}
+
+		return ((kill(owner, 0) == -1) && (errno == ESRCH));
+	}
+
+	return (time(NULL) - statbuf.st_mtim.tv_sec > orphan_temporary_age);
+}
+
+} // unnamed namespace
+
+decode_cache::decode_cache(const std::string &directory, uint64_t size_limit)
+	: m_directory(directory),
+	m_size_limit(size_limit),
+	m_next_temporary(0)
+{
+	struct stat statbuf;
+
+	if ((stat(m_directory.c_str(), &statbuf) == -1)
+		|| (!S_ISDIR(statbuf.st_mode)))
+	{
+		throw std::invalid_argument("Cache directory '" + m_directory + "' is not a valid directory");
+	}
+}
+
+const std::string& decode_cache::directory() const
+{
+	return m_directory;
+}
+
+std::string decode_cache::cached_filename(const std::string &source_filename) const
+{
+	char resolved_name[PATH_MAX];
+	struct stat statbuf;
+
+	if ((realpath(source_filename.c_str(), resolved_name) == NULL)
+		|| (stat(resolved_name, &statbuf) == -1))
+	{
+		throw std::runtime_error("Failed to get information about file '" + source_filename + "'");
+	}
+
+	std::stringstream key;
+	key << resolved_name << '\0' << statbuf.st_size << '\0' << statbuf.st_mtim.tv_sec << '.' << statbuf.st_mtim.tv_nsec;
+
+	std::stringstream result;
+	result << m_directory << '/' << std::hex << std::setfill('0') << std::setw(16) << hash_string(key.str()) << ".wav";
+
+	return result.str();
+}
+
+std::string decode_cache::temporary_filename(const std::string &cached_filename) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::stringstream result;
+	result << cached_filename << '.' << getpid() << '.' << (m_next_temporary++) << temporary_suffix;
+
+	return result.str();
+}
+
+void decode_cache::pin(const std::string &cached_filename)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	++m_pins[cached_filename];
+}
+
+void decode_cache::release(const std::string &cached_filename)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto pinned = m_pins.find(cached_filename);
+
+	if ((pinned != m_pins.end()) && (--(pinned->second) == 0))
+	{
+		m_pins.erase(pinned);
+	}
+}
+
+void decode_cache::evict() const
+{
+	DIR *dir = opendir(m_directory.c_str());
+	if (dir == NULL)
+	{
+		return;
+	}
+
+	std::vector<cache_entry> entries;
+	uint64_t total_size = 0;
+
+	for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+
+		if ((!has_suffix(name, ".wav")) && (!has_suffix(name, temporary_suffix)))
+		{
+			continue;
+		}
+
+		struct stat statbuf;
+		cache_entry cached;
+		cached.filename = m_directory + "/" + name;
+
+		if ((stat(cached.filename.c_str(), &statbuf) == -1)
+			|| (!S_ISREG(statbuf.st_mode)))
+		{
+			continue;
+		}
+
+		// temporary files of running decoders are never touched
+		if (has_suffix(name, temporary_suffix))
+		{
+			if (is_stale_temporary(name, statbuf))
+			{
+				unlink(cached.filename.c_str());
+			}
+
+			continue;
+		}
+
+		cached.size = statbuf.st_size;
+		cached.modification_time = statbuf.st_mtim;
+		total_size += cached.size;
+
+		entries.push_back(cached);
+	}
+
+	closedir(dir);
+
+	if (m_size_limit == 0)
+	{
+		return;
+	}
+
+	std::sort(entries.begin(), entries.end(), is_older);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto entry = entries.begin(); (entry != entries.end()) && (total_size > m_size_limit); ++entry)
+	{
+		if (m_pins.find(entry->filename) != m_pins.end())
+		{
+			continue;
+		}
+
+		if (unlink(entry->filename.c_str()) == 0)
+		{
+			total_size -= entry->size;
+		}
+	}
+}
+
+cache_store_command::cache_store_command(const std::string &command_string, const std::string &temporary_filename, const std::string &cached_filename)
+	: command(),
+	m_command_string(command_string),
+	m_temporary_filename(temporary_filename),
+	m_cached_filename(cached_filename)
+{
+}
+
+bool cache_store_command::run() const
+{
+	// entry is present already, mark it as recently used
+	if (utimes(m_cached_filename.c_str(), NULL) == 0)
+	{
+		return true;
+	}
+
+	if ((system(m_command_string.c_str()) != 0)
+		|| (rename(m_temporary_filename.c_str(), m_cached_filename.c_str()) != 0))
+	{
+		unlink(m_temporary_filename.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+std::string cache_store_command::print() const
+{
+	return m_command_string + " && mv \'" + escape_single_quote(m_temporary_filename) + "\' \'" + escape_single_quote(m_cached_filename) + "\'";
+}
+
+std::string cache_store_command::script() const
+{
+	return print();
+}
+
+bool cache_store_command::compare(const command &other) const
+{
+	const cache_store_command &other_cmd = dynamic_cast<const cache_store_command&>(other);
+
+	return (m_cached_filename < other_cmd.m_cached_filename);
+}
+
+cache_evict_command::cache_evict_command(const std::shared_ptr<decode_cache> &cache)
+	: command(),
+	m_cache(cache)
+{
+}
+
+void cache_evict_command::add_pinned_entry(const std::string &cached_filename)
+{
+	m_pinned_entries.push_back(cached_filename);
+}
+
+bool cache_evict_command::run() const
+{
+	for (auto entry = m_pinned_entries.begin(); entry != m_pinned_entries.end(); ++entry)
+	{
+		m_cache->release(*entry);
+	}
+
+	m_cache->evict();
+
+	return true;
+}
+
+std::string cache_evict_command::print() const
+{
+	return "# evict least recently used entries from cache \'" + escape_single_quote(m_cache->directory()) + "\'";
+}
+
+bool cache_evict_command::compare(const command &other) const
+{
+	const cache_evict_command &other_cmd = dynamic_cast<const cache_evict_command&>(other);
+
+	return (m_cache->directory() < other_cmd.m_cache->directory());
+}
+
+} // namespace dtcue
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_CACHE_HPP
+#define DT_CUE_CACHE_HPP
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+#include "cue-action.hpp"
+
+namespace dtcue {
+
+// Directory with decoded images of sources which are slow to decode.
+// Entries are keyed by source path, size and modification time,
+// least recently used entries are removed when total size exceeds the limit.
+class decode_cache
+{
+public:
+	// size_limit of 0 means no limit
+	decode_cache(const std::string &directory, uint64_t size_limit);
+
+	decode_cache(const decode_cache &other) = delete;
+	decode_cache& operator=(const decode_cache &other) = delete;
+
+	const std::string& directory() const;
+
+	std::string cached_filename(const std::string &source_filename) const;
+
+	// file decoder writes into before it's moved into cache,
+	// name is unique among all stores of this and other processes
+	std::string temporary_filename(const std::string &cached_filename) const;
+
+	// pinned entries aren't evicted until they're released as many times as they were pinned,
+	// so that entry stored for one album isn't removed by cleanup of another one before it's read
+	void pin(const std::string &cached_filename);
+	void release(const std::string &cached_filename);
+
+	// also removes temporary files left by processes which don't run anymore
+	void evict() const;
+
+private:
+	std::string m_directory;
+	uint64_t m_size_limit;
+
+	mutable std::mutex m_mutex;
+	std::map<std::string, unsigned int> m_pins;
+	mutable unsigned int m_next_temporary;
+};
+
+// Runs decode command writing into temporary file and moves result into cache.
+// If entry is already present, only marks it as recently used.
+class cache_store_command: public command
+{
+public:
+	cache_store_command(const std::string &command_string, const std::string &temporary_filename, const std::string &cached_filename);
+
+	virtual bool run() const;
+	virtual std::string print() const;
+	virtual std::string script() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	std::string m_command_string;
+	std::string m_temporary_filename;
+	std::string m_cached_filename;
+};
+
+// Releases entries pinned for album and evicts entries which aren't pinned anymore.
+class cache_evict_command: public command
+{
+public:
+	explicit cache_evict_command(const std::shared_ptr<decode_cache> &cache);
+
+	// entry is released when command runs
+	void add_pinned_entry(const std::string &cached_filename);
+
+	virtual bool run() const;
+	virtual std::string print() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	std::shared_ptr<decode_cache> m_cache;
+	std::vector<std::string> m_pinned_entries;
+};
+
+} // namespace dtcue
+
+#endif /* DT_CUE_CACHE_HPP */
@@ -0,0 +1,664 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-checksum.hpp"
+#include "cue-probe.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include <stdio.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DT_CUE_CRC32_X86
+#include <immintrin.h>
+#endif /* x86 */
+
+namespace dtcue {
+
+namespace {
+
+// samples per CD sector
+const uint32_t sector_samples = 588;
+
+uint32_t read_le32(const unsigned char *data)
+{
+	return (static_cast<uint32_t>(data[0])
+		| (static_cast<uint32_t>(data[1]) << 8)
+		| (static_cast<uint32_t>(data[2]) << 16)
+		| (static_cast<uint32_t>(data[3]) << 24));
+}
+
+struct crc32_tables
+{
+	uint32_t values[8][256];
+
+	crc32_tables()
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t value = i;
+
+			for (int bit = 0; bit < 8; ++bit)
+			{
+				value = (value & 1) ? ((value >> 1) ^ 0xEDB88320) : (value >> 1);
+			}
+
+			values[0][i] = value;
+		}
+
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			for (int table = 1; table < 8; ++table)
+			{
+				values[table][i] = (values[table - 1][i] >> 8) ^ values[0][values[table - 1][i] & 0xFF];
+			}
+		}
+	}
+};
+
+const crc32_tables crc32_table;
+
+// state is kept inverted, as in crc32 class
+uint32_t crc32_update_scalar(uint32_t value, const unsigned char *bytes, size_t size)
+{
+	// slicing-by-8: eight table lookups per 8 bytes instead of one lookup per byte
+	while (size >= 8)
+	{
+		uint32_t low = read_le32(bytes) ^ value;
+		uint32_t high = read_le32(bytes + 4);
+
+		value = crc32_table.values[7][low & 0xFF]
+			^ crc32_table.values[6][(low >> 8) & 0xFF]
+			^ crc32_table.values[5][(low >> 16) & 0xFF]
+			^ crc32_table.values[4][low >> 24]
+			^ crc32_table.values[3][high & 0xFF]
+			^ crc32_table.values[2][(high >> 8) & 0xFF]
+			^ crc32_table.values[1][(high >> 16) & 0xFF]
+			^ crc32_table.values[0][high >> 24];
+
+		bytes += 8;
+		size -= 8;
+	}
+
+	while (size > 0)
+	{
+		value = (value >> 8) ^ crc32_table.values[0][(value ^ *bytes) & 0xFF];
+
+		++bytes;
+		--size;
+	}
+
+	return value;
+}
+
+#ifdef DT_CUE_CRC32_X86
+
+// Folding by carry-less multiplication, "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" by Intel:
+// four 128-bit lanes are folded 64 bytes ahead, then into one lane, which is reduced to 32 bits by Barrett reduction.
+// Constants are powers of x modulo bit-reflected CRC-32 polynomial. SSE4.2 crc32 instruction can't be used,
+// it computes CRC-32C with another polynomial.
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc32_update_pclmul(uint32_t value, const unsigned char *bytes, size_t size)
+{
+	if (size < 64)
+	{
+		return crc32_update_scalar(value, bytes, size);
+	}
+
+	const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+	const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+	const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163CD6124);
+	const __m128i polynomial = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+	const __m128i low_mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+	__m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+	__m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 16));
+	__m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 32));
+	__m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 48));
+
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(value));
+
+	bytes += 64;
+	size -= 64;
+
+	for ( ; size >= 64; bytes += 64, size -= 64)
+	{
+		__m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		__m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		__m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		__m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 16)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 32)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 48)));
+	}
+
+	// fold four lanes into one, then the rest of 16-byte blocks into it
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x2);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x3);
+	x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)), x4);
+
+	for ( ; size >= 16; bytes += 16, size -= 16)
+	{
+		x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_clmulepi64_si128(x1, k3k4, 0x00)),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes)));
+	}
+
+	// 128 bits to 64 bits
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, low_mask), k5k0, 0x00), x2);
+
+	// Barrett reduction to 32 bits
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, low_mask), polynomial, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, low_mask), polynomial, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return crc32_update_scalar(static_cast<uint32_t>(_mm_extract_epi32(x1, 1)), bytes, size);
+}
+
+#endif /* DT_CUE_CRC32_X86 */
+
+typedef uint32_t (*crc32_kernel)(uint32_t value, const unsigned char *bytes, size_t size);
+
+crc32_kernel select_crc32_kernel()
+{
+#ifdef DT_CUE_CRC32_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+	{
+		return crc32_update_pclmul;
+	}
+#endif /* DT_CUE_CRC32_X86 */
+
+	return crc32_update_scalar;
+}
+
+uint32_t rotate_left(uint32_t value, unsigned int count)
+{
+	return ((value << count) | (value >> (32 - count)));
+}
+
+} // unnamed namespace
+
+crc32::crc32()
+	: m_value(0xFFFFFFFF)
+{
+}
+
+void crc32::update(const void *data, size_t size)
+{
+	// CPU is checked once, same as for scanning kernels of parser
+	static const crc32_kernel kernel = select_crc32_kernel();
+
+	m_value = kernel(m_value, static_cast<const unsigned char*>(data), size);
+}
+
+uint32_t crc32::value() const
+{
+	return (m_value ^ 0xFFFFFFFF);
+}
+
+md5::md5()
+	: m_size(0)
+{
+	m_state[0] = 0x67452301;
+	m_state[1] = 0xEFCDAB89;
+	m_state[2] = 0x98BADCFE;
+	m_state[3] = 0x10325476;
+}
+
+void md5::transform(const unsigned char *block)
+{
+	static const uint32_t constants[64] = {
+		0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+		0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+		0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+		0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+		0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+		0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+		0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+		0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+	};
+
+	static const unsigned int shifts[64] = {
+		7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+		5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+		4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+		6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+	};
+
+	uint32_t words[16];
+
+	for (int i = 0; i < 16; ++i)
+	{
+		words[i] = read_le32(block + i * 4);
+	}
+
+	uint32_t a = m_state[0];
+	uint32_t b = m_state[1];
+	uint32_t c = m_state[2];
+	uint32_t d = m_state[3];
+
+	for (unsigned int i = 0; i < 64; ++i)
+	{
+		uint32_t f;
+		unsigned int g;
+
+		if (i < 16)
+		{
+			f = (b & c) | ((~b) & d);
+			g = i;
+		}
+		else if (i < 32)
+		{
+			f = (d & b) | ((~d) & c);
+			g = (5 * i + 1) % 16;
+		}
+		else if (i < 48)
+		{
+			f = b ^ c ^ d;
+			g = (3 * i + 5) % 16;
+		}
+		else
+		{
+			f = c ^ (b | (~d));
+			g = (7 * i) % 16;
+		}
+
+		uint32_t next_d = c;
+		c = b;
+		b = b + rotate_left(a + f + constants[i] + words[g], shifts[i]);
+		a = d;
+		d = next_d;
+	}
+
+	m_state[0] += a;
+	m_state[1] += b;
+	m_state[2] += c;
+	m_state[3] += d;
+}
+
+void md5::update(const void *data, size_t size)
+{
+	const unsigned char *bytes = static_cast<const unsigned char*>(data);
+	size_t buffered = m_size % 64;
+
+	m_size += size;
+
+	if (buffered != 0)
+	{
+		size_t portion = std::min(size, 64 - buffered);
+
+		memcpy(m_buffer + buffered, bytes, portion);
+		bytes += portion;
+		size -= portion;
+
+		if (buffered + portion < 64)
+		{
+			return;
+		}
+
+		transform(m_buffer);
+	}
+
+	while (size >= 64)
+	{
+		transform(bytes);
+		bytes += 64;
+		size -= 64;
+	}
+
+	memcpy(m_buffer, bytes, size);
+}
+
+std::string md5::digest()
+{
+	uint64_t bit_size = m_size * 8;
+	unsigned char padding[72];
+	size_t padding_size = ((m_size % 64) < 56) ? (56 - (m_size % 64)) : (120 - (m_size % 64));
+
+	memset(padding, 0, sizeof(padding));
+	padding[0] = 0x80;
+
+	for (int i = 0; i < 8; ++i)
+	{
+		padding[padding_size + i] = (bit_size >> (i * 8)) & 0xFF;
+	}
+
+	update(padding, padding_size + 8);
+
+	std::string result;
+
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int byte = 0; byte < 4; ++byte)
+		{
+			result.push_back(static_cast<char>((m_state[i] >> (byte * 8)) & 0xFF));
+		}
+	}
+
+	return result;
+}
+
+accuraterip_checksum::accuraterip_checksum(bool first_track, bool last_track)
+	: m_last_track(last_track),
+	m_check_start(first_track ? (sector_samples * 5) : 0),
+	m_multiplier(1),
+	m_sum_low(0),
+	m_sum_high(0),
+	m_delayed_position(0),
+	m_delayed_full(false),
+	m_partial_size(0)
+{
+	if (m_last_track)
+	{
+		m_delayed.resize(sector_samples * 5);
+	}
+}
+
+void accuraterip_checksum::add_sample(uint32_t sample)
+{
+	if (m_last_track)
+	{
+		// sample is added only once it's known not to be among the last 5 sectors
+		uint32_t delayed = m_delayed[m_delayed_position];
+		m_delayed[m_delayed_position] = sample;
+
+		m_delayed_position = (m_delayed_position + 1) % m_delayed.size();
+
+		if (!m_delayed_full)
+		{
+			m_delayed_full = (m_delayed_position == 0);
+			return;
+		}
+
+		sample = delayed;
+	}
+
+	if (m_multiplier >= m_check_start)
+	{
+		uint64_t product = static_cast<uint64_t>(sample) * m_multiplier;
+
+		m_sum_low += static_cast<uint32_t>(product);
+		m_sum_high += static_cast<uint32_t>(product >> 32);
+	}
+
+	++m_multiplier;
+}
+
+void accuraterip_checksum::update(const void *data, size_t size)
+{
+	const unsigned char *bytes = static_cast<const unsigned char*>(data);
+
+	// complete sample split between calls first
+	if (m_partial_size != 0)
+	{
+		size_t missing = std::min(sizeof(m_partial) - m_partial_size, size);
+
+		memcpy(m_partial + m_partial_size, bytes, missing);
+		m_partial_size += missing;
+		bytes += missing;
+		size -= missing;
+
+		if (m_partial_size < sizeof(m_partial))
+		{
+			return;
+		}
+
+		add_sample(read_le32(m_partial));
+		m_partial_size = 0;
+	}
+
+	// left and right 16-bit samples form one 32-bit value
+	for ( ; size >= 4; bytes += 4, size -= 4)
+	{
+		add_sample(read_le32(bytes));
+	}
+
+	memcpy(m_partial, bytes, size);
+	m_partial_size = size;
+}
+
+void accuraterip_checksum::finish()
+{
+	// samples still delayed are the last 5 sectors of the disc
+	m_delayed.clear();
+}
+
+uint32_t accuraterip_checksum::value_v1() const
+{
+	return m_sum_low;
+}
+
+uint32_t accuraterip_checksum::value_v2() const
+{
+	return (m_sum_low + m_sum_high);
+}
+
+pcm_checksum::pcm_checksum(bool first_track, bool last_track)
+	: m_has_format(false),
+	m_bytes(0),
+	m_accuraterip(first_track, last_track)
+{
+}
+
+void pcm_checksum::begin(const wave_format &format)
+{
+	m_format = format;
+	m_has_format = true;
+}
+
+void pcm_checksum::update(const void *data, size_t size)
+{
+	m_bytes += size;
+
+	m_crc32.update(data, size);
+
+	// FLAC signs samples of any width, WAV keeps 8-bit samples unsigned
+	if (m_format.bits_per_sample > 8)
+	{
+		m_md5.update(data, size);
+	}
+
+	if (has_accuraterip())
+	{
+		m_accuraterip.update(data, size);
+	}
+}
+
+void pcm_checksum::finish()
+{
+	if (m_format.bits_per_sample > 8)
+	{
+		m_md5_signature = m_md5.digest();
+	}
+
+	m_accuraterip.finish();
+}
+
+bool pcm_checksum::has_format() const
+{
+	return m_has_format;
+}
+
+const wave_format& pcm_checksum::format() const
+{
+	return m_format;
+}
+
+uint64_t pcm_checksum::samples() const
+{
+	return ((m_format.block_align != 0) ? (m_bytes / m_format.block_align) : 0);
+}
+
+uint32_t pcm_checksum::crc32_value() const
+{
+	return m_crc32.value();
+}
+
+const std::string& pcm_checksum::md5_signature() const
+{
+	return m_md5_signature;
+}
+
+bool pcm_checksum::has_accuraterip() const
+{
+	return ((m_format.channels == 2) && (m_format.sample_rate == 44100) && (m_format.bits_per_sample == 16));
+}
+
+uint32_t pcm_checksum::accuraterip_v1() const
+{
+	return m_accuraterip.value_v1();
+}
+
+uint32_t pcm_checksum::accuraterip_v2() const
+{
+	return m_accuraterip.value_v2();
+}
+
+verify_command::verify_command(const std::shared_ptr<pcm_checksum> &checksum,
+	const std::string &flac_filename,
+	uint64_t expected_samples,
+	uint64_t allowed_difference,
+	const std::string &expected_md5_signature)
+	: command(),
+	m_checksum(checksum),
+	m_flac_filename(flac_filename),
+	m_expected_samples(expected_samples),
+	m_allowed_difference(allowed_difference),
+	m_expected_md5_signature(expected_md5_signature)
+{
+}
+
+bool verify_command::run() const
+{
+	if (!m_checksum->has_format())
+	{
+		fprintf(stderr, "Verification of %s failed: no audio was encoded\n", m_flac_filename.c_str());
+		return false;
+	}
+
+	audio_properties encoded;
+
+	try
+	{
+		encoded = probe_audio_file(m_flac_filename);
+	}
+	catch (const std::exception &exc)
+	{
+		fprintf(stderr, "Verification of %s failed: %s\n", m_flac_filename.c_str(), exc.what());
+		return false;
+	}
+
+	bool result = true;
+	uint64_t samples = m_checksum->samples();
+
+	if (encoded.total_samples != samples)
+	{
+		fprintf(stderr, "Verification of %s failed: %llu samples were encoded, file contains %llu samples\n", m_flac_filename.c_str(), static_cast<unsigned long long>(samples), static_cast<unsigned long long>(encoded.total_samples));
+		result = false;
+	}
+
+	if ((!m_checksum->md5_signature().empty())
+		&& (!encoded.md5_signature.empty())
+		&& (m_checksum->md5_signature() != encoded.md5_signature))
+	{
+		fprintf(stderr, "Verification of %s failed: MD5 signature of file differs from encoded audio\n", m_flac_filename.c_str());
+		result = false;
+	}
+
+	if ((m_expected_samples != 0)
+		&& (((samples > m_expected_samples) ? (samples - m_expected_samples) : (m_expected_samples - samples)) > m_allowed_difference))
+	{
+		fprintf(stderr, "Verification of %s failed: expected %llu samples, got %llu samples\n", m_flac_filename.c_str(), static_cast<unsigned long long>(m_expected_samples), static_cast<unsigned long long>(samples));
+		result = false;
+	}
+
+	if ((!m_expected_md5_signature.empty())
+		&& (!m_checksum->md5_signature().empty())
+		&& (m_checksum->md5_signature() != m_expected_md5_signature))
+	{
+		fprintf(stderr, "Verification of %s failed: MD5 signature differs from source file\n", m_flac_filename.c_str());
+		result = false;
+	}
+
+	if (result)
+	{
+		std::stringstream report;
+
+		report << "Verified " << m_flac_filename << ": " << samples << " samples, CRC32 "
+			<< std::hex << std::setfill('0') << std::setw(8) << m_checksum->crc32_value();
+
+		if (!m_checksum->md5_signature().empty())
+		{
+			report << ", MD5 " << make_hex_digest(m_checksum->md5_signature());
+		}
+
+		if (m_checksum->has_accuraterip())
+		{
+			report << ", AccurateRip v1 " << std::setw(8) << m_checksum->accuraterip_v1()
+				<< ", v2 " << std::setw(8) << m_checksum->accuraterip_v2();
+		}
+
+		printf("%s\n", report.str().c_str());
+	}
+
+	return result;
+}
+
+std::string verify_command::print() const
+{
+	return "# verify \'" + escape_single_quote(m_flac_filename) + "\'";
+}
+
+bool verify_command::compare(const command &other) const
+{
+	const verify_command &other_cmd = dynamic_cast<const verify_command&>(other);
+
+	return (m_flac_filename < other_cmd.m_flac_filename);
+}
+
+std::string make_hex_digest(const std::string &digest)
+{
+	std::stringstream result;
+
+	for (auto iter = digest.begin(); iter != digest.end(); ++iter)
+	{
+		result << std::hex << std::setfill('0') << std::setw(2) << static_cast<unsigned int>(static_cast<unsigned char>(*iter));
+	}
+
+	return result.str();
+}
+
+} // namespace dtcue
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_CHECKSUM_HPP
+#define DT_CUE_CHECKSUM_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <stdint.h>
+
+#include "cue-action.hpp"
+#include "cue-wave.hpp"
+
+namespace dtcue {
+
+// CRC-32 as used by zlib and WAV tools. Computed by carry-less multiplication if CPU supports it,
+// which is chosen at runtime, otherwise 8 bytes at a time by table lookups.
+class crc32
+{
+public:
+	crc32();
+
+	void update(const void *data, size_t size);
+	uint32_t value() const;
+
+private:
+	uint32_t m_value;
+};
+
+class md5
+{
+public:
+	md5();
+
+	void update(const void *data, size_t size);
+
+	// 16 bytes, no more data may be added after digest is taken
+	std::string digest();
+
+private:
+	void transform(const unsigned char *block);
+
+	uint32_t m_state[4];
+	uint64_t m_size;
+	unsigned char m_buffer[64];
+};
+
+// AccurateRip checksums of 16-bit stereo track. First 5 CD sectors of the first track except their last sample
+// and last 5 sectors of the last track of a disc are not included.
+class accuraterip_checksum
+{
+public:
+	accuraterip_checksum(bool first_track, bool last_track);
+
+	void update(const void *data, size_t size);
+	void finish();
+
+	uint32_t value_v1() const;
+	uint32_t value_v2() const;
+
+private:
+	void add_sample(uint32_t sample);
+
+	bool m_last_track;
+	// multiplier of the first sample is 1
+	uint32_t m_check_start;
+	uint32_t m_multiplier;
+
+	uint32_t m_sum_low;
+	uint32_t m_sum_high;
+
+	// last track: samples are added with a delay, those left at the end are dropped
+	std::vector<uint32_t> m_delayed;
+	size_t m_delayed_position;
+	bool m_delayed_full;
+
+	unsigned char m_partial[4];
+	size_t m_partial_size;
+};
+
+// Checksums of PCM data of a track, computed while it's streamed into encoder
+class pcm_checksum
+{
+public:
+	pcm_checksum(bool first_track, bool last_track);
+
+	void begin(const wave_format &format);
+	void update(const void *data, size_t size);
+	void finish();
+
+	bool has_format() const;
+	const wave_format& format() const;
+
+	uint64_t samples() const;
+	uint32_t crc32_value() const;
+
+	// empty if format of samples differs from one used by FLAC for its MD5 signature
+	const std::string& md5_signature() const;
+
+	// AccurateRip checksums are computed only for CD audio
+	bool has_accuraterip() const;
+	uint32_t accuraterip_v1() const;
+	uint32_t accuraterip_v2() const;
+
+private:
+	bool m_has_format;
+	wave_format m_format;
+	uint64_t m_bytes;
+
+	crc32 m_crc32;
+	md5 m_md5;
+	std::string m_md5_signature;
+	accuraterip_checksum m_accuraterip;
+};
+
+// Compares checksums of data fed into encoder with FLAC file produced by it:
+// number of samples and MD5 signature from STREAMINFO have to match, number of samples
+// has to match length of INDEX range and MD5 signature of whole source file is compared if it's known.
+class verify_command: public command
+{
+public:
+	verify_command(const std::shared_ptr<pcm_checksum> &checksum,
+		const std::string &flac_filename,
+		uint64_t expected_samples,
+		uint64_t allowed_difference,
+		const std::string &expected_md5_signature);
+
+	virtual bool run() const;
+	virtual std::string print() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	std::shared_ptr<pcm_checksum> m_checksum;
+	std::string m_flac_filename;
+	uint64_t m_expected_samples;
+	uint64_t m_allowed_difference;
+	std::string m_expected_md5_signature;
+};
+
+std::string make_hex_digest(const std::string &digest);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_CHECKSUM_HPP */
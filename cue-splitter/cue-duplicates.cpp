@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-duplicates.hpp"
+#include "cue-probe.hpp"
+
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+namespace dtcue {
+
+namespace {
+
+void find_cue_files(const std::string &directory, std::vector<std::string> &cue_files)
+{
+	DIR *dir = opendir(directory.c_str());
+	if (dir == NULL)
+	{
+		return;
+	}
+
+	for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir))
+	{
+		if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+		{
+			continue;
+		}
+
+		std::string path = (directory.back() == '/') ? (directory + entry->d_name) : (directory + "/" + entry->d_name);
+		size_t name_length = strlen(entry->d_name);
+		struct stat statbuf;
+
+		if (lstat(path.c_str(), &statbuf) != 0)
+		{
+			continue;
+		}
+
+		if (S_ISDIR(statbuf.st_mode))
+		{
+			find_cue_files(path, cue_files);
+		}
+		else if (S_ISREG(statbuf.st_mode) && (name_length > 4) && (strcasecmp(entry->d_name + name_length - 4, ".cue") == 0))
+		{
+			cue_files.push_back(path);
+		}
+	}
+
+	closedir(dir);
+}
+
+} // unnamed namespace
+
+std::string album_location(const std::string &directory)
+{
+	char resolved[PATH_MAX];
+
+	if (realpath(directory.empty() ? "." : directory.c_str(), resolved) == NULL)
+	{
+		return directory;
+	}
+
+	return resolved;
+}
+
+disc_toc read_disc_toc(const cue &cuesheet, const std::string &source_directory)
+{
+	std::map<std::string, uint64_t> file_frames;
+
+	for (auto track = cuesheet.tracks.begin(); track != cuesheet.tracks.end(); ++track)
+	{
+		for (auto filename = track->files.begin(); filename != track->files.end(); ++filename)
+		{
+			if (file_frames.find(*filename) != file_frames.end())
+			{
+				continue;
+			}
+
+			std::string path = *filename;
+
+			if ((!source_directory.empty()) && (!path.empty()) && (path[0] != '/'))
+			{
+				path = (source_directory.back() == '/') ? (source_directory + path) : (source_directory + "/" + path);
+			}
+
+			// files of unknown length are reported by make_disc_toc() only if their length is needed
+			if (can_probe_audio_file(path))
+			{
+				audio_properties properties = probe_audio_file(path);
+
+				if ((properties.total_samples != 0) && (properties.sample_rate != 0))
+				{
+					file_frames[*filename] = properties.total_samples * 75 / properties.sample_rate;
+				}
+			}
+		}
+	}
+
+	return make_disc_toc(cuesheet, file_frames);
+}
+
+bool index_library(const std::string &directory, const std::string &index_filename, bool verbose)
+{
+	std::vector<std::string> cue_files;
+	find_cue_files(directory, cue_files);
+
+	disc_index library;
+
+	for (auto cue_filename = cue_files.begin(); cue_filename != cue_files.end(); ++cue_filename)
+	{
+		size_t separator = cue_filename->rfind('/');
+		std::string cue_directory = (separator != std::string::npos) ? cue_filename->substr(0, separator + 1) : std::string();
+
+		try
+		{
+			disc_toc toc = read_disc_toc(parse_cue_file(*cue_filename), cue_directory);
+			disc_record record = disc_index::make_record(toc, album_location(cue_directory));
+
+			if (verbose)
+			{
+				printf("%s %s %s\n", record.musicbrainz_id.c_str(), record.freedb_id.c_str(), cue_filename->c_str());
+			}
+
+			library.add(record);
+		}
+		catch (const std::exception &exc)
+		{
+			fprintf(stderr, "Skipping cue sheet '%s': %s\n", cue_filename->c_str(), exc.what());
+		}
+	}
+
+	try
+	{
+		library.save(index_filename);
+	}
+	catch (const std::exception &exc)
+	{
+		fprintf(stderr, "%s\n", exc.what());
+		return false;
+	}
+
+	if (verbose)
+	{
+		printf("Indexed %zu albums of %zu cue sheets\n", library.size(), cue_files.size());
+	}
+
+	return true;
+}
+
+} // namespace dtcue
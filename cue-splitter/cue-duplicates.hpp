@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_DUPLICATES_HPP
+#define DT_CUE_DUPLICATES_HPP
+
+#include <string>
+
+#include <stdint.h>
+
+#include <dt-cue-library.hpp>
+#include <dt-cue-discid.hpp>
+
+namespace dtcue {
+
+// rips of same disc made by different drives differ by their read offsets, which are at most a few frames;
+// more would match different discs having similar tracks
+const uint32_t duplicate_tolerance_frames = 3;
+
+// canonical path of directory holding the album, used as its location in disc index
+std::string album_location(const std::string &directory);
+
+// lengths of files are read from their headers, relative filenames are resolved against source directory,
+// throws if table of contents can't be built
+disc_toc read_disc_toc(const cue &cuesheet, const std::string &source_directory);
+
+// finds cue sheets in directory and its subdirectories and writes index of all their albums,
+// returns false if index can't be written
+bool index_library(const std::string &directory, const std::string &index_filename, bool verbose);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_DUPLICATES_HPP */
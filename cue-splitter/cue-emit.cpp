@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-emit.hpp"
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace dtcue {
+
+namespace {
+
+std::string escape_ninja_path(const std::string &path)
+{
+	std::string result;
+
+	for (auto iter = path.begin(); iter != path.end(); ++iter)
+	{
+		if ((*iter == '$') || (*iter == ' ') || (*iter == ':'))
+		{
+			result.push_back('$');
+		}
+
+		result.push_back(*iter);
+	}
+
+	return result;
+}
+
+std::string escape_ninja_value(const std::string &value)
+{
+	std::string result;
+
+	for (auto iter = value.begin(); iter != value.end(); ++iter)
+	{
+		if (*iter == '$')
+		{
+			result.push_back('$');
+		}
+
+		result.push_back(*iter);
+	}
+
+	return result;
+}
+
+std::string escape_make_path(const std::string &path)
+{
+	std::string result;
+
+	for (auto iter = path.begin(); iter != path.end(); ++iter)
+	{
+		if (*iter == '$')
+		{
+			result.push_back('$');
+		}
+		else if ((*iter == ' ') || (*iter == ':') || (*iter == '#') || (*iter == '%') || (*iter == '\\'))
+		{
+			result.push_back('\\');
+		}
+
+		result.push_back(*iter);
+	}
+
+	return result;
+}
+
+std::string escape_make_recipe(const std::string &recipe)
+{
+	return escape_ninja_value(recipe);
+}
+
+std::string join_paths(const std::vector<std::string> &paths, std::string (*escape)(const std::string&))
+{
+	std::string result;
+
+	for (auto path = paths.begin(); path != paths.end(); ++path)
+	{
+		result += " " + escape(*path);
+	}
+
+	return result;
+}
+
+// job as it's written into build file
+struct build_edge
+{
+	std::vector<std::string> outputs;
+	std::vector<std::string> inputs;
+
+	// outputs of prerequisite jobs
+	std::vector<std::string> prerequisite_outputs;
+
+	std::string script;
+	resource_usage usage;
+};
+
+std::vector<build_edge> make_edges(const std::vector<std::shared_ptr<job> > &jobs, const std::string &stamp_directory)
+{
+	std::vector<build_edge> result;
+	std::map<const job*, std::vector<std::string> > job_outputs;
+	std::set<std::string> stamps;
+
+	for (auto current = jobs.begin(); current != jobs.end(); ++current)
+	{
+		build_edge edge;
+		edge.usage = resource_usage::light;
+
+		std::string commands;
+
+		for (auto command = (*current)->commands.begin(); command != (*current)->commands.end(); ++command)
+		{
+			std::string command_script = (*command)->script();
+
+			if (command_script.empty())
+			{
+				throw std::runtime_error("Action can't be exported into build file: " + (*command)->print());
+			}
+
+			commands += (commands.empty() ? "" : " && ") + command_script;
+
+			if (((*command)->usage() == resource_usage::cpu_bound)
+				|| (((*command)->usage() == resource_usage::io_bound) && (edge.usage == resource_usage::light)))
+			{
+				edge.usage = (*command)->usage();
+			}
+		}
+
+		edge.outputs = (*current)->outputs;
+		edge.inputs = (*current)->inputs;
+
+		if (edge.outputs.empty())
+		{
+			std::stringstream stamp;
+			stamp << std::hex << hash_string(commands);
+
+			std::string stamp_filename = (stamp_directory.empty() ? std::string() : (stamp_directory + "/")) + "job-" + stamp.str() + ".stamp";
+
+			// same commands are run only once
+			if (!stamps.insert(stamp_filename).second)
+			{
+				job_outputs[current->get()].push_back(stamp_filename);
+				continue;
+			}
+
+			edge.outputs.push_back(stamp_filename);
+
+			commands += " && mkdir -p \'" + escape_single_quote(stamp_directory.empty() ? std::string(".") : stamp_directory) + "\'"
+				+ " && touch \'" + escape_single_quote(stamp_filename) + "\'";
+		}
+
+		for (auto prerequisite = (*current)->prerequisites.begin(); prerequisite != (*current)->prerequisites.end(); ++prerequisite)
+		{
+			const std::vector<std::string> &outputs = job_outputs[prerequisite->get()];
+			edge.prerequisite_outputs.insert(edge.prerequisite_outputs.end(), outputs.begin(), outputs.end());
+		}
+
+		// pipes have to fail if any command in them fails, like they do when run internally
+		edge.script = "set -o pipefail; " + commands;
+
+		job_outputs[current->get()] = edge.outputs;
+		result.push_back(edge);
+	}
+
+	return result;
+}
+
+void write_ninja_header(FILE *output)
+{
+	fprintf(output, "# generated by dt-cue-split\n\n");
+	fprintf(output, "ninja_required_version = 1.3\n\n");
+}
+
+// pool of depth 0 is unlimited, shared declarations have both pools so that any album plan may refer to them
+void write_ninja_pools(FILE *output, const scheduler_limits &limits, bool shared)
+{
+	if (shared || (limits.cpu_bound_commands != 0))
+	{
+		fprintf(output, "pool cpu_bound\n  depth = %u\n\n", limits.cpu_bound_commands);
+	}
+
+	if (shared || (limits.io_bound_commands != 0))
+	{
+		fprintf(output, "pool io_bound\n  depth = %u\n\n", limits.io_bound_commands);
+	}
+}
+
+void write_ninja(FILE *output, const std::vector<build_edge> &edges, const scheduler_limits &limits, bool shared_pools)
+{
+	write_ninja_header(output);
+
+	if (!shared_pools)
+	{
+		write_ninja_pools(output, limits, false);
+	}
+
+	// outputs whose content didn't change don't trigger jobs depending on them
+	fprintf(output, "rule job\n  command = /bin/bash -c $script\n  description = $description\n  restat = 1\n\n");
+
+	for (auto edge = edges.begin(); edge != edges.end(); ++edge)
+	{
+		fprintf(output, "build%s: job%s", join_paths(edge->outputs, escape_ninja_path).c_str(), join_paths(edge->inputs, escape_ninja_path).c_str());
+
+		if (!edge->prerequisite_outputs.empty())
+		{
+			fprintf(output, " |%s", join_paths(edge->prerequisite_outputs, escape_ninja_path).c_str());
+		}
+
+		fprintf(output, "\n  script = \'%s\'\n", escape_ninja_value(escape_single_quote(edge->script)).c_str());
+		fprintf(output, "  description = %s\n", escape_ninja_value(edge->outputs.front()).c_str());
+
+		if ((edge->usage == resource_usage::cpu_bound) && (shared_pools || (limits.cpu_bound_commands != 0)))
+		{
+			fprintf(output, "  pool = cpu_bound\n");
+		}
+		else if ((edge->usage == resource_usage::io_bound) && (shared_pools || (limits.io_bound_commands != 0)))
+		{
+			fprintf(output, "  pool = io_bound\n");
+		}
+
+		fprintf(output, "\n");
+	}
+}
+
+void write_make(FILE *output, const std::vector<build_edge> &edges)
+{
+	fprintf(output, "# generated by dt-cue-split\n\n");
+
+	// pipes have to fail if any command in them fails
+	fprintf(output, "SHELL := /bin/bash\n");
+	fprintf(output, ".DELETE_ON_ERROR:\n\n");
+
+	fprintf(output, "all:");
+
+	for (auto edge = edges.begin(); edge != edges.end(); ++edge)
+	{
+		fprintf(output, "%s", join_paths(edge->outputs, escape_make_path).c_str());
+	}
+
+	fprintf(output, "\n.PHONY: all\n\n");
+
+	for (auto edge = edges.begin(); edge != edges.end(); ++edge)
+	{
+		fprintf(output, "%s:%s%s\n", escape_make_path(edge->outputs.front()).c_str(),
+			join_paths(edge->inputs, escape_make_path).c_str(),
+			join_paths(edge->prerequisite_outputs, escape_make_path).c_str());
+
+		fprintf(output, "\t%s\n", escape_make_recipe(edge->script).c_str());
+
+		// rule with several targets would be run once per target, other outputs are produced along with the first one
+		for (auto extra_output = std::next(edge->outputs.begin()); extra_output != edge->outputs.end(); ++extra_output)
+		{
+			fprintf(output, "%s: %s ;\n", escape_make_path(*extra_output).c_str(), escape_make_path(edge->outputs.front()).c_str());
+		}
+
+		fprintf(output, "\n");
+	}
+}
+
+} // unnamed namespace
+
+build_format parse_build_format(const std::string &name)
+{
+	if (name == "ninja")
+	{
+		return build_format::ninja;
+	}
+
+	if (name == "ninja-album")
+	{
+		return build_format::ninja_album;
+	}
+
+	if (name == "ninja-pools")
+	{
+		return build_format::ninja_pools;
+	}
+
+	if (name == "make")
+	{
+		return build_format::make;
+	}
+
+	throw std::invalid_argument("Unsupported build file format: " + name);
+}
+
+void write_build_graph(FILE *output, build_format format, const std::vector<std::shared_ptr<job> > &jobs, const scheduler_limits &limits, const std::string &stamp_directory)
+{
+	std::vector<build_edge> edges = make_edges(jobs, stamp_directory);
+
+	switch (format)
+	{
+	case build_format::ninja:
+		write_ninja(output, edges, limits, false);
+		break;
+
+	case build_format::ninja_album:
+		write_ninja(output, edges, limits, true);
+		break;
+
+	case build_format::ninja_pools:
+		write_ninja_header(output);
+		write_ninja_pools(output, limits, true);
+		break;
+
+	case build_format::make:
+		write_make(output, edges);
+		break;
+	}
+}
+
+} // namespace dtcue
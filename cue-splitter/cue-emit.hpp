@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_EMIT_HPP
+#define DT_CUE_EMIT_HPP
+
+#include <string>
+#include <memory>
+#include <vector>
+
+#include <stdio.h>
+
+#include "cue-scheduler.hpp"
+
+namespace dtcue {
+
+enum class build_format
+{
+	ninja,
+
+	// plan of one album without pool declarations, included by subninja from file written as ninja_pools,
+	// so that plans of several albums share limits
+	ninja_album,
+
+	// declarations of pools only, no jobs are needed
+	ninja_pools,
+
+	make
+};
+
+// throws std::invalid_argument for unknown format
+build_format parse_build_format(const std::string &name);
+
+// Writes jobs as build graph, so that they can be run by ninja or make instead of internal scheduler.
+// Job without known outputs produces stamp file in stamp directory. Prerequisites of job become its dependencies,
+// limits of cpu-bound and io-bound commands become pools of ninja, declared either in the same file
+// or once in shared file for all albums.
+// Throws std::runtime_error if some command can't be expressed as shell command.
+void write_build_graph(FILE *output, build_format format, const std::vector<std::shared_ptr<job> > &jobs, const scheduler_limits &limits, const std::string &stamp_directory);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_EMIT_HPP */
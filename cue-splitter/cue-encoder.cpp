@@ -0,0 +1,444 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-encoder.hpp"
+#include "cue-journal.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dtcue {
+
+const char * const recompress_list_filename = ".dt-cue-split.recompress";
+
+namespace {
+
+// typical speed of flac presets relative to the best one
+const double relative_speed[encoder_tuner::best_level + 1] = { 6.0, 5.5, 5.0, 4.5, 3.5, 3.0, 2.5, 1.3, 1.0 };
+
+// chosen level has to be faster than required by this factor, since measurements vary between tracks
+const double speed_margin = 1.2;
+
+// weight of the newest measurement
+const double speed_smoothing = 0.3;
+
+// how often load average is checked while waiting for idle machine
+const unsigned int idle_check_seconds = 30;
+
+std::string directory_of(const std::string &filename)
+{
+	size_t separator = filename.rfind('/');
+
+	if (separator == std::string::npos)
+	{
+		return std::string();
+	}
+
+	return filename.substr(0, separator + 1);
+}
+
+std::vector<std::string> read_list(const std::string &list_filename)
+{
+	std::ifstream input(list_filename.c_str());
+	std::vector<std::string> result;
+	std::set<std::string> seen;
+	std::string line;
+
+	while (std::getline(input, line))
+	{
+		if ((!line.empty()) && seen.insert(line).second)
+		{
+			result.push_back(line);
+		}
+	}
+
+	return result;
+}
+
+// tracks appended by running splitter meanwhile are kept
+void remove_from_list(const std::string &list_filename, const std::set<std::string> &done)
+{
+	std::vector<std::string> left = read_list(list_filename);
+	left.erase(std::remove_if(left.begin(), left.end(), [&done](const std::string &name) { return (done.find(name) != done.end()); }), left.end());
+
+	if (left.empty())
+	{
+		unlink(list_filename.c_str());
+		return;
+	}
+
+	std::string temporary_filename = list_filename + ".tmp";
+
+	{
+		std::ofstream output(temporary_filename.c_str(), std::ios::trunc);
+
+		for (auto name = left.begin(); name != left.end(); ++name)
+		{
+			output << *name << '\n';
+		}
+
+		if (!output)
+		{
+			throw std::runtime_error("Failed to write file '" + temporary_filename + "'");
+		}
+	}
+
+	if (rename(temporary_filename.c_str(), list_filename.c_str()) != 0)
+	{
+		throw std::runtime_error("Failed to replace file '" + list_filename + "': " + strerror(errno));
+	}
+}
+
+void find_lists(const std::string &directory, std::vector<std::string> &lists)
+{
+	DIR *dir = opendir(directory.c_str());
+	if (dir == NULL)
+	{
+		return;
+	}
+
+	for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir))
+	{
+		if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+		{
+			continue;
+		}
+
+		std::string path = (directory.back() == '/') ? (directory + entry->d_name) : (directory + "/" + entry->d_name);
+		struct stat statbuf;
+
+		if (lstat(path.c_str(), &statbuf) != 0)
+		{
+			continue;
+		}
+
+		if (S_ISDIR(statbuf.st_mode))
+		{
+			find_lists(path, lists);
+		}
+		else if (S_ISREG(statbuf.st_mode) && (strcmp(entry->d_name, recompress_list_filename) == 0))
+		{
+			lists.push_back(path);
+		}
+	}
+
+	closedir(dir);
+}
+
+void wait_for_idle(double idle_load, bool verbose)
+{
+	bool reported = false;
+
+	for (;;)
+	{
+		double load = 0;
+
+		if ((getloadavg(&load, 1) != 1) || (load < idle_load))
+		{
+			return;
+		}
+
+		if (verbose && (!reported))
+		{
+			printf("# waiting for load average %.2f to drop below %.2f\n", load, idle_load);
+			fflush(stdout);
+			reported = true;
+		}
+
+		sleep(idle_check_seconds);
+	}
+}
+
+} // unnamed namespace
+
+encoder_tuner::encoder_tuner(uint64_t target_rate, unsigned int deadline_seconds, unsigned int parallel_jobs)
+	: m_target_rate(target_rate),
+	m_deadline_seconds(deadline_seconds),
+	m_parallel_jobs((parallel_jobs != 0) ? parallel_jobs : 1),
+	m_start_time(std::chrono::steady_clock::now()),
+	m_pending_bytes(0)
+{
+	for (unsigned int level = 0; level <= best_level; ++level)
+	{
+		m_speed[level] = 0;
+	}
+}
+
+void encoder_tuner::add_pending(uint64_t decoded_bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_pending_bytes += decoded_bytes;
+}
+
+unsigned int encoder_tuner::choose_level() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	double required_speed = static_cast<double>(m_target_rate) / m_parallel_jobs;
+
+	if (m_deadline_seconds != 0)
+	{
+		double seconds_left = m_deadline_seconds - std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start_time).count();
+
+		if (seconds_left <= 0)
+		{
+			return 0;
+		}
+
+		required_speed = std::max(required_speed, m_pending_bytes / seconds_left / m_parallel_jobs);
+	}
+
+	// first track is encoded at best level and its speed is used for estimating speed of other levels
+	for (unsigned int level = best_level + 1; level > 0; --level)
+	{
+		double speed = estimate_speed(level - 1);
+
+		if ((speed == 0) || (speed >= required_speed * speed_margin))
+		{
+			return (level - 1);
+		}
+	}
+
+	return 0;
+}
+
+void encoder_tuner::record(unsigned int level, uint64_t decoded_bytes, double seconds, const std::string &output_filename)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_pending_bytes -= std::min(m_pending_bytes, decoded_bytes);
+
+	if ((seconds > 0) && (decoded_bytes != 0))
+	{
+		double speed = decoded_bytes / seconds;
+
+		m_speed[level] = (m_speed[level] == 0) ? speed : (m_speed[level] * (1 - speed_smoothing) + speed * speed_smoothing);
+	}
+
+	if (level < best_level)
+	{
+		// list is placed next to track and refers to it by name only
+		std::string directory = directory_of(output_filename);
+		std::string list_filename = directory + recompress_list_filename;
+		std::string line = output_filename.substr(directory.length()) + "\n";
+
+		int fd = open(list_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		bool written = (fd != -1) && (write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size()));
+
+		if (fd != -1)
+		{
+			close(fd);
+		}
+
+		if (!written)
+		{
+			throw std::runtime_error("Failed to write file '" + list_filename + "'");
+		}
+	}
+}
+
+double encoder_tuner::estimate_speed(unsigned int level) const
+{
+	if (m_speed[level] != 0)
+	{
+		return m_speed[level];
+	}
+
+	// use the closest measured level
+	for (unsigned int distance = 1; distance <= best_level; ++distance)
+	{
+		if ((level >= distance) && (m_speed[level - distance] != 0))
+		{
+			return m_speed[level - distance] * relative_speed[level] / relative_speed[level - distance];
+		}
+
+		if ((level + distance <= best_level) && (m_speed[level + distance] != 0))
+		{
+			return m_speed[level + distance] * relative_speed[level] / relative_speed[level + distance];
+		}
+	}
+
+	return 0;
+}
+
+tuned_encode_command::tuned_encode_command(const std::shared_ptr<encoder_tuner> &tuner, const factory &make_command, uint64_t decoded_bytes, const std::string &output_filename)
+	: command(),
+	m_tuner(tuner),
+	m_make_command(make_command),
+	m_decoded_bytes(decoded_bytes),
+	m_output_filename(output_filename)
+{
+	m_tuner->add_pending(m_decoded_bytes);
+}
+
+bool tuned_encode_command::run() const
+{
+	unsigned int level = m_tuner->choose_level();
+
+	auto start_time = std::chrono::steady_clock::now();
+
+	if (!m_make_command(level)->run())
+	{
+		return false;
+	}
+
+	try
+	{
+		m_tuner->record(level, m_decoded_bytes, std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count(), m_output_filename);
+	}
+	catch (const std::exception &)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+std::string tuned_encode_command::print() const
+{
+	// actual level is chosen when command is started
+	return m_make_command(m_tuner->choose_level())->print();
+}
+
+std::string tuned_encode_command::script() const
+{
+	return m_make_command(encoder_tuner::best_level)->script();
+}
+
+bool tuned_encode_command::compare(const command &other) const
+{
+	const tuned_encode_command &other_cmd = dynamic_cast<const tuned_encode_command&>(other);
+
+	return (m_output_filename < other_cmd.m_output_filename);
+}
+
+bool recompress_when_idle(const std::string &directory, double idle_load, bool verbose, bool dry_run)
+{
+	std::vector<std::string> lists;
+	bool result = true;
+
+	find_lists(directory, lists);
+
+	for (auto list = lists.begin(); list != lists.end(); ++list)
+	{
+		std::vector<std::string> tracks = read_list(*list);
+		std::set<std::string> done;
+
+		// tracks are recorded in journal of their directory, recompressed ones have to be recorded again so that they aren't split again on resume
+		std::unique_ptr<split_journal> journal;
+		std::string journal_path = directory_of(*list) + journal_filename;
+
+		if ((!dry_run) && (access(journal_path.c_str(), F_OK) == 0))
+		{
+			try
+			{
+				journal.reset(new split_journal(journal_path, false));
+			}
+			catch (const std::exception &e)
+			{
+				fprintf(stderr, "%s\n", e.what());
+				result = false;
+			}
+		}
+
+		for (auto track = tracks.begin(); track != tracks.end(); ++track)
+		{
+			std::string track_filename = directory_of(*list) + *track;
+			std::string temporary_filename = track_filename + ".recompress";
+
+			std::stringstream cmdstream;
+			cmdstream << "nice -n 19 flac -" << encoder_tuner::best_level << " -F --no-lax -s -f -o \'" << escape_single_quote(temporary_filename) << "\' \'" << escape_single_quote(track_filename) << "\'";
+
+			if (access(track_filename.c_str(), F_OK) != 0)
+			{
+				// track was removed or renamed since it was encoded
+				done.insert(*track);
+				continue;
+			}
+
+			if (verbose)
+			{
+				printf("%s\n", cmdstream.str().c_str());
+			}
+
+			if (dry_run)
+			{
+				continue;
+			}
+
+			wait_for_idle(idle_load, verbose);
+
+			// records of tracks changed by user are left as they are
+			std::vector<std::string> journal_keys;
+			if (journal)
+			{
+				journal_keys = journal->find_unchanged(track_filename);
+			}
+
+			// flac keeps tags of FLAC input, original track is replaced only when new one is complete
+			if ((!external_command(cmdstream.str()).run())
+				|| (rename(temporary_filename.c_str(), track_filename.c_str()) != 0))
+			{
+				fprintf(stderr, "Failed to recompress track %s\n", track_filename.c_str());
+				unlink(temporary_filename.c_str());
+				result = false;
+				continue;
+			}
+
+			try
+			{
+				for (auto key = journal_keys.begin(); key != journal_keys.end(); ++key)
+				{
+					journal->record_completed(*key, *(journal->find(*key)));
+				}
+			}
+			catch (const std::exception &e)
+			{
+				fprintf(stderr, "%s\n", e.what());
+				result = false;
+			}
+
+			done.insert(*track);
+			remove_from_list(*list, done);
+		}
+
+		if ((!dry_run) && (!done.empty()))
+		{
+			remove_from_list(*list, done);
+		}
+	}
+
+	return result;
+}
+
+} // namespace dtcue
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_ENCODER_HPP
+#define DT_CUE_ENCODER_HPP
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+#include <stdint.h>
+
+#include "cue-action.hpp"
+
+namespace dtcue {
+
+// Chooses compression level of every encoded track from measured speed of encoder,
+// so that queued audio is encoded at requested rate or before deadline.
+// Level of flac preset determines block size and apodization functions as well.
+class encoder_tuner
+{
+public:
+	static const unsigned int best_level = 8;
+
+	// target rate is in bytes of decoded audio per second for all jobs together,
+	// deadline is in seconds since tuner is created, 0 means not set
+	encoder_tuner(uint64_t target_rate, unsigned int deadline_seconds, unsigned int parallel_jobs);
+
+	encoder_tuner(const encoder_tuner &other) = delete;
+	encoder_tuner& operator=(const encoder_tuner &other) = delete;
+
+	void add_pending(uint64_t decoded_bytes);
+
+	unsigned int choose_level() const;
+
+	// also records tracks encoded below best level, so that they are compressed again when machine is idle
+	void record(unsigned int level, uint64_t decoded_bytes, double seconds, const std::string &output_filename);
+
+private:
+	// decoded bytes per second of single job, estimated from other levels if level wasn't used yet
+	double estimate_speed(unsigned int level) const;
+
+	uint64_t m_target_rate;
+	unsigned int m_deadline_seconds;
+	unsigned int m_parallel_jobs;
+
+	std::chrono::steady_clock::time_point m_start_time;
+
+	mutable std::mutex m_mutex;
+
+	uint64_t m_pending_bytes;
+	double m_speed[best_level + 1];
+};
+
+// Runs encoding command built for compression level chosen right before it's started.
+class tuned_encode_command: public command
+{
+public:
+	typedef std::function<std::shared_ptr<command>(unsigned int level)> factory;
+
+	tuned_encode_command(const std::shared_ptr<encoder_tuner> &tuner, const factory &make_command, uint64_t decoded_bytes, const std::string &output_filename);
+
+	virtual bool run() const;
+	virtual std::string print() const;
+
+	// exported plan is run without tuner, so the best level is used
+	virtual std::string script() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	std::shared_ptr<encoder_tuner> m_tuner;
+	factory m_make_command;
+	uint64_t m_decoded_bytes;
+	std::string m_output_filename;
+};
+
+// name of file listing tracks of directory which were encoded below best level
+extern const char * const recompress_list_filename;
+
+// Compresses tracks listed in recompress lists found in directory and its subdirectories again at best level.
+// Every track is started only when load average drops below given value. Returns false if some track failed.
+bool recompress_when_idle(const std::string &directory, double idle_load, bool verbose, bool dry_run);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_ENCODER_HPP */
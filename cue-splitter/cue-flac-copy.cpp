@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-flac-copy.hpp"
+#include "cue-io.hpp"
+
+#include <dt-cue-virtual.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace dtcue {
+
+namespace {
+
+// room for tags added to track after it's cut, so that they don't require rewriting whole file
+const uint32_t padding_size = 8192;
+
+struct frame_source
+{
+	std::string filename;
+	std::vector<flac_frame> frames;
+};
+
+// appends frames to output, numbering them continuously
+void append_frames(const std::string &filename, const std::vector<flac_frame> &frames, size_t first, size_t last, uint64_t &next_sample, flac_stream_info &info, std::ostream &output)
+{
+	if (first >= last)
+	{
+		return;
+	}
+
+	int input = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (input == -1)
+	{
+		throw std::runtime_error("Failed to open file '" + filename + "'");
+	}
+
+	struct input_closer
+	{
+		int fd;
+
+		~input_closer()
+		{
+			close(fd);
+		}
+	} closer = { input };
+
+	// frames of track are adjacent, they're read once and aren't needed after that
+	uint64_t range_offset = frames[first].offset;
+	uint64_t range_length = frames[last - 1].offset + frames[last - 1].size - range_offset;
+
+	advise_sequential_read(input, range_offset, range_length);
+
+	std::string frame;
+
+	for (size_t i = first; i < last; ++i)
+	{
+		const flac_frame &current = frames[i];
+
+		frame.resize(current.size);
+
+		if (pread(input, &frame[0], frame.size(), current.offset) != static_cast<ssize_t>(frame.size()))
+		{
+			throw std::runtime_error("Failed to read file '" + filename + "'");
+		}
+
+		std::string renumbered = renumber_flac_frame(frame, next_sample);
+
+		if (!output.write(renumbered.data(), renumbered.size()))
+		{
+			throw std::runtime_error("Failed to write FLAC frames");
+		}
+
+		// STREAMINFO limits are updated from every frame, last frame of stream is allowed to be shorter
+		if ((info.min_block_size == 0) || (current.block_size < info.min_block_size))
+		{
+			info.min_block_size = current.block_size;
+		}
+
+		if ((info.min_frame_size == 0) || (renumbered.size() < info.min_frame_size))
+		{
+			info.min_frame_size = renumbered.size();
+		}
+
+		info.max_block_size = std::max<unsigned int>(info.max_block_size, current.block_size);
+		info.max_frame_size = std::max<unsigned int>(info.max_frame_size, renumbered.size());
+
+		next_sample += current.block_size;
+	}
+
+	advise_read_done(input, range_offset, range_length);
+}
+
+// decodes samples [start, end) of source and encodes them into separate FLAC file
+frame_source encode_edge(const std::string &source_filename, uint64_t start, uint64_t end, const std::string &output_filename)
+{
+	std::stringstream cmdstream;
+
+	cmdstream << "flac -d -s -c --skip=" << start << " --until=" << end << " \'" << escape_single_quote(source_filename) << "\'"
+		<< " | flac -8 -F --no-lax --ignore-chunk-sizes -s -f -o \'" << escape_single_quote(output_filename) << "\' -";
+
+	if (!external_command(cmdstream.str()).run())
+	{
+		throw std::runtime_error("Failed to encode samples " + std::to_string(start) + "-" + std::to_string(end) + " of file '" + source_filename + "'");
+	}
+
+	frame_source result;
+	result.filename = output_filename;
+	result.frames = scan_flac_frames(output_filename, read_flac_metadata(output_filename));
+
+	return result;
+}
+
+} // unnamed namespace
+
+flac_frame_index::flac_frame_index(const std::string &filename)
+	: m_filename(filename)
+{
+}
+
+const std::string& flac_frame_index::filename() const
+{
+	return m_filename;
+}
+
+const flac_metadata& flac_frame_index::metadata() const
+{
+	std::call_once(m_loaded, &flac_frame_index::load, this);
+
+	return m_metadata;
+}
+
+const std::vector<flac_frame>& flac_frame_index::frames() const
+{
+	std::call_once(m_loaded, &flac_frame_index::load, this);
+
+	return m_frames;
+}
+
+void flac_frame_index::load() const
+{
+	// image with complete SEEKTABLE doesn't need to be scanned
+	flac_image_index image(m_filename);
+
+	m_metadata = image.metadata();
+	m_frames = image.frames();
+}
+
+flac_copy_command::flac_copy_command(const std::shared_ptr<flac_frame_index> &source,
+	uint64_t start_frame,
+	std::experimental::optional<uint64_t> end_frame,
+	const std::string &output_filename)
+	: command(),
+	m_source(source),
+	m_start_frame(start_frame),
+	m_end_frame(end_frame),
+	m_output_filename(output_filename)
+{
+}
+
+bool flac_copy_command::run() const
+{
+	try
+	{
+		copy();
+	}
+	catch (const std::exception &exc)
+	{
+		fprintf(stderr, "%s\n", exc.what());
+		return false;
+	}
+
+	return true;
+}
+
+std::string flac_copy_command::print() const
+{
+	std::stringstream result;
+
+	result << "# copy FLAC frames of \'" << escape_single_quote(m_source->filename()) << "\' from CD frame " << m_start_frame << " to ";
+
+	if (m_end_frame)
+	{
+		result << "CD frame " << *m_end_frame;
+	}
+	else
+	{
+		result << "end";
+	}
+
+	result << " into \'" << escape_single_quote(m_output_filename) << "\', re-encoding partial frames only";
+
+	return result.str();
+}
+
+bool flac_copy_command::compare(const command &other) const
+{
+	const flac_copy_command &other_cmd = dynamic_cast<const flac_copy_command&>(other);
+
+	return (m_output_filename < other_cmd.m_output_filename);
+}
+
+void flac_copy_command::copy() const
+{
+	const flac_stream_info &source_info = m_source->metadata().stream_info;
+
+	const std::vector<flac_frame> &frames = m_source->frames();
+
+	uint64_t total_samples = frames.back().first_sample + frames.back().block_size;
+
+	// one CD frame is 1/75 of second
+	uint64_t start = std::min<uint64_t>(m_start_frame * source_info.sample_rate / 75, total_samples);
+	uint64_t end = m_end_frame ? std::min<uint64_t>(*m_end_frame * source_info.sample_rate / 75, total_samples) : total_samples;
+
+	if (start >= end)
+	{
+		throw std::runtime_error("Range of file '" + m_source->filename() + "' is empty");
+	}
+
+	auto starts_before = [](const flac_frame &frame, uint64_t sample) { return (frame.first_sample < sample); };
+	auto ends_after = [](uint64_t sample, const flac_frame &frame) { return (frame.first_sample + frame.block_size > sample); };
+
+	// frames [first, last) lie between cut points completely
+	size_t first = std::lower_bound(frames.begin(), frames.end(), start, starts_before) - frames.begin();
+	size_t last = std::upper_bound(frames.begin(), frames.end(), end, ends_after) - frames.begin();
+
+	uint64_t copy_start = end;
+	uint64_t copy_end = end;
+
+	if (first < last)
+	{
+		copy_start = frames[first].first_sample;
+		copy_end = frames[last - 1].first_sample + frames[last - 1].block_size;
+	}
+
+	std::string head_filename = m_output_filename + ".head.flac";
+	std::string tail_filename = m_output_filename + ".tail.flac";
+
+	struct edge_files_remover
+	{
+		std::string head;
+		std::string tail;
+
+		~edge_files_remover()
+		{
+			unlink(head.c_str());
+			unlink(tail.c_str());
+		}
+	} remover = { head_filename, tail_filename };
+
+	frame_source head;
+	frame_source tail;
+
+	if (start < copy_start)
+	{
+		head = encode_edge(m_source->filename(), start, copy_start, head_filename);
+	}
+
+	if (copy_end < end)
+	{
+		tail = encode_edge(m_source->filename(), copy_end, end, tail_filename);
+	}
+
+	std::ofstream output(m_output_filename.c_str(), std::ios::binary | std::ios::trunc);
+
+	if (!output)
+	{
+		throw std::runtime_error("Failed to create file '" + m_output_filename + "'");
+	}
+
+	flac_stream_info info;
+	info.sample_rate = source_info.sample_rate;
+	info.channels = source_info.channels;
+	info.bits_per_sample = source_info.bits_per_sample;
+	info.total_samples = end - start;
+
+	std::string padding(4 + padding_size, '\0');
+	padding[0] = static_cast<char>(0x81);
+	padding[1] = static_cast<char>((padding_size >> 16) & 0xFF);
+	padding[2] = static_cast<char>((padding_size >> 8) & 0xFF);
+	padding[3] = static_cast<char>(padding_size & 0xFF);
+
+	// STREAMINFO is written again when sizes of all frames are known
+	output << "fLaC" << make_flac_stream_info_block(info, false) << padding;
+
+	uint64_t next_sample = 0;
+
+	append_frames(head.filename, head.frames, 0, head.frames.size(), next_sample, info, output);
+	append_frames(m_source->filename(), frames, first, last, next_sample, info, output);
+	append_frames(tail.filename, tail.frames, 0, tail.frames.size(), next_sample, info, output);
+
+	if (next_sample != info.total_samples)
+	{
+		throw std::runtime_error("Frames copied from file '" + m_source->filename() + "' don't match requested range");
+	}
+
+	// blocks shorter than 16 samples are allowed anywhere in variable block size stream,
+	// but STREAMINFO may not declare them
+	info.min_block_size = std::max<unsigned int>(info.min_block_size, 16);
+	info.max_block_size = std::max<unsigned int>(info.max_block_size, info.min_block_size);
+
+	output.seekp(4);
+	output << make_flac_stream_info_block(info, false);
+	output.close();
+
+	if (!output)
+	{
+		throw std::runtime_error("Failed to write file '" + m_output_filename + "'");
+	}
+}
+
+} // namespace dtcue
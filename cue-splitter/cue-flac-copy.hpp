@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_FLAC_COPY_HPP
+#define DT_CUE_FLAC_COPY_HPP
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+#include <dt-cue-flac.hpp>
+
+#include "cue-action.hpp"
+
+namespace dtcue {
+
+// Frame index of FLAC source, built on first use and shared by all tracks cut from this source.
+class flac_frame_index
+{
+public:
+	explicit flac_frame_index(const std::string &filename);
+
+	flac_frame_index(const flac_frame_index &other) = delete;
+	flac_frame_index& operator=(const flac_frame_index &other) = delete;
+
+	const std::string& filename() const;
+
+	// both scan whole file on first call
+	const flac_metadata& metadata() const;
+	const std::vector<flac_frame>& frames() const;
+
+private:
+	void load() const;
+
+	std::string m_filename;
+
+	mutable std::once_flag m_loaded;
+	mutable flac_metadata m_metadata;
+	mutable std::vector<flac_frame> m_frames;
+};
+
+// Cuts track out of FLAC source without decoding it completely: frames lying between cut points are copied as they are,
+// only partial frames at both ends are decoded and encoded again.
+// Output uses variable block size strategy and its STREAMINFO doesn't have MD5 signature.
+// Track boundaries are specified in CD frames, 1/75 of second.
+class flac_copy_command: public command
+{
+public:
+	flac_copy_command(const std::shared_ptr<flac_frame_index> &source,
+		uint64_t start_frame,
+		std::experimental::optional<uint64_t> end_frame,
+		const std::string &output_filename);
+
+	virtual bool run() const;
+	virtual std::string print() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	void copy() const;
+
+	std::shared_ptr<flac_frame_index> m_source;
+	uint64_t m_start_frame;
+	std::experimental::optional<uint64_t> m_end_frame;
+	std::string m_output_filename;
+};
+
+} // namespace dtcue
+
+#endif /* DT_CUE_FLAC_COPY_HPP */
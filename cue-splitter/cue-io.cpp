@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-io.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dtcue {
+
+void advise_sequential_read(int fd, uint64_t offset, uint64_t length)
+{
+	posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+
+	// start reading whole range in background instead of waiting for kernel to detect sequential access
+	posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+}
+
+void advise_read_done(int fd, uint64_t offset, uint64_t length)
+{
+	posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+}
+
+bool sync_and_drop_file(int fd)
+{
+	// dirty pages can't be dropped, they have to be written first
+	if (fsync(fd) != 0)
+	{
+		return false;
+	}
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+	return true;
+}
+
+bool sync_and_drop_file(const std::string &filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return false;
+	}
+
+	bool result = sync_and_drop_file(fd);
+
+	close(fd);
+
+	return result;
+}
+
+void drop_file_cache(const std::string &filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		return;
+	}
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+	close(fd);
+}
+
+} // namespace dtcue
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_IO_HPP
+#define DT_CUE_IO_HPP
+
+#include <string>
+
+#include <stdint.h>
+
+namespace dtcue {
+
+// Hints for page cache. Failures of hints are ignored since they affect only speed.
+// Length of 0 means until end of file.
+
+// range of file is going to be read once from start to end
+void advise_sequential_read(int fd, uint64_t offset, uint64_t length);
+
+// range of file isn't going to be read again
+void advise_read_done(int fd, uint64_t offset, uint64_t length);
+
+// Writes file to disk and drops its pages from page cache, so that big finished tracks
+// don't evict pages used by other processes. Returns false if file couldn't be written.
+bool sync_and_drop_file(int fd);
+bool sync_and_drop_file(const std::string &filename);
+
+// Drops pages of file which isn't going to be read again from page cache, no matter which process read them.
+void drop_file_cache(const std::string &filename);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_IO_HPP */
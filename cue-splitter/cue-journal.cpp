@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-journal.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dtcue {
+
+const char * const journal_filename = ".dt-cue-split.journal";
+
+namespace {
+
+const char * const journal_header = "dt-cue-split journal 2";
+
+} // unnamed namespace
+
+split_journal::split_journal(const std::string &filename, bool read_only)
+	: m_filename(filename),
+	m_fd(-1)
+{
+	bool valid = false;
+
+	{
+		std::ifstream input_file(m_filename.c_str());
+		std::string file_line;
+
+		if (std::getline(input_file, file_line))
+		{
+			// records of unknown format can't be trusted, and dropping them silently would lose finished tracks
+			if (file_line != journal_header)
+			{
+				throw std::runtime_error("Journal file '" + m_filename + "' has unsupported format, remove it to split all tracks again");
+			}
+
+			valid = true;
+
+			while (std::getline(input_file, file_line))
+			{
+				std::istringstream stream(file_line);
+				std::string track_index;
+				journal_record completed;
+
+				if ((stream >> track_index >> completed.audio_fingerprint >> completed.tags_fingerprint >> completed.size >> completed.modification_seconds >> completed.modification_nanoseconds)
+					&& (stream.get() == ' ')
+					&& std::getline(stream, completed.output_filename))
+				{
+					// newer records replace older ones
+					m_records[track_index] = completed;
+				}
+			}
+		}
+	}
+
+	if (read_only)
+	{
+		return;
+	}
+
+	if (valid)
+	{
+		m_fd = open(m_filename.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+	}
+	else
+	{
+		m_fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+		std::string header = std::string(journal_header) + "\n";
+
+		if ((m_fd != -1) && (write(m_fd, header.data(), header.size()) != static_cast<ssize_t>(header.size())))
+		{
+			close(m_fd);
+			m_fd = -1;
+		}
+	}
+
+	if (m_fd == -1)
+	{
+		throw std::runtime_error("Failed to open journal file '" + m_filename + "'");
+	}
+}
+
+split_journal::~split_journal()
+{
+	if (m_fd != -1)
+	{
+		close(m_fd);
+	}
+}
+
+const std::string& split_journal::filename() const
+{
+	return m_filename;
+}
+
+const journal_record* split_journal::find(const std::string &track_index) const
+{
+	auto completed = m_records.find(track_index);
+	if (completed == m_records.end())
+	{
+		return NULL;
+	}
+
+	return &(completed->second);
+}
+
+std::vector<std::string> split_journal::find_unchanged(const std::string &output_filename) const
+{
+	std::vector<std::string> result;
+	struct stat output_statbuf;
+
+	if (stat(output_filename.c_str(), &output_statbuf) == -1)
+	{
+		return result;
+	}
+
+	// records may name the same file by relative or absolute path
+	for (auto completed = m_records.begin(); completed != m_records.end(); ++completed)
+	{
+		struct stat statbuf;
+
+		if ((stat(completed->second.output_filename.c_str(), &statbuf) == 0)
+			&& (statbuf.st_dev == output_statbuf.st_dev)
+			&& (statbuf.st_ino == output_statbuf.st_ino)
+			&& is_unchanged(completed->second))
+		{
+			result.push_back(completed->first);
+		}
+	}
+
+	return result;
+}
+
+bool split_journal::is_unchanged(const journal_record &completed)
+{
+	struct stat statbuf;
+
+	return ((stat(completed.output_filename.c_str(), &statbuf) == 0)
+		&& (static_cast<uint64_t>(statbuf.st_size) == completed.size)
+		&& (statbuf.st_mtim.tv_sec == completed.modification_seconds)
+		&& (statbuf.st_mtim.tv_nsec == completed.modification_nanoseconds));
+}
+
+void split_journal::record_completed(const std::string &track_index, const journal_record &completed)
+{
+	struct stat statbuf;
+
+	if (stat(completed.output_filename.c_str(), &statbuf) == -1)
+	{
+		throw std::runtime_error("Failed to get information about file '" + completed.output_filename + "'");
+	}
+
+	journal_record updated = completed;
+	updated.size = statbuf.st_size;
+	updated.modification_seconds = statbuf.st_mtim.tv_sec;
+	updated.modification_nanoseconds = statbuf.st_mtim.tv_nsec;
+
+	std::stringstream line;
+	line << track_index << ' ' << updated.audio_fingerprint << ' ' << updated.tags_fingerprint << ' '
+		<< updated.size << ' ' << updated.modification_seconds << ' ' << updated.modification_nanoseconds << ' '
+		<< updated.output_filename << '\n';
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if ((m_fd == -1)
+		|| (write(m_fd, line.str().data(), line.str().size()) != static_cast<ssize_t>(line.str().size()))
+		|| (fsync(m_fd) != 0))
+	{
+		throw std::runtime_error("Failed to write journal file '" + m_filename + "'");
+	}
+
+	m_records[track_index] = updated;
+}
+
+journal_record_command::journal_record_command(const std::shared_ptr<split_journal> &journal, const std::string &track_index, const journal_record &completed)
+	: command(),
+	m_journal(journal),
+	m_track_index(track_index),
+	m_record(completed)
+{
+}
+
+bool journal_record_command::run() const
+{
+	try
+	{
+		m_journal->record_completed(m_track_index, m_record);
+	}
+	catch (const std::exception &)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+std::string journal_record_command::print() const
+{
+	return "# record track " + m_track_index + " as \'" + escape_single_quote(m_record.output_filename) + "\' in journal \'" + escape_single_quote(m_journal->filename()) + "\'";
+}
+
+bool journal_record_command::compare(const command &other) const
+{
+	const journal_record_command &other_cmd = dynamic_cast<const journal_record_command&>(other);
+
+	return (m_track_index < other_cmd.m_track_index);
+}
+
+} // namespace dtcue
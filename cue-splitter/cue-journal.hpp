@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_JOURNAL_HPP
+#define DT_CUE_JOURNAL_HPP
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+#include "cue-action.hpp"
+
+namespace dtcue {
+
+// name of journal file placed in output directory
+extern const char * const journal_filename;
+
+struct journal_record
+{
+	// fingerprint of everything affecting audio data of track: source files, INDEX range, gap handling
+	std::string audio_fingerprint;
+
+	// fingerprint of tags written into track
+	std::string tags_fingerprint;
+
+	std::string output_filename;
+
+	// state of output file right after it was completed
+	uint64_t size;
+	int64_t modification_seconds;
+	int64_t modification_nanoseconds;
+
+	journal_record()
+		: size(0),
+		modification_seconds(0),
+		modification_nanoseconds(0)
+	{
+	}
+};
+
+// Journal of tracks completed by previous runs, stored alongside output files.
+// Every record is appended and synced as soon as track is finished, thus journal survives interrupted runs.
+class split_journal
+{
+public:
+	// read-only journal is never created or written, e.g. for dry run;
+	// throws std::runtime_error if file exists but isn't journal of this version
+	split_journal(const std::string &filename, bool read_only);
+	~split_journal();
+
+	split_journal(const split_journal &other) = delete;
+	split_journal& operator=(const split_journal &other) = delete;
+
+	const std::string& filename() const;
+
+	// track is identified by key unique among all albums sharing journal;
+	// returns NULL if there is no record for this track
+	const journal_record* find(const std::string &track_index) const;
+
+	// returns keys of tracks whose output is given file, as long as it wasn't changed since it was completed
+	std::vector<std::string> find_unchanged(const std::string &output_filename) const;
+
+	// checks that output file of record wasn't changed since it was completed
+	static bool is_unchanged(const journal_record &completed);
+
+	void record_completed(const std::string &track_index, const journal_record &completed);
+
+private:
+	std::string m_filename;
+	std::map<std::string, journal_record> m_records;
+
+	std::mutex m_mutex;
+	int m_fd;
+};
+
+// Records track as completed. Size and modification time of output file are taken when command is run.
+class journal_record_command: public command
+{
+public:
+	journal_record_command(const std::shared_ptr<split_journal> &journal, const std::string &track_index, const journal_record &completed);
+
+	virtual bool run() const;
+	virtual std::string print() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	std::shared_ptr<split_journal> m_journal;
+	std::string m_track_index;
+	journal_record m_record;
+};
+
+} // namespace dtcue
+
+#endif /* DT_CUE_JOURNAL_HPP */
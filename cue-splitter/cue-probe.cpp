@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-probe.hpp"
+#include "cue-wave.hpp"
+
+#include <stdexcept>
+
+#include <errno.h>
+#include <string.h>
+
+namespace dtcue {
+
+namespace {
+
+bool has_extension(const std::string &filename, const std::string &extension)
+{
+	return ((filename.length() >= extension.length())
+		&& (filename.compare(filename.length() - extension.length(), std::string::npos, extension) == 0));
+}
+
+uint32_t read_le32(const unsigned char *data)
+{
+	return (static_cast<uint32_t>(data[0])
+		| (static_cast<uint32_t>(data[1]) << 8)
+		| (static_cast<uint32_t>(data[2]) << 16)
+		| (static_cast<uint32_t>(data[3]) << 24));
+}
+
+uint16_t read_le16(const unsigned char *data)
+{
+	return (static_cast<uint16_t>(data[0]) | (static_cast<uint16_t>(data[1]) << 8));
+}
+
+uint32_t read_be24(const unsigned char *data)
+{
+	return ((static_cast<uint32_t>(data[0]) << 16)
+		| (static_cast<uint32_t>(data[1]) << 8)
+		| static_cast<uint32_t>(data[2]));
+}
+
+uint32_t read_be32(const unsigned char *data)
+{
+	return ((static_cast<uint32_t>(data[0]) << 24) | read_be24(data + 1));
+}
+
+class file_handle
+{
+public:
+	explicit file_handle(const std::string &filename)
+		: m_file(fopen(filename.c_str(), "rbe"))
+	{
+		if (m_file == NULL)
+		{
+			throw std::runtime_error("Failed to open file " + filename + ": " + strerror(errno));
+		}
+	}
+
+	~file_handle()
+	{
+		fclose(m_file);
+	}
+
+	file_handle(const file_handle &other) = delete;
+	file_handle& operator=(const file_handle &other) = delete;
+
+	FILE* get() const
+	{
+		return m_file;
+	}
+
+private:
+	FILE *m_file;
+};
+
+audio_properties probe_wave_file(const std::string &filename)
+{
+	file_handle input(filename);
+	wave_format format;
+
+	if ((!read_wave_header(input.get(), format))
+		|| (format.sample_rate == 0)
+		|| (format.channels == 0)
+		|| (format.block_align == 0))
+	{
+		throw std::runtime_error("File " + filename + " isn't a valid WAV file");
+	}
+
+	audio_properties result;
+	result.sample_rate     = format.sample_rate;
+	result.channels        = format.channels;
+	result.bits_per_sample = format.bits_per_sample;
+	result.total_samples   = format.data_size / format.block_align;
+
+	return result;
+}
+
+audio_properties probe_flac_file(const std::string &filename)
+{
+	file_handle input(filename);
+	unsigned char header[10];
+
+	if (fread(header, 1, 4, input.get()) != 4)
+	{
+		throw std::runtime_error("File " + filename + " isn't a valid FLAC file");
+	}
+
+	// some taggers put ID3v2 tag in front of FLAC stream
+	if (memcmp(header, "ID3", 3) == 0)
+	{
+		if (fread(header + 4, 1, 6, input.get()) != 6)
+		{
+			throw std::runtime_error("File " + filename + " isn't a valid FLAC file");
+		}
+
+		// tag size is stored as syncsafe integer and doesn't include 10 bytes of header
+		long tag_size = ((header[6] & 0x7F) << 21) | ((header[7] & 0x7F) << 14) | ((header[8] & 0x7F) << 7) | (header[9] & 0x7F);
+
+		if ((fseek(input.get(), tag_size, SEEK_CUR) != 0)
+			|| (fread(header, 1, 4, input.get()) != 4))
+		{
+			throw std::runtime_error("File " + filename + " isn't a valid FLAC file");
+		}
+	}
+
+	// STREAMINFO is always the first metadata block
+	unsigned char streaminfo[4 + 34];
+
+	if ((memcmp(header, "fLaC", 4) != 0)
+		|| (fread(streaminfo, 1, sizeof(streaminfo), input.get()) != sizeof(streaminfo))
+		|| ((streaminfo[0] & 0x7F) != 0)
+		|| (read_be24(streaminfo + 1) != 34))
+	{
+		throw std::runtime_error("File " + filename + " isn't a valid FLAC file");
+	}
+
+	const unsigned char *data = streaminfo + 4;
+
+	audio_properties result;
+	result.sample_rate     = (static_cast<unsigned int>(data[10]) << 12) | (static_cast<unsigned int>(data[11]) << 4) | (data[12] >> 4);
+	result.channels        = ((data[12] >> 1) & 0x07) + 1;
+	result.bits_per_sample = (((data[12] & 0x01) << 4) | (data[13] >> 4)) + 1;
+	result.total_samples   = (static_cast<uint64_t>(data[13] & 0x0F) << 32) | read_be32(data + 14);
+
+	// encoder may leave signature unset
+	std::string md5_signature(reinterpret_cast<const char*>(data + 18), 16);
+	if (md5_signature != std::string(16, '\0'))
+	{
+		result.md5_signature = md5_signature;
+	}
+
+	if (result.sample_rate == 0)
+	{
+		throw std::runtime_error("File " + filename + " isn't a valid FLAC file");
+	}
+
+	return result;
+}
+
+audio_properties probe_wavpack_file(const std::string &filename)
+{
+	static const unsigned int sample_rates[] = { 6000, 8000, 9600, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000, 64000, 88200, 96000, 192000 };
+
+	file_handle input(filename);
+	unsigned char header[32];
+
+	if ((fread(header, 1, sizeof(header), input.get()) != sizeof(header))
+		|| (memcmp(header, "wvpk", 4) != 0))
+	{
+		throw std::runtime_error("File " + filename + " isn't a valid WavPack file");
+	}
+
+	uint32_t block_size = read_le32(header + 4);
+	uint32_t total_samples = read_le32(header + 12);
+	uint32_t flags = read_le32(header + 24);
+
+	audio_properties result;
+
+	// total number of samples is 40 bits long, lower 32 bits set to 0xFFFFFFFF mean unknown length
+	if (total_samples != 0xFFFFFFFF)
+	{
+		result.total_samples = static_cast<uint64_t>(total_samples) + (static_cast<uint64_t>(header[11]) << 32) - header[11];
+	}
+
+	result.bits_per_sample = ((flags & 0x03) + 1) * 8 - ((flags >> 13) & 0x1F);
+	result.channels = (flags & 0x04) ? 1 : 2;
+
+	unsigned int rate_index = (flags >> 23) & 0x0F;
+	if (rate_index < sizeof(sample_rates) / sizeof(sample_rates[0]))
+	{
+		result.sample_rate = sample_rates[rate_index];
+	}
+
+	// multichannel audio and non-standard sample rates are described by metadata sub-blocks of first block
+	if ((block_size >= 24) && (block_size <= 1024 * 1024))
+	{
+		std::string block(block_size - 24, '\0');
+
+		if (fread(&block[0], 1, block.size(), input.get()) != block.size())
+		{
+			throw std::runtime_error("File " + filename + " isn't a valid WavPack file");
+		}
+
+		const unsigned char *data = reinterpret_cast<const unsigned char*>(block.data());
+		size_t offset = 0;
+
+		while (offset + 2 <= block.size())
+		{
+			unsigned int id = data[offset];
+			size_t size = data[offset + 1] * 2;
+			offset += 2;
+
+			if (id & 0x80)
+			{
+				if (offset + 2 > block.size())
+				{
+					break;
+				}
+
+				size += (static_cast<size_t>(data[offset]) << 9) | (static_cast<size_t>(data[offset + 1]) << 17);
+				offset += 2;
+			}
+
+			if (offset + size > block.size())
+			{
+				break;
+			}
+
+			size_t data_size = (id & 0x40) ? (size - 1) : size;
+
+			if (((id & 0x3F) == 0x0D) && (data_size >= 1))
+			{
+				result.channels = data[offset];
+			}
+			else if (((id & 0x3F) == 0x27) && (data_size >= 3) && (result.sample_rate == 0))
+			{
+				result.sample_rate = data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16);
+			}
+
+			offset += size;
+		}
+	}
+
+	if (result.sample_rate == 0)
+	{
+		throw std::runtime_error("File " + filename + " has unsupported sample rate");
+	}
+
+	return result;
+}
+
+audio_properties probe_ape_file(const std::string &filename)
+{
+	file_handle input(filename);
+	unsigned char header[52 + 24];
+
+	if ((fread(header, 1, 6, input.get()) != 6)
+		|| (memcmp(header, "MAC ", 4) != 0))
+	{
+		throw std::runtime_error("File " + filename + " isn't a valid APE file");
+	}
+
+	unsigned int version = read_le16(header + 4);
+
+	audio_properties result;
+	uint32_t blocks_per_frame = 0;
+	uint32_t final_frame_blocks = 0;
+	uint32_t total_frames = 0;
+
+	if (version >= 3980)
+	{
+		// descriptor is followed by header, descriptor size is stored in the descriptor itself
+		if (fread(header + 6, 1, 46, input.get()) != 46)
+		{
+			throw std::runtime_error("File " + filename + " isn't a valid APE file");
+		}
+
+		uint32_t descriptor_size = read_le32(header + 8);
+
+		if ((descriptor_size < 52)
+			|| (fseek(input.get(), descriptor_size, SEEK_SET) != 0)
+			|| (fread(header + 52, 1, 24, input.get()) != 24))
+		{
+			throw std::runtime_error("File " + filename + " isn't a valid APE file");
+		}
+
+		const unsigned char *data = header + 52;
+
+		blocks_per_frame       = read_le32(data + 4);
+		final_frame_blocks     = read_le32(data + 8);
+		total_frames           = read_le32(data + 12);
+		result.bits_per_sample = read_le16(data + 16);
+		result.channels        = read_le16(data + 18);
+		result.sample_rate     = read_le32(data + 20);
+	}
+	else
+	{
+		if (fread(header + 6, 1, 26, input.get()) != 26)
+		{
+			throw std::runtime_error("File " + filename + " isn't a valid APE file");
+		}
+
+		unsigned int compression_level = read_le16(header + 6);
+		unsigned int format_flags = read_le16(header + 8);
+
+		result.channels    = read_le16(header + 10);
+		result.sample_rate = read_le32(header + 12);
+		total_frames       = read_le32(header + 24);
+		final_frame_blocks = read_le32(header + 28);
+
+		if (format_flags & 0x01)
+		{
+			result.bits_per_sample = 8;
+		}
+		else if (format_flags & 0x08)
+		{
+			result.bits_per_sample = 24;
+		}
+		else
+		{
+			result.bits_per_sample = 16;
+		}
+
+		if (version >= 3950)
+		{
+			blocks_per_frame = 73728 * 4;
+		}
+		else if ((version >= 3900) || ((version >= 3800) && (compression_level == 4000)))
+		{
+			blocks_per_frame = 73728;
+		}
+		else
+		{
+			blocks_per_frame = 9216;
+		}
+	}
+
+	if ((result.sample_rate == 0) || (result.channels == 0))
+	{
+		throw std::runtime_error("File " + filename + " isn't a valid APE file");
+	}
+
+	if (total_frames != 0)
+	{
+		result.total_samples = static_cast<uint64_t>(total_frames - 1) * blocks_per_frame + final_frame_blocks;
+	}
+
+	return result;
+}
+
+} // unnamed namespace
+
+bool audio_properties::same_format(const audio_properties &other) const
+{
+	return ((sample_rate == other.sample_rate)
+		&& (channels == other.channels)
+		&& (bits_per_sample == other.bits_per_sample));
+}
+
+bool can_probe_audio_file(const std::string &filename)
+{
+	return (has_extension(filename, ".wav")
+		|| has_extension(filename, ".flac")
+		|| has_extension(filename, ".wv")
+		|| has_extension(filename, ".ape"));
+}
+
+audio_properties probe_audio_file(const std::string &filename)
+{
+	if (has_extension(filename, ".wav"))
+	{
+		return probe_wave_file(filename);
+	}
+	else if (has_extension(filename, ".flac"))
+	{
+		return probe_flac_file(filename);
+	}
+	else if (has_extension(filename, ".wv"))
+	{
+		return probe_wavpack_file(filename);
+	}
+	else if (has_extension(filename, ".ape"))
+	{
+		return probe_ape_file(filename);
+	}
+
+	throw std::runtime_error("Unsupported file type found, filename: " + filename);
+}
+
+} // namespace dtcue
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_PROBE_HPP
+#define DT_CUE_PROBE_HPP
+
+#include <string>
+
+#include <stdint.h>
+
+namespace dtcue {
+
+struct audio_properties
+{
+	unsigned int sample_rate;
+	unsigned int channels;
+	unsigned int bits_per_sample;
+
+	// length of audio in samples per channel, 0 if it's unknown
+	uint64_t total_samples;
+
+	// MD5 of decoded samples stored by FLAC encoder, empty if it's unknown
+	std::string md5_signature;
+
+	audio_properties()
+		: sample_rate(0),
+		channels(0),
+		bits_per_sample(0),
+		total_samples(0)
+	{
+	}
+
+	bool same_format(const audio_properties &other) const;
+};
+
+// true for files which probe_audio_file() is able to read
+bool can_probe_audio_file(const std::string &filename);
+
+// reads format and length of audio from file headers without decoding it,
+// throws if file is damaged or isn't of type its extension says
+audio_properties probe_audio_file(const std::string &filename);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_PROBE_HPP */
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-progress.hpp"
+
+#include <sstream>
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dtcue {
+
+namespace {
+
+// CD frames per second
+const uint64_t frame_rate = 75;
+
+std::string format_duration(uint64_t seconds)
+{
+	char buffer[32];
+
+	snprintf(buffer, sizeof(buffer), "%llu:%02u:%02u",
+		static_cast<unsigned long long>(seconds / 3600),
+		static_cast<unsigned int>((seconds / 60) % 60),
+		static_cast<unsigned int>(seconds % 60));
+
+	return buffer;
+}
+
+} // unnamed namespace
+
+progress_reporter::progress_reporter(bool show_on_terminal, const std::string &status_filename)
+	: m_show_on_terminal(show_on_terminal),
+	m_status_filename(status_filename),
+	m_running(false),
+	m_start_time(std::chrono::steady_clock::now()),
+	m_albums_total(0),
+	m_albums_done(0),
+	m_tracks_total(0),
+	m_tracks_done(0),
+	m_frames_total(0),
+	m_frames_done(0),
+	m_bytes_in(0),
+	m_bytes_out(0)
+{
+}
+
+progress_reporter::~progress_reporter()
+{
+	stop();
+}
+
+unsigned int progress_reporter::add_album()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_albums.push_back(album_state());
+
+	return m_albums.size() - 1;
+}
+
+void progress_reporter::add_track(unsigned int album, uint64_t frames)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_albums[album].tracks == 0)
+	{
+		++m_albums_total;
+	}
+
+	++m_albums[album].tracks;
+	++m_tracks_total;
+	m_frames_total += frames;
+}
+
+void progress_reporter::record_track(unsigned int album, uint64_t frames, uint64_t decoded_bytes, const std::string &output_filename)
+{
+	struct stat statbuf;
+	uint64_t output_size = 0;
+
+	if (stat(output_filename.c_str(), &statbuf) == 0)
+	{
+		output_size = statbuf.st_size;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	++m_tracks_done;
+	m_frames_done += frames;
+	m_bytes_in += decoded_bytes;
+	m_bytes_out += output_size;
+
+	++m_albums[album].tracks_done;
+
+	if (m_albums[album].tracks_done == m_albums[album].tracks)
+	{
+		++m_albums_done;
+	}
+}
+
+void progress_reporter::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_running)
+	{
+		return;
+	}
+
+	m_running = true;
+	m_start_time = std::chrono::steady_clock::now();
+	m_thread = std::thread(&progress_reporter::reporter_thread, this);
+}
+
+void progress_reporter::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_running)
+		{
+			return;
+		}
+
+		m_running = false;
+		m_condition.notify_all();
+	}
+
+	m_thread.join();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	report(true);
+}
+
+void progress_reporter::reporter_thread()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (m_running)
+	{
+		report(false);
+
+		m_condition.wait_for(lock, std::chrono::seconds(1));
+	}
+}
+
+// called with mutex locked
+void progress_reporter::report(bool final)
+{
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start_time).count();
+	double audio_done = static_cast<double>(m_frames_done) / frame_rate;
+	double audio_total = static_cast<double>(m_frames_total) / frame_rate;
+
+	// audio seconds processed per wall clock second
+	double speed = (elapsed > 0) ? (audio_done / elapsed) : 0;
+
+	// estimate is based on INDEX-derived length of tracks which are left
+	std::experimental::optional<uint64_t> eta;
+
+	if (speed > 0)
+	{
+		eta = static_cast<uint64_t>((audio_total - audio_done) / speed);
+	}
+
+	if (m_show_on_terminal)
+	{
+		fprintf(stderr, "\r\033[K%u/%u tracks, %u/%u albums, %.1fx, %.1f MiB in, %.1f MiB out, ETA %s",
+			m_tracks_done, m_tracks_total,
+			m_albums_done, m_albums_total,
+			speed,
+			static_cast<double>(m_bytes_in) / (1024 * 1024),
+			static_cast<double>(m_bytes_out) / (1024 * 1024),
+			eta ? format_duration(*eta).c_str() : "unknown");
+
+		if (final)
+		{
+			fprintf(stderr, "\n");
+		}
+
+		fflush(stderr);
+	}
+
+	if (!m_status_filename.empty())
+	{
+		std::stringstream status;
+
+		status << "state=" << (final ? "finished" : "running") << '\n'
+			<< "tracks_done=" << m_tracks_done << '\n'
+			<< "tracks_total=" << m_tracks_total << '\n'
+			<< "albums_done=" << m_albums_done << '\n'
+			<< "albums_total=" << m_albums_total << '\n'
+			<< "audio_seconds_done=" << static_cast<uint64_t>(audio_done) << '\n'
+			<< "audio_seconds_total=" << static_cast<uint64_t>(audio_total) << '\n'
+			<< "elapsed_seconds=" << static_cast<uint64_t>(elapsed) << '\n'
+			<< "audio_seconds_per_second=" << speed << '\n'
+			<< "bytes_in=" << m_bytes_in << '\n'
+			<< "bytes_out=" << m_bytes_out << '\n';
+
+		if (eta)
+		{
+			status << "eta_seconds=" << *eta << '\n';
+		}
+
+		// readers never see partially written status
+		std::string temporary_filename = m_status_filename + ".partial";
+		FILE *status_file = fopen(temporary_filename.c_str(), "we");
+
+		if (status_file != NULL)
+		{
+			bool written = (fwrite(status.str().data(), 1, status.str().size(), status_file) == status.str().size());
+
+			if ((fclose(status_file) == 0) && written)
+			{
+				rename(temporary_filename.c_str(), m_status_filename.c_str());
+			}
+			else
+			{
+				unlink(temporary_filename.c_str());
+			}
+		}
+	}
+}
+
+progress_record_command::progress_record_command(const std::shared_ptr<progress_reporter> &reporter, unsigned int album, uint64_t frames, uint64_t decoded_bytes, const std::string &output_filename)
+	: command(),
+	m_reporter(reporter),
+	m_album(album),
+	m_frames(frames),
+	m_decoded_bytes(decoded_bytes),
+	m_output_filename(output_filename)
+{
+}
+
+bool progress_record_command::run() const
+{
+	m_reporter->record_track(m_album, m_frames, m_decoded_bytes, m_output_filename);
+
+	return true;
+}
+
+std::string progress_record_command::print() const
+{
+	return "# report completion of \'" + escape_single_quote(m_output_filename) + "\'";
+}
+
+bool progress_record_command::compare(const command &other) const
+{
+	const progress_record_command &other_cmd = dynamic_cast<const progress_record_command&>(other);
+
+	return (m_output_filename < other_cmd.m_output_filename);
+}
+
+} // namespace dtcue
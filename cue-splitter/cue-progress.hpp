@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_PROGRESS_HPP
+#define DT_CUE_PROGRESS_HPP
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+#include <stdint.h>
+
+#include "cue-action.hpp"
+
+namespace dtcue {
+
+// Collects number of completed tracks and albums and length of processed audio,
+// periodically shows them on terminal and writes them into status file.
+class progress_reporter
+{
+public:
+	// empty status filename means no status file
+	progress_reporter(bool show_on_terminal, const std::string &status_filename);
+	~progress_reporter();
+
+	progress_reporter(const progress_reporter &other) = delete;
+	progress_reporter& operator=(const progress_reporter &other) = delete;
+
+	// returns identifier of album, album without tracks isn't shown
+	unsigned int add_album();
+
+	// length of audio is in CD frames
+	void add_track(unsigned int album, uint64_t frames);
+
+	void record_track(unsigned int album, uint64_t frames, uint64_t decoded_bytes, const std::string &output_filename);
+
+	void start();
+
+	// shows final state and stops reporting
+	void stop();
+
+private:
+	struct album_state
+	{
+		unsigned int tracks;
+		unsigned int tracks_done;
+
+		album_state()
+			: tracks(0),
+			tracks_done(0)
+		{
+		}
+	};
+
+	void report(bool final);
+	void reporter_thread();
+
+	bool m_show_on_terminal;
+	std::string m_status_filename;
+
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::thread m_thread;
+	bool m_running;
+
+	std::chrono::steady_clock::time_point m_start_time;
+
+	std::vector<album_state> m_albums;
+
+	unsigned int m_albums_total;
+	unsigned int m_albums_done;
+	unsigned int m_tracks_total;
+	unsigned int m_tracks_done;
+	uint64_t m_frames_total;
+	uint64_t m_frames_done;
+	uint64_t m_bytes_in;
+	uint64_t m_bytes_out;
+};
+
+// Reports track as completed. Size of output file is taken when command is run.
+class progress_record_command: public command
+{
+public:
+	progress_record_command(const std::shared_ptr<progress_reporter> &reporter, unsigned int album, uint64_t frames, uint64_t decoded_bytes, const std::string &output_filename);
+
+	virtual bool run() const;
+	virtual std::string print() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	std::shared_ptr<progress_reporter> m_reporter;
+	unsigned int m_album;
+	uint64_t m_frames;
+	uint64_t m_decoded_bytes;
+	std::string m_output_filename;
+};
+
+} // namespace dtcue
+
+#endif /* DT_CUE_PROGRESS_HPP */
@@ -0,0 +1,840 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-remote.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+namespace dtcue {
+
+struct remote_task
+{
+	unsigned int id;
+	std::string script;
+
+	// number of times task was lost together with its worker
+	unsigned int attempts;
+
+	bool finished;
+	bool succeeded;
+
+	remote_task()
+		: id(0),
+		attempts(0),
+		finished(false),
+		succeeded(false)
+	{
+	}
+};
+
+namespace {
+
+struct socket_address
+{
+	bool is_unix;
+
+	std::string path;
+
+	std::string host;
+	std::string port;
+};
+
+socket_address parse_address(const std::string &address)
+{
+	socket_address result;
+
+	if (address.compare(0, 5, "unix:") == 0)
+	{
+		result.is_unix = true;
+		result.path = address.substr(5);
+
+		if (result.path.empty())
+		{
+			throw std::invalid_argument("Invalid socket address: " + address);
+		}
+
+		return result;
+	}
+
+	size_t separator = address.rfind(':');
+
+	if ((separator == std::string::npos) || (separator + 1 == address.length()))
+	{
+		throw std::invalid_argument("Invalid socket address: " + address);
+	}
+
+	result.is_unix = false;
+	result.host = address.substr(0, separator);
+	result.port = address.substr(separator + 1);
+
+	// IPv6 addresses are written in brackets
+	if ((result.host.length() >= 2) && (result.host.front() == '[') && (result.host.back() == ']'))
+	{
+		result.host = result.host.substr(1, result.host.length() - 2);
+	}
+
+	return result;
+}
+
+std::string socket_error(const std::string &message, const std::string &address)
+{
+	return message + " '" + address + "': " + strerror(errno);
+}
+
+// lost machine is noticed even if its worker is in the middle of long job
+void enable_keepalive(int fd)
+{
+	int enabled = 1;
+	int idle_seconds = 60;
+	int interval_seconds = 10;
+	int probes = 6;
+
+	setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &enabled, sizeof(enabled));
+	setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle_seconds, sizeof(idle_seconds));
+	setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval_seconds, sizeof(interval_seconds));
+	setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+}
+
+void set_receive_timeout(int fd, unsigned int seconds)
+{
+	struct timeval timeout;
+	timeout.tv_sec = seconds;
+	timeout.tv_usec = 0;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+struct sockaddr_un make_unix_address(const std::string &path)
+{
+	struct sockaddr_un result;
+	memset(&result, 0, sizeof(result));
+	result.sun_family = AF_UNIX;
+
+	if (path.length() >= sizeof(result.sun_path))
+	{
+		throw std::invalid_argument("Socket path is too long: " + path);
+	}
+
+	memcpy(result.sun_path, path.c_str(), path.length());
+
+	return result;
+}
+
+// tries every address host and port resolve to, returns connected or bound socket
+int open_tcp_socket(const socket_address &address, const std::string &printable_address, bool listening)
+{
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	// without AI_PASSIVE empty host means loopback, so socket isn't exposed to network by accident
+	hints.ai_flags = 0;
+
+	struct addrinfo *addresses = NULL;
+
+	int error = getaddrinfo(address.host.empty() ? NULL : address.host.c_str(), address.port.c_str(), &hints, &addresses);
+	if (error != 0)
+	{
+		throw std::runtime_error("Failed to resolve address '" + printable_address + "': " + gai_strerror(error));
+	}
+
+	int result = -1;
+
+	for (struct addrinfo *current = addresses; (current != NULL) && (result == -1); current = current->ai_next)
+	{
+		result = socket(current->ai_family, current->ai_socktype | SOCK_CLOEXEC, current->ai_protocol);
+		if (result == -1)
+		{
+			continue;
+		}
+
+		bool success;
+
+		if (listening)
+		{
+			int enabled = 1;
+			setsockopt(result, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+
+			success = (bind(result, current->ai_addr, current->ai_addrlen) == 0) && (listen(result, SOMAXCONN) == 0);
+		}
+		else
+		{
+			success = (connect(result, current->ai_addr, current->ai_addrlen) == 0);
+		}
+
+		if (!success)
+		{
+			int saved_errno = errno;
+			close(result);
+			errno = saved_errno;
+			result = -1;
+		}
+	}
+
+	freeaddrinfo(addresses);
+
+	if (result == -1)
+	{
+		throw std::runtime_error(socket_error(listening ? "Failed to listen on" : "Failed to connect to", printable_address));
+	}
+
+	enable_keepalive(result);
+
+	return result;
+}
+
+int listen_socket(const std::string &printable_address)
+{
+	socket_address address = parse_address(printable_address);
+
+	if (!address.is_unix)
+	{
+		return open_tcp_socket(address, printable_address, true);
+	}
+
+	struct sockaddr_un unix_address = make_unix_address(address.path);
+
+	int result = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (result == -1)
+	{
+		throw std::runtime_error(socket_error("Failed to create socket", printable_address));
+	}
+
+	// socket file left by coordinator which was killed
+	unlink(address.path.c_str());
+
+	// nobody can connect before listen(), so permissions are restricted in time
+	if ((bind(result, reinterpret_cast<struct sockaddr*>(&unix_address), sizeof(unix_address)) != 0)
+		|| (chmod(address.path.c_str(), S_IRUSR | S_IWUSR) != 0)
+		|| (listen(result, SOMAXCONN) != 0))
+	{
+		std::string message = socket_error("Failed to listen on", printable_address);
+		close(result);
+		throw std::runtime_error(message);
+	}
+
+	return result;
+}
+
+int connect_socket(const std::string &printable_address)
+{
+	socket_address address = parse_address(printable_address);
+
+	if (!address.is_unix)
+	{
+		return open_tcp_socket(address, printable_address, false);
+	}
+
+	struct sockaddr_un unix_address = make_unix_address(address.path);
+
+	int result = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (result == -1)
+	{
+		throw std::runtime_error(socket_error("Failed to create socket", printable_address));
+	}
+
+	if (connect(result, reinterpret_cast<struct sockaddr*>(&unix_address), sizeof(unix_address)) != 0)
+	{
+		std::string message = socket_error("Failed to connect to", printable_address);
+		close(result);
+		throw std::runtime_error(message);
+	}
+
+	return result;
+}
+
+// buffered reading of protocol messages, any failure means that connection is lost
+class connection
+{
+public:
+	explicit connection(int fd)
+		: m_fd(fd)
+	{
+	}
+
+	~connection()
+	{
+		close(m_fd);
+	}
+
+	connection(const connection &other) = delete;
+	connection& operator=(const connection &other) = delete;
+
+	int fd() const
+	{
+		return m_fd;
+	}
+
+	// line is returned without newline
+	bool read_line(std::string &line)
+	{
+		size_t end;
+
+		while ((end = m_buffer.find('\n')) == std::string::npos)
+		{
+			if (!fill())
+			{
+				return false;
+			}
+		}
+
+		line = m_buffer.substr(0, end);
+		m_buffer.erase(0, end + 1);
+
+		return true;
+	}
+
+	bool read_exact(size_t length, std::string &data)
+	{
+		while (m_buffer.length() < length)
+		{
+			if (!fill())
+			{
+				return false;
+			}
+		}
+
+		data = m_buffer.substr(0, length);
+		m_buffer.erase(0, length);
+
+		return true;
+	}
+
+	bool write_all(const std::string &data)
+	{
+		size_t written = 0;
+
+		while (written < data.length())
+		{
+			ssize_t result = send(m_fd, data.data() + written, data.length() - written, MSG_NOSIGNAL);
+
+			if (result < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				return false;
+			}
+
+			written += result;
+		}
+
+		return true;
+	}
+
+	// idle peer never sends anything, so readable socket means that it was closed
+	bool is_closed() const
+	{
+		struct pollfd descriptor;
+		descriptor.fd = m_fd;
+		descriptor.events = POLLIN;
+		descriptor.revents = 0;
+
+		return (poll(&descriptor, 1, 0) != 0);
+	}
+
+private:
+	bool fill()
+	{
+		char data[4096];
+
+		for (;;)
+		{
+			ssize_t result = recv(m_fd, data, sizeof(data), 0);
+
+			if (result > 0)
+			{
+				m_buffer.append(data, result);
+				return true;
+			}
+
+			if ((result < 0) && (errno == EINTR))
+			{
+				continue;
+			}
+
+			return false;
+		}
+	}
+
+	int m_fd;
+	std::string m_buffer;
+};
+
+// returns exit status of script, or 128 + signal number if it was killed like shell does
+int run_script(const std::string &script)
+{
+	pid_t child = fork();
+
+	if (child == -1)
+	{
+		return -1;
+	}
+
+	if (child == 0)
+	{
+		// job of killed worker is given to another worker, so it shouldn't keep writing the same files
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+		// failure of any command of pipeline fails the job, same as when it's run locally
+		execl("/bin/bash", "bash", "-o", "pipefail", "-c", script.c_str(), static_cast<char*>(NULL));
+		_exit(127);
+	}
+
+	int status;
+
+	while (waitpid(child, &status, 0) == -1)
+	{
+		if (errno != EINTR)
+		{
+			return -1;
+		}
+	}
+
+	if (WIFEXITED(status))
+	{
+		return WEXITSTATUS(status);
+	}
+
+	if (WIFSIGNALED(status))
+	{
+		return 128 + WTERMSIG(status);
+	}
+
+	return -1;
+}
+
+std::string shared_token()
+{
+	const char *token = getenv("DT_CUE_SPLIT_TOKEN");
+
+	return (token != NULL) ? token : std::string();
+}
+
+// time taken doesn't tell how much of token was guessed right, only its length may be learned
+bool tokens_equal(const std::string &received, const std::string &expected)
+{
+	if (received.length() != expected.length())
+	{
+		return false;
+	}
+
+	unsigned char difference = 0;
+
+	for (size_t i = 0; i < received.length(); ++i)
+	{
+		difference |= received[i] ^ expected[i];
+	}
+
+	return (difference == 0);
+}
+
+std::string current_directory()
+{
+	char *directory = getcwd(NULL, 0);
+
+	if (directory == NULL)
+	{
+		throw std::runtime_error(std::string("Failed to get current directory: ") + strerror(errno));
+	}
+
+	std::string result = directory;
+	free(directory);
+
+	return result;
+}
+
+} // unnamed namespace
+
+const unsigned int job_dispatcher::worker_wait_seconds;
+
+job_dispatcher::job_dispatcher(const std::string &address, unsigned int max_attempts, bool verbose)
+	: m_address(address),
+	m_token(shared_token()),
+	m_directory(current_directory()),
+	m_max_attempts(max_attempts),
+	m_verbose(verbose),
+	m_listen_fd(listen_socket(address)),
+	m_stopping(false),
+	m_next_id(0),
+	m_live_workers(0),
+	m_no_workers_since(std::chrono::steady_clock::now())
+{
+	if (m_token.empty() && (!parse_address(address).is_unix))
+	{
+		close(m_listen_fd);
+		throw std::runtime_error("Serving jobs on TCP socket requires token in environment variable DT_CUE_SPLIT_TOKEN");
+	}
+
+	m_acceptor = std::thread(&job_dispatcher::accept_workers, this);
+}
+
+job_dispatcher::~job_dispatcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+		m_condition.notify_all();
+	}
+
+	// wakes up accept()
+	shutdown(m_listen_fd, SHUT_RDWR);
+	m_acceptor.join();
+	close(m_listen_fd);
+
+	socket_address address = parse_address(m_address);
+
+	if (address.is_unix)
+	{
+		unlink(address.path.c_str());
+	}
+
+	// idle workers see their connections closed and exit
+	for (auto connection_thread = m_connections.begin(); connection_thread != m_connections.end(); ++connection_thread)
+	{
+		connection_thread->join();
+	}
+}
+
+bool job_dispatcher::run(const std::string &script)
+{
+	std::shared_ptr<remote_task> task = std::make_shared<remote_task>();
+
+	// workers may be started in any directory
+	task->script = "cd \'" + escape_single_quote(m_directory) + "\' || exit 1\n" + script;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	task->id = ++m_next_id;
+	m_queue.push_back(task);
+	m_condition.notify_all();
+
+	while (!task->finished)
+	{
+		// queued script is given up only when nobody could take it; running one is requeued if its worker is lost
+		if ((m_live_workers == 0) && (std::chrono::steady_clock::now() - m_no_workers_since >= std::chrono::seconds(worker_wait_seconds)))
+		{
+			auto queued = std::find(m_queue.begin(), m_queue.end(), task);
+
+			if (queued != m_queue.end())
+			{
+				m_queue.erase(queued);
+				fprintf(stderr, "No worker connected to %s for %u seconds, job %u failed\n", m_address.c_str(), worker_wait_seconds, task->id);
+				return false;
+			}
+		}
+
+		m_condition.wait_for(lock, std::chrono::seconds(1));
+	}
+
+	return task->succeeded;
+}
+
+void job_dispatcher::accept_workers()
+{
+	for (;;)
+	{
+		int fd = accept4(m_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_stopping)
+		{
+			if (fd != -1)
+			{
+				close(fd);
+			}
+
+			break;
+		}
+
+		if (fd == -1)
+		{
+			if ((errno == EINTR) || (errno == ECONNABORTED))
+			{
+				continue;
+			}
+
+			fprintf(stderr, "Failed to accept workers on %s: %s\n", m_address.c_str(), strerror(errno));
+			break;
+		}
+
+		m_connections.push_back(std::thread(&job_dispatcher::serve_worker, this, fd));
+	}
+}
+
+void job_dispatcher::serve_worker(int fd)
+{
+	connection worker(fd);
+
+	// connection which doesn't introduce itself isn't kept forever
+	set_receive_timeout(fd, 10);
+
+	std::string greeting;
+	std::string token;
+
+	if ((!worker.read_line(greeting)) || (greeting.compare(0, 7, "worker ") != 0)
+		|| (!worker.read_line(token)) || (token.compare(0, 6, "token ") != 0))
+	{
+		fprintf(stderr, "Rejected connection on %s which isn't dt-cue-split worker\n", m_address.c_str());
+		return;
+	}
+
+	if (!tokens_equal(token.substr(6), m_token))
+	{
+		fprintf(stderr, "Rejected worker on %s with wrong token\n", m_address.c_str());
+		worker.write_all("rejected\n");
+		return;
+	}
+
+	// jobs may take any time
+	set_receive_timeout(fd, 0);
+
+	std::string name = greeting.substr(7);
+
+	if (m_verbose)
+	{
+		printf("Worker %s connected\n", name.c_str());
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_live_workers;
+	}
+
+	for (;;)
+	{
+		std::shared_ptr<remote_task> task;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			m_condition.wait(lock, [this]() { return (m_stopping || (!m_queue.empty())); });
+
+			if (m_stopping)
+			{
+				break;
+			}
+
+			task = m_queue.front();
+			m_queue.pop_front();
+
+			// worker which disconnected while idle didn't lose anything
+			if (worker.is_closed())
+			{
+				fprintf(stderr, "Worker %s disconnected\n", name.c_str());
+				m_queue.push_front(task);
+				m_condition.notify_all();
+				break;
+			}
+		}
+
+		std::stringstream header;
+		header << "job " << task->id << " " << task->script.length() << "\n";
+
+		std::string reply;
+		bool answered = worker.write_all(header.str() + task->script) && worker.read_line(reply);
+
+		std::stringstream fields(reply);
+		std::string keyword;
+		unsigned int id = 0;
+		int status = -1;
+		unsigned long milliseconds = 0;
+
+		answered = answered && (fields >> keyword >> id >> status >> milliseconds) && (keyword == "done") && (id == task->id);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!answered)
+		{
+			++(task->attempts);
+
+			if (task->attempts < m_max_attempts)
+			{
+				fprintf(stderr, "Lost worker %s, job %u is given to another worker\n", name.c_str(), task->id);
+				m_queue.push_front(task);
+			}
+			else
+			{
+				fprintf(stderr, "Lost worker %s, job %u failed after %u attempts\n", name.c_str(), task->id, task->attempts);
+				task->finished = true;
+			}
+
+			m_condition.notify_all();
+			break;
+		}
+
+		task->finished = true;
+		task->succeeded = (status == 0);
+
+		if (m_verbose)
+		{
+			printf("Worker %s finished job %u in %.3f seconds with exit status %d\n", name.c_str(), task->id, milliseconds / 1000.0, status);
+		}
+		else if (status != 0)
+		{
+			fprintf(stderr, "Job %u failed on worker %s with exit status %d\n", task->id, name.c_str(), status);
+		}
+
+		m_condition.notify_all();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (--m_live_workers == 0)
+	{
+		m_no_workers_since = std::chrono::steady_clock::now();
+	}
+}
+
+remote_command::remote_command(const std::shared_ptr<job_dispatcher> &dispatcher, const std::shared_ptr<command> &local_command)
+	: command(),
+	m_dispatcher(dispatcher),
+	m_local_command(local_command)
+{
+	// only waiting for worker is done locally
+	set_usage(resource_usage::light, local_command->reads_source());
+}
+
+bool remote_command::run() const
+{
+	// script is made only now, since it may depend on results of previous jobs
+	return m_dispatcher->run(m_local_command->script());
+}
+
+std::string remote_command::print() const
+{
+	return "# on worker: " + m_local_command->print();
+}
+
+std::string remote_command::script() const
+{
+	return m_local_command->script();
+}
+
+bool remote_command::compare(const command &other) const
+{
+	const remote_command &other_cmd = dynamic_cast<const remote_command&>(other);
+
+	return command_comparator()(m_local_command, other_cmd.m_local_command);
+}
+
+bool run_worker(const std::string &address, bool verbose)
+{
+	connection coordinator(connect_socket(address));
+
+	char hostname[256];
+
+	if (gethostname(hostname, sizeof(hostname)) != 0)
+	{
+		strcpy(hostname, "unknown");
+	}
+
+	hostname[sizeof(hostname) - 1] = '\0';
+
+	std::stringstream name;
+	name << hostname << ":" << getpid();
+
+	if (!coordinator.write_all("worker " + name.str() + "\ntoken " + shared_token() + "\n"))
+	{
+		fprintf(stderr, "Failed to connect to %s\n", address.c_str());
+		return false;
+	}
+
+	if (verbose)
+	{
+		printf("Connected to %s as %s\n", address.c_str(), name.str().c_str());
+	}
+
+	std::string header;
+
+	// coordinator closes connection when all jobs are done
+	while (coordinator.read_line(header))
+	{
+		if (header == "rejected")
+		{
+			fprintf(stderr, "Coordinator %s rejected token of this worker\n", address.c_str());
+			return false;
+		}
+
+		std::stringstream fields(header);
+		std::string keyword;
+		unsigned int id = 0;
+		size_t length = 0;
+		std::string script;
+
+		if ((!(fields >> keyword >> id >> length)) || (keyword != "job") || (!coordinator.read_exact(length, script)))
+		{
+			fprintf(stderr, "Invalid job received from %s\n", address.c_str());
+			return false;
+		}
+
+		if (verbose)
+		{
+			printf("Running job %u:\n%s\n", id, script.c_str());
+		}
+
+		// output of script isn't mixed with buffered output
+		fflush(stdout);
+
+		auto start = std::chrono::steady_clock::now();
+		int status = run_script(script);
+		auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+		if (verbose)
+		{
+			printf("Job %u finished in %.3f seconds with exit status %d\n", id, milliseconds / 1000.0, status);
+		}
+
+		std::stringstream reply;
+		reply << "done " << id << " " << status << " " << milliseconds << "\n";
+
+		if (!coordinator.write_all(reply.str()))
+		{
+			fprintf(stderr, "Lost connection to %s\n", address.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+} // namespace dtcue
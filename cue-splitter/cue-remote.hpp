@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_REMOTE_HPP
+#define DT_CUE_REMOTE_HPP
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "cue-action.hpp"
+
+namespace dtcue {
+
+// Jobs are run by worker processes connected over socket, which may be located on other machines.
+// Address is either "unix:path" of Unix socket or "host:port" of TCP socket.
+// TCP socket with empty host is bound to loopback only, other machines are served only when host is given explicitly.
+// Workers have to see files under the same paths as coordinator, i.e. on shared storage.
+//
+// Workers prove they may run jobs by token shared through environment variable DT_CUE_SPLIT_TOKEN.
+// Token is required on TCP socket; Unix socket is accessible by its owner only, so token is optional there.
+//
+// Protocol is line based:
+//   worker -> coordinator: "worker <name>" and "token <token>" once after connecting
+//   coordinator -> worker: "rejected" if token is wrong, connection is closed after that
+//   coordinator -> worker: "job <id> <length>" followed by shell script of given length
+//   worker -> coordinator: "done <id> <exit status> <milliseconds>"
+// Coordinator closes connection when there are no more jobs.
+
+struct remote_task;
+
+// Coordinator side: hands scripts over to connected workers.
+// Script of worker which disconnects before reporting result is given to another worker.
+// Scripts fail when no worker is connected for worker_wait_seconds.
+class job_dispatcher
+{
+public:
+	// script is retried until it's lost together with its worker max_attempts times
+	job_dispatcher(const std::string &address, unsigned int max_attempts, bool verbose);
+	~job_dispatcher();
+
+	job_dispatcher(const job_dispatcher &other) = delete;
+	job_dispatcher& operator=(const job_dispatcher &other) = delete;
+
+	static const unsigned int worker_wait_seconds = 600;
+
+	// blocks until some worker runs script in current directory, returns true if script succeeded;
+	// waits for workers to connect if there are none, but not longer than worker_wait_seconds
+	bool run(const std::string &script);
+
+private:
+	void accept_workers();
+	void serve_worker(int fd);
+
+	std::string m_address;
+	std::string m_token;
+	std::string m_directory;
+	unsigned int m_max_attempts;
+	bool m_verbose;
+
+	int m_listen_fd;
+	std::thread m_acceptor;
+
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+
+	bool m_stopping;
+	unsigned int m_next_id;
+
+	unsigned int m_live_workers;
+	std::chrono::steady_clock::time_point m_no_workers_since;
+	std::deque<std::shared_ptr<remote_task> > m_queue;
+	std::vector<std::thread> m_connections;
+};
+
+// Runs script of local command on worker, so that it takes no local resources.
+class remote_command: public command
+{
+public:
+	remote_command(const std::shared_ptr<job_dispatcher> &dispatcher, const std::shared_ptr<command> &local_command);
+
+	virtual bool run() const;
+	virtual std::string print() const;
+	virtual std::string script() const;
+
+protected:
+	virtual bool compare(const command &other) const;
+
+private:
+	std::shared_ptr<job_dispatcher> m_dispatcher;
+	std::shared_ptr<command> m_local_command;
+};
+
+// Worker side: connects to coordinator and runs jobs it sends until coordinator closes connection.
+// Throws std::runtime_error if coordinator can't be reached, returns false if it sent invalid job
+// or result couldn't be reported.
+bool run_worker(const std::string &address, bool verbose);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_REMOTE_HPP */
@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-scheduler.hpp"
+
+#include <stdio.h>
+
+namespace dtcue {
+
+scheduler::scheduler(const scheduler_limits &limits)
+	: m_limits(limits),
+	m_resident(false),
+	m_running(0),
+	m_reserved_bytes(0),
+	m_running_io_bound(0),
+	m_running_cpu_bound(0),
+	m_running_source_readers(0),
+	m_failed(false)
+{
+	if (m_limits.threads == 0)
+	{
+		m_limits.threads = 1;
+	}
+}
+
+void scheduler::add(const std::shared_ptr<job> &new_job)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_jobs.push_back(new_job);
+	m_states[new_job.get()] = job_state::pending;
+
+	m_condition.notify_all();
+}
+
+void scheduler::add(const std::vector<std::shared_ptr<job> > &new_jobs)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto iter = new_jobs.begin(); iter != new_jobs.end(); ++iter)
+	{
+		m_jobs.push_back(*iter);
+		m_states[iter->get()] = job_state::pending;
+	}
+
+	m_condition.notify_all();
+}
+
+bool scheduler::run(bool verbose, bool dry_run)
+{
+	// dry run only prints commands, keep them in order
+	unsigned int threads = dry_run ? 1 : m_limits.threads;
+
+	if (threads > m_jobs.size())
+	{
+		threads = m_jobs.size();
+	}
+
+	std::vector<std::thread> workers;
+
+	for (unsigned int i = 1; i < threads; ++i)
+	{
+		workers.push_back(std::thread(&scheduler::worker, this, verbose, dry_run));
+	}
+
+	worker(verbose, dry_run);
+
+	for (auto iter = workers.begin(); iter != workers.end(); ++iter)
+	{
+		iter->join();
+	}
+
+	return (!m_failed);
+}
+
+void scheduler::start(bool verbose, bool dry_run)
+{
+	// dry run only prints commands, keep them in order
+	unsigned int threads = dry_run ? 1 : m_limits.threads;
+
+	m_resident = true;
+
+	for (unsigned int i = 0; i < threads; ++i)
+	{
+		m_workers.push_back(std::thread(&scheduler::worker, this, verbose, dry_run));
+	}
+}
+
+bool scheduler::finish()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_resident = false;
+		m_condition.notify_all();
+	}
+
+	for (auto iter = m_workers.begin(); iter != m_workers.end(); ++iter)
+	{
+		iter->join();
+	}
+
+	m_workers.clear();
+
+	return (!m_failed);
+}
+
+std::vector<std::shared_ptr<job> > scheduler::jobs()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return m_jobs;
+}
+
+const scheduler_limits& scheduler::limits() const
+{
+	return m_limits;
+}
+
+std::shared_ptr<job> scheduler::acquire()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for (;;)
+	{
+		bool pending_left = false;
+		bool state_changed = false;
+		std::shared_ptr<job> selected;
+
+		for (auto iter = m_jobs.begin(); iter != m_jobs.end(); ++iter)
+		{
+			job_state &state = m_states[iter->get()];
+
+			if (state != job_state::pending)
+			{
+				continue;
+			}
+
+			pending_left = true;
+
+			bool ready = true;
+			bool prerequisite_failed = false;
+
+			for (auto prerequisite = (*iter)->prerequisites.begin(); prerequisite != (*iter)->prerequisites.end(); ++prerequisite)
+			{
+				job_state prerequisite_state = m_states[prerequisite->get()];
+
+				if ((prerequisite_state == job_state::pending) || (prerequisite_state == job_state::running))
+				{
+					ready = false;
+				}
+				else if (prerequisite_state == job_state::failed)
+				{
+					prerequisite_failed = true;
+				}
+			}
+
+			if (!ready)
+			{
+				continue;
+			}
+
+			if (prerequisite_failed && (*iter)->requires_success)
+			{
+				state = job_state::failed;
+				m_failed = true;
+				state_changed = true;
+				continue;
+			}
+
+			// a job bigger than whole budget is still allowed to run alone
+			if ((m_limits.work_budget != 0)
+				&& (m_running != 0)
+				&& (m_reserved_bytes + (*iter)->reserve_bytes > m_limits.work_budget))
+			{
+				continue;
+			}
+
+			// sequential run keeps original order, parallel run starts longest jobs first
+			// so that no long job is left running alone at the end
+			if ((!selected)
+				|| ((m_limits.threads > 1) && ((*iter)->cost > selected->cost)))
+			{
+				selected = *iter;
+
+				if (m_limits.threads == 1)
+				{
+					break;
+				}
+			}
+		}
+
+		if (selected)
+		{
+			if (state_changed)
+			{
+				m_condition.notify_all();
+			}
+
+			m_states[selected.get()] = job_state::running;
+			++m_running;
+			m_reserved_bytes += selected->reserve_bytes;
+
+			return selected;
+		}
+
+		if (!pending_left)
+		{
+			if (!m_resident)
+			{
+				return std::shared_ptr<job>();
+			}
+
+			// everything added so far is finished and new jobs can't depend on it,
+			// forget it so that long running process doesn't accumulate jobs
+			if (m_running == 0)
+			{
+				m_jobs.clear();
+				m_states.clear();
+			}
+
+			m_condition.wait(lock);
+			continue;
+		}
+
+		if (state_changed)
+		{
+			m_condition.notify_all();
+			continue;
+		}
+
+		m_condition.wait(lock);
+	}
+}
+
+void scheduler::complete(const std::shared_ptr<job> &finished_job, bool success)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_states[finished_job.get()] = success ? job_state::succeeded : job_state::failed;
+
+	if (!success)
+	{
+		m_failed = true;
+	}
+
+	--m_running;
+	m_reserved_bytes -= (finished_job->release_bytes < m_reserved_bytes) ? finished_job->release_bytes : m_reserved_bytes;
+
+	m_condition.notify_all();
+}
+
+void scheduler::acquire_resources(const command &next_command)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	for (;;)
+	{
+		bool available = true;
+
+		if ((next_command.usage() == resource_usage::io_bound)
+			&& (m_limits.io_bound_commands != 0)
+			&& (m_running_io_bound >= m_limits.io_bound_commands))
+		{
+			available = false;
+		}
+
+		if ((next_command.usage() == resource_usage::cpu_bound)
+			&& (m_limits.cpu_bound_commands != 0)
+			&& (m_running_cpu_bound >= m_limits.cpu_bound_commands))
+		{
+			available = false;
+		}
+
+		if (next_command.reads_source()
+			&& (m_limits.source_readers != 0)
+			&& (m_running_source_readers >= m_limits.source_readers))
+		{
+			available = false;
+		}
+
+		if (available)
+		{
+			break;
+		}
+
+		m_condition.wait(lock);
+	}
+
+	if (next_command.usage() == resource_usage::io_bound)
+	{
+		++m_running_io_bound;
+	}
+	else if (next_command.usage() == resource_usage::cpu_bound)
+	{
+		++m_running_cpu_bound;
+	}
+
+	if (next_command.reads_source())
+	{
+		++m_running_source_readers;
+	}
+}
+
+void scheduler::release_resources(const command &finished_command)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (finished_command.usage() == resource_usage::io_bound)
+	{
+		--m_running_io_bound;
+	}
+	else if (finished_command.usage() == resource_usage::cpu_bound)
+	{
+		--m_running_cpu_bound;
+	}
+
+	if (finished_command.reads_source())
+	{
+		--m_running_source_readers;
+	}
+
+	m_condition.notify_all();
+}
+
+void scheduler::worker(bool verbose, bool dry_run)
+{
+	for (std::shared_ptr<job> current_job = acquire(); current_job; current_job = acquire())
+	{
+		bool success = true;
+
+		for (auto command = current_job->commands.begin(); command != current_job->commands.end(); ++command)
+		{
+			if (verbose)
+			{
+				std::lock_guard<std::mutex> lock(m_output_mutex);
+				printf("%s\n", (*command)->print().c_str());
+			}
+
+			if (!dry_run)
+			{
+				acquire_resources(**command);
+				bool command_result = (*command)->run();
+				release_resources(**command);
+
+				if (!command_result)
+				{
+					std::lock_guard<std::mutex> lock(m_output_mutex);
+					fprintf(stderr, "Action failed: %s\n", (*command)->print().c_str());
+					success = false;
+					break;
+				}
+			}
+		}
+
+		complete(current_job, success);
+	}
+}
+
+} // namespace dtcue
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_SCHEDULER_HPP
+#define DT_CUE_SCHEDULER_HPP
+
+#include <list>
+#include <map>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include <stdint.h>
+
+#include "cue-action.hpp"
+
+namespace dtcue {
+
+// Sequence of commands which are run one after another.
+// Job is started only after all its prerequisites are finished.
+struct job
+{
+	std::list<std::shared_ptr<command> > commands;
+
+	std::vector<std::shared_ptr<job> > prerequisites;
+
+	// if not set, job is started even if some prerequisites failed
+	bool requires_success;
+
+	// space in work directory taken when job starts and given back when it finishes
+	uint64_t reserve_bytes;
+	uint64_t release_bytes;
+
+	// estimated processing time, i.e. length of audio in CD frames;
+	// when running in parallel, ready jobs with larger cost are started first
+	uint64_t cost;
+
+	// files read and produced by job, used only when plan is exported into build file
+	std::vector<std::string> inputs;
+	std::vector<std::string> outputs;
+
+	job()
+		: requires_success(true),
+		reserve_bytes(0),
+		release_bytes(0),
+		cost(0)
+	{
+	}
+};
+
+// value of 0 means no limit for all fields except threads
+struct scheduler_limits
+{
+	unsigned int threads;
+
+	// bytes available for intermediate files in work directory
+	uint64_t work_budget;
+
+	// number of concurrently running commands of each kind
+	unsigned int io_bound_commands;
+	unsigned int cpu_bound_commands;
+
+	// number of commands concurrently reading source files
+	unsigned int source_readers;
+
+	scheduler_limits()
+		: threads(1),
+		work_budget(0),
+		io_bound_commands(0),
+		cpu_bound_commands(0),
+		source_readers(0)
+	{
+	}
+};
+
+class scheduler
+{
+public:
+	explicit scheduler(const scheduler_limits &limits);
+
+	void add(const std::shared_ptr<job> &new_job);
+
+	// jobs are added at once, so that workers never see part of them
+	void add(const std::vector<std::shared_ptr<job> > &new_jobs);
+
+	// returns true if all jobs succeeded
+	bool run(bool verbose, bool dry_run);
+
+	// starts workers which keep waiting for new jobs until finish() is called
+	void start(bool verbose, bool dry_run);
+
+	// waits for all added jobs, returns true if all of them succeeded
+	bool finish();
+
+	// jobs added so far, for exporting plan instead of running it
+	std::vector<std::shared_ptr<job> > jobs();
+
+	const scheduler_limits& limits() const;
+
+private:
+	enum class job_state
+	{
+		pending,
+		running,
+		succeeded,
+		failed
+	};
+
+	std::shared_ptr<job> acquire();
+	void complete(const std::shared_ptr<job> &finished_job, bool success);
+
+	void acquire_resources(const command &next_command);
+	void release_resources(const command &finished_command);
+
+	void worker(bool verbose, bool dry_run);
+
+	scheduler_limits m_limits;
+
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::mutex m_output_mutex;
+
+	// set while workers started by start() are running
+	bool m_resident;
+	std::vector<std::thread> m_workers;
+
+	std::vector<std::shared_ptr<job> > m_jobs;
+	std::map<const job*, job_state> m_states;
+
+	unsigned int m_running;
+	uint64_t m_reserved_bytes;
+
+	unsigned int m_running_io_bound;
+	unsigned int m_running_cpu_bound;
+	unsigned int m_running_source_readers;
+	bool m_failed;
+};
+
+} // namespace dtcue
+
+#endif /* DT_CUE_SCHEDULER_HPP */
@@ -19,29 +19,55 @@
  */
 
 #include <dt-cue-library.hpp>
+#include <dt-cue-embedded.hpp>
+#include <dt-cue-plan.hpp>
 
 #include <list>
 #include <vector>
 #include <set>
 #include <stdexcept>
 #include <sstream>
+#include <fstream>
 #include <iomanip>
 #include <memory>
 #include <string>
 #include <algorithm>
 
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#include <linux/magic.h>
 
 #include "cue-action.hpp"
+#include "cue-cache.hpp"
+#include "cue-checksum.hpp"
+#include "cue-duplicates.hpp"
+#include "cue-emit.hpp"
+#include "cue-remote.hpp"
+#include "cue-encoder.hpp"
+#include "cue-flac-copy.hpp"
+#include "cue-journal.hpp"
+#include "cue-probe.hpp"
+#include "cue-progress.hpp"
+#include "cue-scheduler.hpp"
+#include "cue-target.hpp"
+#include "cue-watch.hpp"
 
 struct track_part
 {
 	std::string filename;
 
-	std::experimental::optional<dtcue::time_point> start_time;
-	std::experimental::optional<dtcue::time_point> end_time;
+	// in CD frames, 1/75 of second
+	std::experimental::optional<uint64_t> start_frame;
+	std::experimental::optional<uint64_t> end_frame;
 };
 
 struct track_data
@@ -53,34 +79,80 @@ struct track_data
 	std::vector<track_part> parts;
 };
 
-enum class gap_action_type
+struct split_context
 {
-	discard,
-	prepend,
-	append,
-	prepend_first_then_append
-};
+	std::map<std::string, std::string> frames_to_seconds_map;
 
-std::string escape_single_quote(const std::string &input)
-{
-	std::string result = input;
+	std::set<std::shared_ptr<dtcue::command>, dtcue::command_comparator> init_commands;
+	std::set<std::shared_ptr<dtcue::command>, dtcue::command_comparator> deinit_commands;
 
-	size_t idx = result.rfind('\'');
+	std::shared_ptr<dtcue::decode_cache> cache;
 
-	while (idx != std::string::npos)
-	{
-		result.replace(idx, 1, "\'\\\'\'");
+	// intermediate files are placed into work directory, finished tracks are moved into output directory,
+	// empty string means current directory
+	std::string work_directory;
+	std::string output_directory;
 
-		if (idx == 0)
-		{
-			break;
-		}
+	// relative filenames of cue sheet are resolved against this directory, empty string means current directory
+	std::string source_directory;
+
+	// formats of source files, filled by validation for files whose headers can be read
+	std::map<std::string, dtcue::audio_properties> source_properties;
+
+	// if set, every track job reports its completion
+	std::shared_ptr<dtcue::progress_reporter> progress;
+
+	// if set, audio is streamed into encoders through splitter and encoded tracks are checked against its checksums
+	bool verify;
+
+	// expected size of files created in work directory by init commands and removed by deinit commands
+	std::map<const dtcue::command*, uint64_t> work_bytes;
+
+	// if set, images which have to be decoded completely are cut into tracks while decoding
+	bool stream_decode;
+	std::map<std::string, std::shared_ptr<dtcue::stream_split_command> > stream_commands;
+
+	// if set, tracks of FLAC sources are cut by copying frames, frame index of every source is built once
+	bool flac_copy;
+	std::map<std::string, std::shared_ptr<dtcue::flac_frame_index> > flac_sources;
+
+	// if set, compression level of every track is chosen when its encoding starts
+	std::shared_ptr<dtcue::encoder_tuner> tuner;
+
+	// every track is encoded into these formats too, from the same decoded audio as FLAC
+	std::vector<dtcue::output_target> targets;
+
+	// if set, albums already present in library under another directory are skipped
+	std::shared_ptr<dtcue::disc_index> library;
 
-		idx = result.rfind('\'', idx - 1);
+	// if set, encoding commands are run by connected workers
+	std::shared_ptr<dtcue::job_dispatcher> dispatcher;
+
+	split_context()
+		: verify(false),
+		stream_decode(false),
+		flac_copy(false)
+	{
 	}
+};
 
-	return result;
-}
+struct split_options
+{
+	bool verbose;
+	bool dry_run;
+	bool resume;
+	dtcue::gap_action gap_action;
+
+	split_options()
+		: verbose(false),
+		dry_run(false),
+		resume(false),
+		gap_action(dtcue::gap_action::discard)
+	{
+	}
+};
+
+using dtcue::escape_single_quote;
 
 void rename_tag(std::map<std::string, std::string> &tags, const std::string &oldname, const std::string &newname)
 {
@@ -94,12 +166,7 @@ void rename_tag(std::map<std::string, std::string> &tags, const std::string &old
 	}
 }
 
-bool is_timepoint_zero(const dtcue::time_point &timepoint)
-{
-	return ((std::stoul(timepoint.minutes) == 0) && (std::stoul(timepoint.seconds) == 0) && (std::stoul(timepoint.frames) == 0));
-}
-
-std::list<track_data> convert_cue_to_tracks(const dtcue::cue &cue, gap_action_type gap_action)
+std::list<track_data> convert_cue_to_tracks(const dtcue::cue &cue, dtcue::gap_action gap_action)
 {
 	std::list<track_data> result;
 	std::map<std::string, std::string> global_tags;
@@ -109,51 +176,19 @@ std::list<track_data> convert_cue_to_tracks(const dtcue::cue &cue, gap_action_ty
 	// NOTE: initial TITLE is transformed into ALBUM, TITLE for track is left as it is
 	rename_tag(global_tags, "TITLE", "ALBUM");
 
-	auto track = cue.tracks.begin();
-	auto next_track = track;
+	// positions are kept in CD frames, since sample rates of source files aren't known yet
+	dtcue::split_plan plan = dtcue::make_split_plan(cue, gap_action, 75);
+	auto range = plan.ranges.begin();
 
-	while (track != cue.tracks.end())
+	for (uint32_t track_position = 0; track_position < cue.tracks.size(); ++track_position)
 	{
-		++next_track;
-
-		if (track->type != dtcue::track_type::audio)
-		{
-			std::stringstream err;
-			err << "Track with index " << track->track_index << " has unsupported type";
-			throw std::runtime_error(err.str());
-		}
-
-		auto index0 = track->indices.find(0);
-		auto index1 = track->indices.find(1);
-
-		std::experimental::optional<std::map<unsigned int, dtcue::file_time_point>::const_iterator> index0_next;
-		std::experimental::optional<std::map<unsigned int, dtcue::file_time_point>::const_iterator> index1_next;
-
-		if (index1 == track->indices.end())
-		{
-			std::stringstream err;
-			err << "Track with index " << track->track_index << " doesn't have index 01";
-			throw std::runtime_error(err.str());
-		}
-
-		if (next_track != cue.tracks.end())
-		{
-			index0_next = next_track->indices.find(0);
-			index1_next = next_track->indices.find(1);
-
-			if (index1_next == next_track->indices.end())
-			{
-				std::stringstream err;
-				err << "Track with index " << next_track->track_index << " doesn't have index 01";
-				throw std::runtime_error(err.str());
-			}
-		}
+		const dtcue::track &track = cue.tracks[track_position];
 
 		track_data data;
-		data.index = track->track_index;
+		data.index = track.track_index;
 
 		// NOTE: track-specific tags are more important compared to generic tags
-		data.tags = track->tags;
+		data.tags = track.tags;
 		data.tags.insert(global_tags.begin(), global_tags.end());
 
 		if (data.tags.find("TRACKNUMBER") == data.tags.end())
@@ -164,124 +199,27 @@ std::list<track_data> convert_cue_to_tracks(const dtcue::cue &cue, gap_action_ty
 		// NOTE: rename PERFORMER tag into ARTIST
 		rename_tag(data.tags, "PERFORMER", "ARTIST");
 
-		size_t index = index1->second.file_index;
-		dtcue::time_point initial_timepoint = index1->second.time;
-
-		switch (gap_action)
-		{
-		case gap_action_type::discard:
-		case gap_action_type::append:
-			break;
-
-		case gap_action_type::prepend:
-			if (index0 != track->indices.end())
-			{
-				index = index0->second.file_index;
-				initial_timepoint = index0->second.time;
-			}
-			break;
-
-		case gap_action_type::prepend_first_then_append:
-			if ((index0 != track->indices.end()) && (track == cue.tracks.begin()))
-			{
-				index = index0->second.file_index;
-				initial_timepoint = index0->second.time;
-			}
-			break;
-		}
-
+		// only the first part starts at INDEX point, following parts start at beginning of their files
+		for (bool first_part = true; (range != plan.ranges.end()) && (range->track == track_position); ++range, first_part = false)
 		{
 			track_part part;
 
-			part.filename = track->files[index];
-			part.start_time = initial_timepoint;
-
-			data.parts.push_back(part);
-		}
-
-		for (++index ; index < track->files.size(); ++index)
-		{
-			track_part part;
-
-			part.filename = track->files[index];
-
-			data.parts.push_back(part);
-		}
-
-		if (next_track != cue.tracks.end())
-		{
-			std::string filename;
-			dtcue::time_point timepoint;
+			part.filename = plan.files[range->file];
 
-			switch (gap_action)
+			if (first_part)
 			{
-			case gap_action_type::discard:
-			case gap_action_type::prepend:
-				if (index0_next && ((*index0_next) != next_track->indices.end()))
-				{
-					filename = next_track->files[(*index0_next)->second.file_index];
-					timepoint = (*index0_next)->second.time;
-				}
-				else
-				{
-					filename = next_track->files[(*index1_next)->second.file_index];
-					timepoint = (*index1_next)->second.time;
-				}
-				break;
-
-			case gap_action_type::append:
-			case gap_action_type::prepend_first_then_append:
-				if ((*index1_next)->second.file_index != 0)
-				{
-					index = 0;
-					size_t last_index = (*index1_next)->second.file_index;
-
-					if (data.parts.back().filename == next_track->files[0])
-					{
-						index = 1;
-					}
-
-					for ( ; index <= last_index; ++index)
-					{
-						track_part part;
-
-						part.filename = next_track->files[index];
-
-						data.parts.push_back(part);
-					}
-				}
-
-				filename = next_track->files[(*index1_next)->second.file_index];
-				timepoint = (*index1_next)->second.time;
-				break;
+				part.start_frame = range->start;
 			}
 
-			if (is_timepoint_zero(timepoint))
+			if (range->end != dtcue::split_plan::until_end)
 			{
-				if (data.parts.back().filename != filename)
-				{
-					std::stringstream err;
-					err << "Track with index " << next_track->track_index << " has invalid starting timestamp";
-					throw std::runtime_error(err.str());
-				}
-
-				data.parts.pop_back();
+				part.end_frame = range->end;
 			}
-			else
-			{
-				if (data.parts.back().filename != filename)
-				{
-					std::stringstream err;
-					err << "Track with index " << next_track->track_index << " doesn't continue at same file as previous track";
-					throw std::runtime_error(err.str());
-				}
 
-				data.parts.back().end_time = timepoint;
-			}
+			data.parts.push_back(part);
 		}
 
 		result.push_back(data);
-		track = next_track;
 	}
 
 	return result;
@@ -323,405 +261,1780 @@ bool convert_and_save_frames(std::map<std::string, std::string> &map, const std:
 	return true;
 }
 
-void print_usage(const char *name)
+// mm:ss.ffffff, as accepted by flac
+std::string format_minutes_time(uint64_t frames)
 {
-	fprintf(stderr, "USAGE: %s [-v|--verbose] [-n|--dry-run] [--gap-discard|--gap-prepend|--gap-append|--gap-prepend-first-then-append] cuesheet\n", name);
+	char buffer[64];
+
+	snprintf(buffer, sizeof(buffer), "%02llu:%02llu.%06llu",
+		static_cast<unsigned long long>(frames / (75 * 60)),
+		static_cast<unsigned long long>((frames / 75) % 60),
+		static_cast<unsigned long long>((frames % 75) * 1000000 / 75));
+
+	return buffer;
 }
 
-int main(int argc, char **argv)
+// h:m:ss.ffffff, as accepted by wvunpack and ffmpeg
+std::string format_hours_time(uint64_t frames)
 {
-	bool verbose = false;
-	bool dry_run = false;
-	gap_action_type gap_action = gap_action_type::discard;
-	char *filename = NULL;
-
-	std::map<std::string, std::string> frames_to_seconds_map;
+	char buffer[64];
 
-	try
-	{
-		for (int i = 1; i < argc; ++i)
-		{
-			if ((strcmp(argv[i], "-v") == 0)
-				|| (strcmp(argv[i], "--verbose") == 0))
-			{
-				verbose = true;
-			}
-			else if ((strcmp(argv[i], "-n") == 0)
-				|| (strcmp(argv[i], "--dry-run") == 0))
-			{
-				dry_run = true;
-			}
-			else if (strcmp(argv[i], "--gap-discard") == 0)
-			{
-				gap_action = gap_action_type::discard;
-			}
-			else if (strcmp(argv[i], "--gap-prepend") == 0)
-			{
-				gap_action = gap_action_type::prepend;
-			}
-			else if (strcmp(argv[i], "--gap-append") == 0)
-			{
-				gap_action = gap_action_type::append;
-			}
-			else if (strcmp(argv[i], "--gap-prepend-first-then-append") == 0)
-			{
-				gap_action = gap_action_type::prepend_first_then_append;
-			}
-			else if (filename == NULL)
-			{
-				filename = argv[i];
-			}
-			else
-			{
-				print_usage(argv[0]);
-				return -1;
-			}
-		}
+	snprintf(buffer, sizeof(buffer), "%llu:%llu:%02llu.%06llu",
+		static_cast<unsigned long long>(frames / (75 * 60 * 60)),
+		static_cast<unsigned long long>((frames / (75 * 60)) % 60),
+		static_cast<unsigned long long>((frames / 75) % 60),
+		static_cast<unsigned long long>((frames % 75) * 1000000 / 75));
 
-		if (filename == NULL)
-		{
-			print_usage(argv[0]);
-			return -1;
-		}
+	return buffer;
+}
 
-		dtcue::cue cuesheet = dtcue::parse_cue_file(filename);
+// mm:ss:ff, as written in cue sheet
+std::string format_frames(uint64_t frames)
+{
+	char buffer[64];
 
-		// convert frames to time, from 1/75 to 1/1000000, and save these values to map
-		{
-			for (auto track = cuesheet.tracks.begin(); track != cuesheet.tracks.end(); ++track)
-			{
-				for (auto index = track->indices.begin(); index != track->indices.end(); ++index)
-				{
-					if (!convert_and_save_frames(frames_to_seconds_map, index->second.time.frames))
-					{
-						fprintf(stderr, "Failed to convert frames for track %s, index %u: value is %s\n", track->track_index.c_str(), index->first, index->second.time.frames.c_str());
-						return -1;
-					}
-				}
-			}
-		}
+	snprintf(buffer, sizeof(buffer), "%02llu:%02llu:%02llu",
+		static_cast<unsigned long long>(frames / (75 * 60)),
+		static_cast<unsigned long long>((frames / 75) % 60),
+		static_cast<unsigned long long>(frames % 75));
 
-		if (verbose)
-		{
-			printf("\nGlobal tags:\n");
+	return buffer;
+}
 
-			for (auto tag = cuesheet.tags.begin(); tag != cuesheet.tags.end(); ++tag)
-			{
-				printf("\t%s=%s\n", tag->first.c_str(), tag->second.c_str());
-			}
+bool has_extension(const std::string &filename, const std::string &extension)
+{
+	return ((filename.length() >= extension.length())
+		&& (filename.compare(filename.length() - extension.length(), std::string::npos, extension) == 0));
+}
 
-			printf("Tracks:\n");
+std::string make_hex_string(uint64_t value)
+{
+	std::stringstream result;
 
-			for (auto track = cuesheet.tracks.begin(); track != cuesheet.tracks.end(); ++track)
-			{
-				printf("\tTrack %s\n", track->track_index.c_str());
+	result << std::hex << std::setfill('0') << std::setw(16) << value;
 
-				for (size_t file_idx = 0; file_idx < track->files.size(); ++file_idx)
-				{
-					printf("\t\tFile %zu: %s\n", file_idx, track->files[file_idx].c_str());
-				}
+	return result.str();
+}
 
-				for (auto index = track->indices.begin(); index != track->indices.end(); ++index)
-				{
-					printf("\t\tINDEX %02d: file %zu, %s:%s.%s\n", index->first, index->second.file_index, index->second.time.minutes.c_str(), index->second.time.seconds.c_str(), frames_to_seconds_map[index->second.time.frames].c_str());
-				}
+std::string join_path(const std::string &directory, const std::string &filename)
+{
+	if (directory.empty())
+	{
+		return filename;
+	}
 
-				for (auto tag = track->tags.begin(); tag != track->tags.end(); ++tag)
-				{
-					printf("\t\t%s=%s\n", tag->first.c_str(), tag->second.c_str());
-				}
-			}
+	if (directory.back() == '/')
+	{
+		return directory + filename;
+	}
 
-			printf("\n");
-		}
+	return directory + "/" + filename;
+}
 
-		std::list<track_data> tracks = convert_cue_to_tracks(cuesheet, gap_action);
+uint64_t file_size(const std::string &filename)
+{
+	struct stat statbuf;
 
-		// convert frames to time, from 1/75 to 1/1000000, and save these values to map
-		{
-			for (auto track = tracks.begin(); track != tracks.end(); ++track)
-			{
-				for (auto part = track->parts.begin(); part != track->parts.end(); ++part)
-				{
-					if (part->start_time)
-					{
-						if (!convert_and_save_frames(frames_to_seconds_map, part->start_time->frames))
-						{
-							fprintf(stderr, "Failed to convert frames for track %s, file %s, start time: value is %s\n", track->index.c_str(), part->filename.c_str(), part->start_time->frames.c_str());
-							return -1;
-						}
-					}
+	if (stat(filename.c_str(), &statbuf) == -1)
+	{
+		return 0;
+	}
 
-					if (part->end_time)
-					{
-						if (!convert_and_save_frames(frames_to_seconds_map, part->end_time->frames))
-						{
-							fprintf(stderr, "Failed to convert frames for track %s, file %s, end time: value is %s\n", track->index.c_str(), part->filename.c_str(), part->end_time->frames.c_str());
-							return -1;
-						}
-					}
-				}
-			}
-		}
+	return statbuf.st_size;
+}
 
-		if (verbose)
-		{
-			for (auto track = tracks.begin(); track != tracks.end(); ++track)
-			{
-				printf("Track %s\n", track->index.c_str());
+bool is_tmpfs(const std::string &directory)
+{
+	struct statfs statbuf;
 
-				for (auto part = track->parts.begin(); part != track->parts.end(); ++part)
-				{
-					printf("Filename: %s\n", part->filename.c_str());
+	return ((statfs(directory.c_str(), &statbuf) == 0) && (statbuf.f_type == TMPFS_MAGIC));
+}
 
-					if (part->start_time)
-					{
-						printf("Start: %s:%s.%s\n", part->start_time->minutes.c_str(), part->start_time->seconds.c_str(), frames_to_seconds_map[part->start_time->frames].c_str());
-					}
-					else
-					{
-						printf("Start: NONE\n");
-					}
+uint64_t available_space(const std::string &directory)
+{
+	struct statvfs statbuf;
 
-					if (part->end_time)
-					{
-						printf("End:   %s:%s.%s\n", part->end_time->minutes.c_str(), part->end_time->seconds.c_str(), frames_to_seconds_map[part->end_time->frames].c_str());
-					}
-					else
-					{
-						printf("End:   NONE\n");
-					}
-				}
+	if (statvfs(directory.c_str(), &statbuf) == -1)
+	{
+		return 0;
+	}
 
-				for (auto tag = track->tags.begin(); tag != track->tags.end(); ++tag)
-				{
-					printf("%s=%s\n", tag->first.c_str(), tag->second.c_str());
-				}
+	return static_cast<uint64_t>(statbuf.f_bavail) * statbuf.f_frsize;
+}
 
-				printf("\n");
-			}
-		}
+// range of samples taken from source file, returns false if length of source isn't known
+bool get_part_samples(const track_part &part, const split_context &context, uint64_t &start, uint64_t &end)
+{
+	auto properties = context.source_properties.find(part.filename);
 
-		std::list<std::shared_ptr<dtcue::command> > commands_list;
-		std::set<std::shared_ptr<dtcue::command>, dtcue::command_comparator> init_commands, deinit_commands;
+	if ((properties == context.source_properties.end()) || (properties->second.total_samples == 0))
+	{
+		return false;
+	}
 
-		for (auto track = tracks.begin(); track != tracks.end(); ++track)
-		{
-			std::stringstream cmdstream;
+	const dtcue::audio_properties &format = properties->second;
 
-			// TODO: support concatenating tracks from parts of multiple files
-			if (track->parts.size() != 1)
-			{
-				std::stringstream err;
-				err << "Track with index " << track->index << " consists of more than 1 file. This is currently not supported.";
-				throw std::runtime_error(err.str());
-			}
+	start = part.start_frame ? (*(part.start_frame) * format.sample_rate / 75) : 0;
 
-			if (track->parts.front().filename.rfind(".flac") == track->parts.front().filename.length() - strlen(".flac"))
-			{
-				// use "C" locale in order to always use '.' as separator
-				cmdstream << "LC_ALL=C ";
-				cmdstream << "flac -d -F";
+	// last track of file ends where audio ends
+	end = part.end_frame ? (*(part.end_frame) * format.sample_rate / 75) : format.total_samples;
 
-				if (track->parts.front().start_time)
-				{
-					cmdstream << " --skip=" << track->parts.front().start_time->minutes << ':' << track->parts.front().start_time->seconds << '.' << frames_to_seconds_map[track->parts.front().start_time->frames];
-				}
+	if (end > format.total_samples)
+	{
+		end = format.total_samples;
+	}
 
-				if (track->parts.front().end_time)
-				{
-					cmdstream << " --until=" << track->parts.front().end_time->minutes << ':' << track->parts.front().end_time->seconds << '.' << frames_to_seconds_map[track->parts.front().end_time->frames];
-				}
+	if (start > end)
+	{
+		start = end;
+	}
 
-				cmdstream << " -o \'_track_" << track->index << ".wav\' \'" << escape_single_quote(track->parts.front().filename) << "\'";
-			}
-			else if (track->parts.front().filename.rfind(".wv") == track->parts.front().filename.length() - strlen(".wv"))
-			{
-				cmdstream << "wvunpack";
+	return true;
+}
 
-				if (track->parts.front().start_time)
-				{
-					unsigned int minutes = std::stoul(track->parts.front().start_time->minutes);
-					cmdstream << " --skip=" << minutes / 60 << ":" << minutes % 60 << ':' << track->parts.front().start_time->seconds << "." << frames_to_seconds_map[track->parts.front().start_time->frames];
-				}
+// length of track in samples, 0 if it isn't known
+uint64_t get_track_samples(const track_data &track, const split_context &context)
+{
+	uint64_t result = 0;
 
-				if (track->parts.front().end_time)
-				{
-					unsigned int minutes = std::stoul(track->parts.front().end_time->minutes);
-					cmdstream << " --until=" << minutes / 60 << ":" << minutes % 60 << ':' << track->parts.front().end_time->seconds << "." << frames_to_seconds_map[track->parts.front().end_time->frames];
-				}
+	for (auto part = track.parts.begin(); part != track.parts.end(); ++part)
+	{
+		uint64_t start = 0;
+		uint64_t end = 0;
 
-				cmdstream << " -o \'_track_" << track->index << ".wav\' \'" << escape_single_quote(track->parts.front().filename) << "\'";
-			}
-			else if ((track->parts.front().filename.rfind(".ape") == track->parts.front().filename.length() - strlen(".ape"))
-			         || (track->parts.front().filename.rfind(".m4a") == track->parts.front().filename.length() - strlen(".m4a"))
-			         || (track->parts.front().filename.rfind(".wav") == track->parts.front().filename.length() - strlen(".wav")))
-			{
-				std::string track_filename;
+		if (!get_part_samples(*part, context, start, end))
+		{
+			return 0;
+		}
 
-				if (track->parts.front().filename.rfind(".ape") == track->parts.front().filename.length() - strlen(".ape"))
-				{
-					track_filename = track->parts.front().filename;
-					track_filename.replace(track_filename.rfind(".ape"), std::string::npos, ".wav");
+		result += end - start;
+	}
 
-					cmdstream << "mac \'" << escape_single_quote(track->parts.front().filename) << "\' \'" << escape_single_quote(track_filename) << "\' -d";
+	return result;
+}
 
-					init_commands.insert(std::make_shared<dtcue::external_command>(cmdstream.str()));
+// size of decoded track, exact for sources whose format and length were read from headers,
+// otherwise estimated assuming CD audio: 2352 bytes per frame
+uint64_t estimate_track_bytes(const track_data &track, const split_context &context)
+{
+	uint64_t result = 0;
 
-					cmdstream.str(std::string());
+	for (auto part = track.parts.begin(); part != track.parts.end(); ++part)
+	{
+		uint64_t start_sample = 0;
+		uint64_t end_sample = 0;
 
-					cmdstream << "rm \'" << escape_single_quote(track_filename) << "\'";
+		if (get_part_samples(*part, context, start_sample, end_sample))
+		{
+			const dtcue::audio_properties &format = context.source_properties.find(part->filename)->second;
 
-					deinit_commands.insert(std::make_shared<dtcue::external_command>(cmdstream.str()));
+			result += (end_sample - start_sample) * format.channels * ((format.bits_per_sample + 7) / 8);
+			continue;
+		}
 
-					cmdstream.str(std::string());
-				}
-				else if (track->parts.front().filename.rfind(".m4a") == track->parts.front().filename.length() - strlen(".m4a"))
-				{
-					track_filename = track->parts.front().filename;
-					track_filename.replace(track_filename.rfind(".m4a"), std::string::npos, ".wav");
+		uint64_t start = part->start_frame ? (*(part->start_frame) * 2352) : 0;
 
-					cmdstream << "alac -f \'" << escape_single_quote(track_filename) << "\' \'" << escape_single_quote(track->parts.front().filename) << "\'";
+		if (part->end_frame)
+		{
+			uint64_t end = *(part->end_frame) * 2352;
+			result += (end > start) ? (end - start) : 0;
+		}
+		else
+		{
+			// length of the last track in file is not known, guess it from size of the file
+			uint64_t decoded_size = file_size(part->filename);
 
-					init_commands.insert(std::make_shared<dtcue::external_command>(cmdstream.str()));
+			if (!has_extension(part->filename, ".wav"))
+			{
+				decoded_size *= 2;
+			}
 
-					cmdstream.str(std::string());
+			result += (decoded_size > start) ? (decoded_size - start) : 0;
+		}
+	}
 
-					cmdstream << "rm \'" << escape_single_quote(track_filename) << "\'";
+	return result;
+}
 
-					deinit_commands.insert(std::make_shared<dtcue::external_command>(cmdstream.str()));
+// length of track in CD frames, 1/75 of second; exact for sources whose format and length were read from headers,
+// otherwise estimated assuming CD audio
+uint64_t estimate_track_frames(const track_data &track, const split_context &context)
+{
+	uint64_t result = 0;
 
-					cmdstream.str(std::string());
-				}
-				else
-				{
-					track_filename = track->parts.front().filename;
-				}
+	for (auto part = track.parts.begin(); part != track.parts.end(); ++part)
+	{
+		uint64_t start_sample = 0;
+		uint64_t end_sample = 0;
 
-				cmdstream << "ffmpeg -i \'" << escape_single_quote(track_filename) << "\'";
+		if (get_part_samples(*part, context, start_sample, end_sample))
+		{
+			const dtcue::audio_properties &format = context.source_properties.find(part->filename)->second;
 
-				if (track->parts.front().start_time)
-				{
-					unsigned int minutes = std::stoul(track->parts.front().start_time->minutes);
-					cmdstream << " -ss " << minutes / 60 << ":" << minutes % 60 << ':' << track->parts.front().start_time->seconds << "." << frames_to_seconds_map[track->parts.front().start_time->frames];
-				}
+			result += (end_sample - start_sample) * 75 / format.sample_rate;
+			continue;
+		}
 
-				if (track->parts.front().end_time)
-				{
-					unsigned int minutes = std::stoul(track->parts.front().end_time->minutes);
-					cmdstream << " -to " << minutes / 60 << ":" << minutes % 60 << ':' << track->parts.front().end_time->seconds << "." << frames_to_seconds_map[track->parts.front().end_time->frames];
-				}
+		track_data single_part;
+		single_part.parts.push_back(*part);
+
+		result += estimate_track_bytes(single_part, context) / 2352;
+	}
+
+	return result;
+}
+
+std::string file_identity(const std::string &filename)
+{
+	struct stat statbuf;
+	std::stringstream result;
+
+	if (stat(filename.c_str(), &statbuf) == 0)
+	{
+		result << statbuf.st_size << ':' << statbuf.st_mtim.tv_sec << '.' << statbuf.st_mtim.tv_nsec;
+	}
+
+	return result.str();
+}
+
+std::string make_audio_fingerprint(const track_data &track, dtcue::gap_action gap_action, const std::vector<dtcue::output_target> &targets)
+{
+	std::stringstream key;
+
+	key << static_cast<int>(gap_action);
+
+	// tracks are encoded again when set of formats changes
+	for (auto target = targets.begin(); target != targets.end(); ++target)
+	{
+		key << '\0' << target->format << ':' << target->quality << ':' << target->directory;
+	}
+
+	for (auto part = track.parts.begin(); part != track.parts.end(); ++part)
+	{
+		key << '\0' << part->filename << '\0' << file_identity(part->filename) << '\0';
+
+		if (part->start_frame)
+		{
+			key << *(part->start_frame);
+		}
+
+		key << '-';
+
+		if (part->end_frame)
+		{
+			key << *(part->end_frame);
+		}
+	}
+
+	return make_hex_string(dtcue::hash_string(key.str()));
+}
+
+// identifies album among others split into same output directory, e.g. discs of one release;
+// made of source files, since they don't change when tags of cue sheet are edited
+std::string make_album_key(const std::list<track_data> &tracks)
+{
+	std::set<std::string> sources;
+
+	for (auto track = tracks.begin(); track != tracks.end(); ++track)
+	{
+		for (auto part = track->parts.begin(); part != track->parts.end(); ++part)
+		{
+			char resolved[PATH_MAX];
+
+			sources.insert((realpath(part->filename.c_str(), resolved) != NULL) ? std::string(resolved) : part->filename);
+		}
+	}
+
+	std::stringstream key;
+
+	for (auto source = sources.begin(); source != sources.end(); ++source)
+	{
+		key << *source << '\0';
+	}
+
+	return make_hex_string(dtcue::hash_string(key.str()));
+}
+
+std::string make_tags_fingerprint(const std::map<std::string, std::string> &tags)
+{
+	std::stringstream key;
+
+	for (auto tag = tags.begin(); tag != tags.end(); ++tag)
+	{
+		key << tag->first << '\0' << tag->second << '\0';
+	}
+
+	return make_hex_string(dtcue::hash_string(key.str()));
+}
+
+// finished track is named after its title if it's known
+std::string make_output_filename(const track_data &track, const std::string &directory, const std::string &extension)
+{
+	auto title_tag = track.tags.find("TITLE");
+	if (title_tag != track.tags.end())
+	{
+		return join_path(directory, track.index + " - " + title_tag->second + extension);
+	}
+
+	return join_path(directory, "_track_" + track.index + extension);
+}
+
+std::string make_tag_command(const std::map<std::string, std::string> &tags, const std::string &filename, bool replace_existing)
+{
+	std::stringstream cmdstream;
+
+	cmdstream << "metaflac";
+
+	if (replace_existing)
+	{
+		cmdstream << " --remove-all-tags";
+	}
+
+	// first set ALBUM, TITLE, ARTIST and TRACKNUMBER, after that set everything else
+	std::list<std::string> preferred_tags;
+	preferred_tags.push_back("ALBUM");
+	preferred_tags.push_back("TITLE");
+	preferred_tags.push_back("ARTIST");
+	preferred_tags.push_back("TRACKNUMBER");
+
+	for (auto searched = preferred_tags.begin(); searched != preferred_tags.end(); ++searched)
+	{
+		auto tag = tags.find(*searched);
+		if (tag != tags.end())
+		{
+			cmdstream << " --set-tag=\'" << escape_single_quote(tag->first) << "=" << escape_single_quote(tag->second) << "\'";
+		}
+	}
+
+	for (auto tag = tags.begin(); tag != tags.end(); ++tag)
+	{
+		if (std::find(preferred_tags.begin(), preferred_tags.end(), tag->first) == preferred_tags.end())
+		{
+			cmdstream << " --set-tag=\'" << escape_single_quote(tag->first) << "=" << escape_single_quote(tag->second) << "\'";
+		}
+	}
+
+	cmdstream << " \'" << escape_single_quote(filename) << "\'";
+
+	return cmdstream.str();
+}
+
+std::shared_ptr<dtcue::command> make_external_command(const std::string &command_string, dtcue::resource_usage usage, bool reads_source)
+{
+	std::shared_ptr<dtcue::command> result = std::make_shared<dtcue::external_command>(command_string);
+
+	result->set_usage(usage, reads_source);
+
+	return result;
+}
+
+// with tuner, compression level is chosen when encoding starts, otherwise the best level is used
+std::shared_ptr<dtcue::command> make_encode_command(const split_context &context,
+	const dtcue::tuned_encode_command::factory &make_command,
+	uint64_t decoded_bytes,
+	const std::string &output_filename,
+	bool reads_source)
+{
+	if (!context.tuner)
+	{
+		return make_command(dtcue::encoder_tuner::best_level);
+	}
+
+	std::shared_ptr<dtcue::command> result = std::make_shared<dtcue::tuned_encode_command>(context.tuner, make_command, decoded_bytes, output_filename);
+
+	result->set_usage(dtcue::resource_usage::cpu_bound, reads_source);
+
+	return result;
+}
+
+// ffmpeg only copies samples, other decoders have to decompress them
+dtcue::resource_usage decode_usage(const track_part &part)
+{
+	if (has_extension(part.filename, ".flac") || has_extension(part.filename, ".wv"))
+	{
+		return dtcue::resource_usage::cpu_bound;
+	}
+
+	return dtcue::resource_usage::io_bound;
+}
+
+// command decoding whole APE or ALAC image into WAV stream on standard output
+std::string make_image_decode_command(const std::string &filename)
+{
+	std::stringstream cmdstream;
+
+	if (has_extension(filename, ".ape"))
+	{
+		cmdstream << "mac \'" << escape_single_quote(filename) << "\' - -d";
+	}
+	else
+	{
+		cmdstream << "alac \'" << escape_single_quote(filename) << "\'";
+	}
+
+	return cmdstream.str();
+}
+
+// if output is "-", decoded WAV stream is written to standard output
+std::string make_decode_command(const track_part &part,
+	const std::string &output,
+	split_context &context)
+{
+	std::stringstream cmdstream;
+	bool to_stdout = (output == "-");
+
+	if (has_extension(part.filename, ".flac"))
+	{
+		// use "C" locale in order to always use '.' as separator
+		cmdstream << "LC_ALL=C ";
+		cmdstream << "flac -d -F";
+
+		if (part.start_frame)
+		{
+			cmdstream << " --skip=" << format_minutes_time(*(part.start_frame));
+		}
 
-				cmdstream << " -acodec copy \'_track_" << track->index << ".wav\'";
+		if (part.end_frame)
+		{
+			cmdstream << " --until=" << format_minutes_time(*(part.end_frame));
+		}
+
+		if (to_stdout)
+		{
+			cmdstream << " -s -c \'" << escape_single_quote(part.filename) << "\'";
+		}
+		else
+		{
+			cmdstream << " -o \'" << escape_single_quote(output) << "\' \'" << escape_single_quote(part.filename) << "\'";
+		}
+	}
+	else if (has_extension(part.filename, ".wv"))
+	{
+		cmdstream << "wvunpack";
+
+		if (to_stdout)
+		{
+			cmdstream << " -q";
+		}
+
+		if (part.start_frame)
+		{
+			cmdstream << " --skip=" << format_hours_time(*(part.start_frame));
+		}
+
+		if (part.end_frame)
+		{
+			cmdstream << " --until=" << format_hours_time(*(part.end_frame));
+		}
+
+		if (to_stdout)
+		{
+			cmdstream << " \'" << escape_single_quote(part.filename) << "\' -o -";
+		}
+		else
+		{
+			cmdstream << " -o \'" << escape_single_quote(output) << "\' \'" << escape_single_quote(part.filename) << "\'";
+		}
+	}
+	else if (has_extension(part.filename, ".ape")
+		|| has_extension(part.filename, ".m4a")
+		|| has_extension(part.filename, ".wav"))
+	{
+		std::string track_filename;
+
+		if ((has_extension(part.filename, ".ape") || has_extension(part.filename, ".m4a")) && context.cache)
+		{
+			// decoded image is kept in cache and reused by subsequent runs
+			track_filename = context.cache->cached_filename(part.filename);
+			std::string temporary_filename = context.cache->temporary_filename(track_filename);
+
+			if (has_extension(part.filename, ".ape"))
+			{
+				cmdstream << "mac \'" << escape_single_quote(part.filename) << "\' \'" << escape_single_quote(temporary_filename) << "\' -d";
 			}
 			else
 			{
-				std::stringstream err;
-				err << "Unsupported file type found, filename: " << track->parts.front().filename;
-				throw std::runtime_error(err.str());
+				cmdstream << "alac -f \'" << escape_single_quote(temporary_filename) << "\' \'" << escape_single_quote(part.filename) << "\'";
 			}
 
-			commands_list.push_back(std::make_shared<dtcue::external_command>(cmdstream.str()));
+			std::shared_ptr<dtcue::command> store_command = std::make_shared<dtcue::cache_store_command>(cmdstream.str(), temporary_filename, track_filename);
+			store_command->set_usage(dtcue::resource_usage::cpu_bound, true);
+
+			context.init_commands.insert(store_command);
+
+			// entry is kept until all jobs of this cue sheet are finished, even if another album evicts entries meanwhile
+			std::shared_ptr<dtcue::command> evict_command = *(context.deinit_commands.insert(std::make_shared<dtcue::cache_evict_command>(context.cache)).first);
+			std::dynamic_pointer_cast<dtcue::cache_evict_command>(evict_command)->add_pinned_entry(track_filename);
+			context.cache->pin(track_filename);
 
 			cmdstream.str(std::string());
+		}
+		else if ((has_extension(part.filename, ".ape") || has_extension(part.filename, ".m4a")) && context.stream_decode)
+		{
+			// whole image is decoded for this part only and is never written to disk
+			cmdstream << make_image_decode_command(part.filename) << " | ";
+			track_filename = "-";
+		}
+		else if (has_extension(part.filename, ".ape") || has_extension(part.filename, ".m4a"))
+		{
+			// decoded image is placed next to source unless work directory is specified
+			track_filename = part.filename;
+			track_filename.replace(track_filename.rfind('.'), std::string::npos, ".wav");
 
-			cmdstream << "flac -8 -F --no-lax \'_track_" << track->index << ".wav\'";
+			if (!context.work_directory.empty())
+			{
+				size_t separator = track_filename.rfind('/');
+				std::string name = (separator != std::string::npos) ? track_filename.substr(separator + 1) : track_filename;
 
-			commands_list.push_back(std::make_shared<dtcue::external_command>(cmdstream.str()));
+				// sources with same name from different directories may share work directory
+				name.replace(name.rfind('.'), std::string::npos, "." + make_hex_string(dtcue::hash_string(part.filename)) + ".wav");
+
+				track_filename = join_path(context.work_directory, name);
+			}
+
+			if (has_extension(part.filename, ".ape"))
+			{
+				cmdstream << "mac \'" << escape_single_quote(part.filename) << "\' \'" << escape_single_quote(track_filename) << "\' -d";
+			}
+			else
+			{
+				cmdstream << "alac -f \'" << escape_single_quote(track_filename) << "\' \'" << escape_single_quote(part.filename) << "\'";
+			}
+
+			const dtcue::command *init_command = context.init_commands.insert(make_external_command(cmdstream.str(), dtcue::resource_usage::cpu_bound, true)).first->get();
 
 			cmdstream.str(std::string());
 
-			cmdstream << "rm \'_track_" << track->index << ".wav\'";
+			cmdstream << "rm \'" << escape_single_quote(track_filename) << "\'";
 
-			commands_list.push_back(std::make_shared<dtcue::external_command>(cmdstream.str()));
+			const dtcue::command *deinit_command = context.deinit_commands.insert(std::make_shared<dtcue::external_command>(cmdstream.str())).first->get();
 
 			cmdstream.str(std::string());
 
-			cmdstream << "metaflac";
+			// lossless compression usually halves the size
+			context.work_bytes[init_command] = file_size(part.filename) * 2;
+			context.work_bytes[deinit_command] = context.work_bytes[init_command];
+		}
+		else
+		{
+			track_filename = part.filename;
+		}
+
+		if (to_stdout)
+		{
+			cmdstream << "ffmpeg -loglevel error";
+		}
+		else
+		{
+			cmdstream << "ffmpeg";
+		}
+
+		if (track_filename == "-")
+		{
+			cmdstream << " -i -";
+		}
+		else
+		{
+			cmdstream << " -i \'" << escape_single_quote(track_filename) << "\'";
+		}
+
+		if (part.start_frame)
+		{
+			cmdstream << " -ss " << format_hours_time(*(part.start_frame));
+		}
+
+		if (part.end_frame)
+		{
+			cmdstream << " -to " << format_hours_time(*(part.end_frame));
+		}
+
+		if (to_stdout)
+		{
+			cmdstream << " -acodec copy -f wav -";
+		}
+		else
+		{
+			cmdstream << " -acodec copy \'" << escape_single_quote(output) << "\'";
+		}
+	}
+	else
+	{
+		std::stringstream err;
+		err << "Unsupported file type found, filename: " << part.filename;
+		throw std::runtime_error(err.str());
+	}
+
+	return cmdstream.str();
+}
+
+bool is_supported_source(const std::string &filename)
+{
+	return (has_extension(filename, ".flac")
+		|| has_extension(filename, ".wv")
+		|| has_extension(filename, ".ape")
+		|| has_extension(filename, ".m4a")
+		|| has_extension(filename, ".wav"));
+}
 
-			// first set ALBUM, TITLE, ARTIST and TRACKNUMBER, after that set everything else
-			std::list<std::string> preferred_tags;
-			preferred_tags.push_back("ALBUM");
-			preferred_tags.push_back("TITLE");
-			preferred_tags.push_back("ARTIST");
-			preferred_tags.push_back("TRACKNUMBER");
+// checks source files and INDEX ranges of all tracks before any command is run,
+// reports every problem found and returns false if some track can't be split
+bool validate_tracks(const std::list<track_data> &tracks, split_context &context)
+{
+	bool valid = true;
+	std::set<std::string> checked_files;
 
-			for (auto searched = preferred_tags.begin(); searched != preferred_tags.end(); ++searched)
+	for (auto track = tracks.begin(); track != tracks.end(); ++track)
+	{
+		for (auto part = track->parts.begin(); part != track->parts.end(); ++part)
+		{
+			if (!checked_files.insert(part->filename).second)
 			{
-				auto tag = track->tags.find(*searched);
-				if (tag != track->tags.end())
-				{
-					cmdstream << " --set-tag=\'" << escape_single_quote(tag->first) << "=" << escape_single_quote(tag->second) << "\'";
-				}
+				continue;
 			}
 
-			for (auto tag = track->tags.begin(); tag != track->tags.end(); ++tag)
+			struct stat statbuf;
+
+			if (!is_supported_source(part->filename))
+			{
+				fprintf(stderr, "Track %s: unsupported file type, filename: %s\n", track->index.c_str(), part->filename.c_str());
+				valid = false;
+			}
+			else if (stat(part->filename.c_str(), &statbuf) != 0)
+			{
+				fprintf(stderr, "Track %s: failed to access file %s: %s\n", track->index.c_str(), part->filename.c_str(), strerror(errno));
+				valid = false;
+			}
+			else if ((!S_ISREG(statbuf.st_mode)) || (statbuf.st_size == 0))
+			{
+				fprintf(stderr, "Track %s: file %s is empty or isn't a regular file\n", track->index.c_str(), part->filename.c_str());
+				valid = false;
+			}
+			else if (dtcue::can_probe_audio_file(part->filename))
 			{
-				if (std::find(preferred_tags.begin(), preferred_tags.end(), tag->first) == preferred_tags.end())
+				try
+				{
+					context.source_properties[part->filename] = dtcue::probe_audio_file(part->filename);
+				}
+				catch (const std::exception &exc)
 				{
-					cmdstream << " --set-tag=\'" << escape_single_quote(tag->first) << "=" << escape_single_quote(tag->second) << "\'";
+					fprintf(stderr, "Track %s: %s\n", track->index.c_str(), exc.what());
+					valid = false;
 				}
 			}
+		}
+	}
 
-			cmdstream << " \'_track_" << track->index << ".flac\'";
+	for (auto track = tracks.begin(); track != tracks.end(); ++track)
+	{
+		const dtcue::audio_properties *track_format = NULL;
+		std::string track_format_filename;
 
-			commands_list.push_back(std::make_shared<dtcue::external_command>(cmdstream.str()));
+		for (auto part = track->parts.begin(); part != track->parts.end(); ++part)
+		{
+			uint64_t start_frame = part->start_frame ? *(part->start_frame) : 0;
 
-			auto tag = track->tags.find("TITLE");
-			if (tag != track->tags.end())
+			if (part->end_frame && (*(part->end_frame) <= start_frame))
 			{
-				cmdstream.str(std::string());
-				cmdstream << "mv \'_track_" << track->index << ".flac\' \'" << track->index << " - " << escape_single_quote(tag->second) << ".flac\'";
-				commands_list.push_back(std::make_shared<dtcue::external_command>(cmdstream.str()));
+				fprintf(stderr, "Track %s: range of file %s ending at %s is empty\n", track->index.c_str(), part->filename.c_str(), format_frames(*(part->end_frame)).c_str());
+				valid = false;
 			}
-		}
 
-		for (auto command = init_commands.begin(); command != init_commands.end(); ++command)
-		{
-			if (verbose)
+			auto properties = context.source_properties.find(part->filename);
+			if (properties == context.source_properties.end())
 			{
-				printf("%s\n", (*command)->print().c_str());
+				continue;
 			}
 
-			if (!dry_run)
+			if (properties->second.total_samples != 0)
 			{
-				if (!(*command)->run())
+				// one CD frame is 1/75 of second
+				if (part->start_frame && (start_frame * properties->second.sample_rate / 75 >= properties->second.total_samples))
+				{
+					fprintf(stderr, "Track %s: start %s is beyond end of file %s\n", track->index.c_str(), format_frames(start_frame).c_str(), part->filename.c_str());
+					valid = false;
+				}
+
+				if (part->end_frame && (*(part->end_frame) * properties->second.sample_rate / 75 > properties->second.total_samples))
 				{
-					fprintf(stderr, "Action failed: %s\n", (*command)->print().c_str());
+					fprintf(stderr, "Track %s: end %s is beyond end of file %s\n", track->index.c_str(), format_frames(*(part->end_frame)).c_str(), part->filename.c_str());
+					valid = false;
 				}
 			}
-		}
 
-		for (auto command = commands_list.begin(); command != commands_list.end(); ++command)
-		{
-			if (verbose)
+			// parts are concatenated into single stream
+			if (track_format == NULL)
+			{
+				track_format = &(properties->second);
+				track_format_filename = part->filename;
+			}
+			else if (!track_format->same_format(properties->second))
 			{
-				printf("%s\n", (*command)->print().c_str());
+				fprintf(stderr, "Track %s: files %s and %s have different sample formats\n", track->index.c_str(), track_format_filename.c_str(), part->filename.c_str());
+				valid = false;
 			}
+		}
+	}
+
+	return valid;
+}
 
-			if (!dry_run)
+// adds jobs splitting cue sheet to executor, returns false if cue sheet can't be split
+bool add_cue_jobs(const dtcue::cue &cuesheet, const split_options &options, split_context &context, dtcue::scheduler &executor)
+{
+	// convert frames to time, from 1/75 to 1/1000000, and save these values to map
+	{
+		for (auto track = cuesheet.tracks.begin(); track != cuesheet.tracks.end(); ++track)
+		{
+			for (auto index = track->indices.begin(); index != track->indices.end(); ++index)
 			{
-				if (!(*command)->run())
+				if (!convert_and_save_frames(context.frames_to_seconds_map, index->second.time.frames))
 				{
-					fprintf(stderr, "Action failed: %s\n", (*command)->print().c_str());
+					fprintf(stderr, "Failed to convert frames for track %s, index %u: value is %s\n", track->track_index.c_str(), index->first, index->second.time.frames.c_str());
+					return false;
 				}
 			}
 		}
+	}
+
+	if (options.verbose)
+	{
+		printf("\nGlobal tags:\n");
+
+		for (auto tag = cuesheet.tags.begin(); tag != cuesheet.tags.end(); ++tag)
+		{
+			printf("\t%s=%s\n", tag->first.c_str(), tag->second.c_str());
+		}
 
-		for (auto command = deinit_commands.begin(); command != deinit_commands.end(); ++command)
+		printf("Tracks:\n");
+
+		for (auto track = cuesheet.tracks.begin(); track != cuesheet.tracks.end(); ++track)
 		{
-			if (verbose)
+			printf("\tTrack %s\n", track->track_index.c_str());
+
+			for (size_t file_idx = 0; file_idx < track->files.size(); ++file_idx)
 			{
-				printf("%s\n", (*command)->print().c_str());
+				printf("\t\tFile %zu: %s\n", file_idx, track->files[file_idx].c_str());
 			}
 
-			if (!dry_run)
+			for (auto index = track->indices.begin(); index != track->indices.end(); ++index)
 			{
-				if (!(*command)->run())
-				{
-					fprintf(stderr, "Action failed: %s\n", (*command)->print().c_str());
-				}
+				printf("\t\tINDEX %02d: file %zu, %s:%s.%s\n", index->first, index->second.file_index, index->second.time.minutes.c_str(), index->second.time.seconds.c_str(), context.frames_to_seconds_map[index->second.time.frames].c_str());
 			}
+
+			for (auto tag = track->tags.begin(); tag != track->tags.end(); ++tag)
+			{
+				printf("\t\t%s=%s\n", tag->first.c_str(), tag->second.c_str());
+			}
+		}
+
+		printf("\n");
+	}
+
+	if (context.library)
+	{
+		// headers of source files are enough for disc ID, so duplicate is found before anything is decoded
+		try
+		{
+			dtcue::disc_toc toc = dtcue::read_disc_toc(cuesheet, context.source_directory);
+			std::string location = dtcue::album_location(context.source_directory);
+			bool exact = false;
+			const dtcue::disc_record *duplicate = context.library->find(toc, dtcue::duplicate_tolerance_frames, location, exact);
+
+			if ((duplicate != NULL) && exact)
+			{
+				fprintf(stderr, "Album %s is already present in library: %s\n", location.c_str(), duplicate->location.c_str());
+				return true;
+			}
+
+			// similar lengths of tracks alone aren't proof enough for skipping album
+			if (duplicate != NULL)
+			{
+				fprintf(stderr, "Album %s may be already present in library, tracks of %s have almost same lengths; splitting it anyway\n", location.c_str(), duplicate->location.c_str());
+			}
+
+			// albums split during this run are matched too
+			context.library->add(dtcue::disc_index::make_record(toc, location));
+		}
+		catch (const std::exception &exc)
+		{
+			fprintf(stderr, "Failed to compute disc ID, album isn't checked for duplicates: %s\n", exc.what());
+		}
+	}
+
+	std::list<track_data> tracks = convert_cue_to_tracks(cuesheet, options.gap_action);
+
+	if (!context.source_directory.empty())
+	{
+		for (auto track = tracks.begin(); track != tracks.end(); ++track)
+		{
+			for (auto part = track->parts.begin(); part != track->parts.end(); ++part)
+			{
+				if ((!part->filename.empty()) && (part->filename[0] != '/'))
+				{
+					part->filename = join_path(context.source_directory, part->filename);
+				}
+			}
+		}
+	}
+
+	// nothing is run if some track would fail, dry run only reports problems
+	if ((!validate_tracks(tracks, context)) && (!options.dry_run))
+	{
+		return false;
+	}
+
+	// source images are read once, whichever job reads them last, cleanup runs after all of them
+	for (auto track = tracks.begin(); track != tracks.end(); ++track)
+	{
+		for (auto part = track->parts.begin(); part != track->parts.end(); ++part)
+		{
+			if (!part->filename.empty())
+			{
+				context.deinit_commands.insert(std::make_shared<dtcue::drop_cache_command>(part->filename));
+			}
+		}
+	}
+
+	if (options.verbose)
+	{
+		for (auto track = tracks.begin(); track != tracks.end(); ++track)
+		{
+			printf("Track %s\n", track->index.c_str());
+
+			for (auto part = track->parts.begin(); part != track->parts.end(); ++part)
+			{
+				printf("Filename: %s\n", part->filename.c_str());
+
+				if (part->start_frame)
+				{
+					printf("Start: %s\n", format_minutes_time(*(part->start_frame)).c_str());
+				}
+				else
+				{
+					printf("Start: NONE\n");
+				}
+
+				if (part->end_frame)
+				{
+					printf("End:   %s\n", format_minutes_time(*(part->end_frame)).c_str());
+				}
+				else
+				{
+					printf("End:   NONE\n");
+				}
+			}
+
+			for (auto tag = track->tags.begin(); tag != track->tags.end(); ++tag)
+			{
+				printf("%s=%s\n", tag->first.c_str(), tag->second.c_str());
+			}
+
+			printf("\n");
+		}
+	}
+
+	std::list<std::shared_ptr<dtcue::job> > track_jobs;
+	std::shared_ptr<dtcue::split_journal> journal;
+
+	// journal may be shared by several albums, their tracks are told apart by album key
+	std::string album_key = make_album_key(tracks);
+
+	if (options.resume)
+	{
+		journal = std::make_shared<dtcue::split_journal>(join_path(context.output_directory, dtcue::journal_filename), options.dry_run);
+	}
+
+	unsigned int progress_album = context.progress ? context.progress->add_album() : 0;
+
+	for (auto track = tracks.begin(); track != tracks.end(); ++track)
+	{
+		std::stringstream cmdstream;
+		std::shared_ptr<dtcue::job> track_job = std::make_shared<dtcue::job>();
+		std::list<std::shared_ptr<dtcue::command> > &commands_list = track_job->commands;
+
+		std::string wav_filename = join_path(context.work_directory, "_track_" + track->index + ".wav");
+		std::string flac_filename = join_path(context.work_directory, "_track_" + track->index + ".flac");
+		uint64_t track_bytes = estimate_track_bytes(*track, context);
+
+		std::string output_filename = make_output_filename(*track, context.output_directory, ".flac");
+
+		// encoded in work directory and moved into their directories along with FLAC track
+		std::vector<std::pair<std::string, std::string> > target_filenames;
+		std::vector<std::string> target_commands;
+
+		for (auto target = context.targets.begin(); target != context.targets.end(); ++target)
+		{
+			std::string target_filename = join_path(context.work_directory, "_track_" + track->index + target->extension);
+
+			target_filenames.push_back(std::make_pair(target_filename,
+				make_output_filename(*track, target->directory.empty() ? context.output_directory : target->directory, target->extension)));
+
+			target_commands.push_back(dtcue::make_target_encode_command(*target, track->tags, target_filename));
+		}
+
+		dtcue::journal_record track_record;
+		std::string journal_key = album_key + ":" + track->index;
+		std::string stale_output_filename;
+		track_record.audio_fingerprint = make_audio_fingerprint(*track, options.gap_action, context.targets);
+		track_record.tags_fingerprint = make_tags_fingerprint(track->tags);
+		track_record.output_filename = output_filename;
+
+		if (journal)
+		{
+			const dtcue::journal_record *previous = journal->find(journal_key);
+
+			if ((previous != NULL)
+				&& (previous->audio_fingerprint == track_record.audio_fingerprint)
+				&& dtcue::split_journal::is_unchanged(*previous))
+			{
+				if ((previous->tags_fingerprint == track_record.tags_fingerprint)
+					&& (previous->output_filename == output_filename))
+				{
+					if (options.verbose)
+					{
+						printf("Track %s is already completed: %s\n", track->index.c_str(), output_filename.c_str());
+					}
+
+					continue;
+				}
+
+				// audio is same, only tags have to be updated,
+				// tracks of additional formats are encoded again since there is no tool for editing tags of all of them
+				if (context.targets.empty())
+				{
+					commands_list.push_back(std::make_shared<dtcue::external_command>(make_tag_command(track->tags, previous->output_filename, true)));
+
+					if (previous->output_filename != output_filename)
+					{
+						commands_list.push_back(std::make_shared<dtcue::move_command>(previous->output_filename, output_filename));
+					}
+
+					commands_list.push_back(std::make_shared<dtcue::journal_record_command>(journal, journal_key, track_record));
+
+					// no audio is processed
+					if (context.progress)
+					{
+						context.progress->add_track(progress_album, 0);
+						commands_list.push_back(std::make_shared<dtcue::progress_record_command>(context.progress, progress_album, 0, 0, output_filename));
+					}
+
+					track_jobs.push_back(track_job);
+					continue;
+				}
+			}
+
+			// output of previous run is replaced by new track, unless it was changed since then
+			if ((previous != NULL) && (previous->output_filename != output_filename) && dtcue::split_journal::is_unchanged(*previous))
+			{
+				stale_output_filename = previous->output_filename;
+			}
+
+			// remove whatever is left from interrupted run
+			if (!options.dry_run)
+			{
+				unlink(wav_filename.c_str());
+				unlink(flac_filename.c_str());
+				unlink(dtcue::move_command(flac_filename, output_filename).temporary_filename().c_str());
+
+				for (auto target_filename = target_filenames.begin(); target_filename != target_filenames.end(); ++target_filename)
+				{
+					unlink(target_filename->first.c_str());
+					unlink(dtcue::move_command(target_filename->first, target_filename->second).temporary_filename().c_str());
+				}
+			}
+		}
+
+		std::shared_ptr<dtcue::pcm_checksum> checksum;
+		uint64_t allowed_difference = 0;
+
+		if (context.verify)
+		{
+			checksum = std::make_shared<dtcue::pcm_checksum>(track == tracks.begin(), std::next(track) == tracks.end());
+		}
+
+		if ((track->parts.size() == 1)
+			&& context.stream_decode
+			&& (!context.cache)
+			&& (has_extension(track->parts.front().filename, ".ape") || has_extension(track->parts.front().filename, ".m4a")))
+		{
+			// image is decoded only once and cut into all its tracks while decoding
+			const track_part &part = track->parts.front();
+			auto stream_command = context.stream_commands.find(part.filename);
+
+			if (stream_command == context.stream_commands.end())
+			{
+				stream_command = context.stream_commands.insert(std::make_pair(part.filename, std::make_shared<dtcue::stream_split_command>(make_image_decode_command(part.filename)))).first;
+				stream_command->second->set_usage(dtcue::resource_usage::cpu_bound, true);
+				context.init_commands.insert(stream_command->second);
+			}
+
+			cmdstream << "flac -8 -F --no-lax --ignore-chunk-sizes" << (context.verify ? " -V" : "") << " -s -o \'" << escape_single_quote(flac_filename) << "\' -";
+
+			std::vector<std::string> sink_commands(1, cmdstream.str());
+			sink_commands.insert(sink_commands.end(), target_commands.begin(), target_commands.end());
+
+			stream_command->second->add_output(part.start_frame ? *(part.start_frame) : 0, part.end_frame, sink_commands, checksum);
+
+			cmdstream.str(std::string());
+
+			// encoded track is produced by init command and stays in work directory until this job moves it out
+			context.work_bytes[stream_command->second.get()] += track_bytes;
+			track_job->release_bytes = track_bytes;
+		}
+		else if ((track->parts.size() == 1)
+			&& context.flac_copy
+			&& (!context.verify)
+			&& context.targets.empty()
+			&& has_extension(track->parts.front().filename, ".flac"))
+		{
+			// NOTE: checksums can't be computed since most of audio is never decoded
+			const track_part &part = track->parts.front();
+			std::shared_ptr<dtcue::flac_frame_index> &source = context.flac_sources[part.filename];
+
+			if (!source)
+			{
+				source = std::make_shared<dtcue::flac_frame_index>(part.filename);
+			}
+
+			std::shared_ptr<dtcue::command> copy_command = std::make_shared<dtcue::flac_copy_command>(source, part.start_frame ? *(part.start_frame) : 0, part.end_frame, flac_filename);
+			copy_command->set_usage(dtcue::resource_usage::io_bound, true);
+
+			commands_list.push_back(copy_command);
+
+			// lossless compression usually halves the size
+			track_job->reserve_bytes = track_bytes / 2;
+			track_job->release_bytes = track_job->reserve_bytes;
+		}
+		else if ((track->parts.size() == 1) && (!context.verify) && context.targets.empty())
+		{
+			commands_list.push_back(make_external_command(make_decode_command(track->parts.front(), wav_filename, context), decode_usage(track->parts.front()), true));
+
+			std::string encode_arguments = " -F --no-lax \'" + escape_single_quote(wav_filename) + "\'";
+
+			commands_list.push_back(make_encode_command(context, [encode_arguments](unsigned int level)
+				{
+					return make_external_command("flac -" + std::to_string(level) + encode_arguments, dtcue::resource_usage::cpu_bound, false);
+				},
+				track_bytes, output_filename, false));
+
+			cmdstream << "rm \'" << escape_single_quote(wav_filename) << "\'";
+
+			commands_list.push_back(std::make_shared<dtcue::external_command>(cmdstream.str()));
+
+			cmdstream.str(std::string());
+
+			// both decoded and encoded track are present in work directory while encoding
+			track_job->reserve_bytes = track_bytes * 2;
+			track_job->release_bytes = track_job->reserve_bytes;
+		}
+		else
+		{
+			// NOTE: parts are decoded one after another and streamed into encoders, no concatenated file is written,
+			// single part is streamed too if checksums of audio are needed or it has to be encoded into several formats
+			std::vector<std::string> source_commands;
+
+			for (auto part = track->parts.begin(); part != track->parts.end(); ++part)
+			{
+				source_commands.push_back(make_decode_command(*part, "-", context));
+			}
+
+			cmdstream << " -F --no-lax --ignore-chunk-sizes" << (context.verify ? " -V" : "") << " -s -o \'" << escape_single_quote(flac_filename) << "\' -";
+
+			std::string encode_arguments = cmdstream.str();
+
+			commands_list.push_back(make_encode_command(context, [source_commands, encode_arguments, target_commands, checksum](unsigned int level)
+				{
+					std::shared_ptr<dtcue::pipe_command> encode_command = std::make_shared<dtcue::pipe_command>(source_commands, "flac -" + std::to_string(level) + encode_arguments);
+
+					for (auto target_command = target_commands.begin(); target_command != target_commands.end(); ++target_command)
+					{
+						encode_command->add_sink(*target_command);
+					}
+
+					encode_command->set_usage(dtcue::resource_usage::cpu_bound, true);
+					encode_command->set_checksum(checksum);
+
+					return std::static_pointer_cast<dtcue::command>(encode_command);
+				},
+				track_bytes, output_filename, true));
+
+			// positions in time-based decoder options may be rounded to neighbouring sample at both ends of every part
+			allowed_difference = track->parts.size() * 2;
+
+			cmdstream.str(std::string());
+
+			track_job->reserve_bytes = track_bytes;
+			track_job->release_bytes = track_job->reserve_bytes;
+		}
+
+		track_job->cost = estimate_track_frames(*track, context);
+
+		if (checksum)
+		{
+			std::string source_md5_signature;
+
+			// whole source file is compared with its own signature
+			if ((track->parts.size() == 1) && ((!track->parts.front().start_frame) || (*(track->parts.front().start_frame) == 0)) && (!track->parts.front().end_frame))
+			{
+				auto properties = context.source_properties.find(track->parts.front().filename);
+
+				if (properties != context.source_properties.end())
+				{
+					source_md5_signature = properties->second.md5_signature;
+				}
+			}
+
+			commands_list.push_back(std::make_shared<dtcue::verify_command>(checksum, flac_filename, get_track_samples(*track, context), allowed_difference, source_md5_signature));
+		}
+
+		commands_list.push_back(std::make_shared<dtcue::external_command>(make_tag_command(track->tags, flac_filename, false)));
+
+		// finished track is moved into output directory only when it's complete
+		if (output_filename != flac_filename)
+		{
+			commands_list.push_back(std::make_shared<dtcue::move_command>(flac_filename, output_filename));
+		}
+
+		for (auto target_filename = target_filenames.begin(); target_filename != target_filenames.end(); ++target_filename)
+		{
+			if (target_filename->first != target_filename->second)
+			{
+				commands_list.push_back(std::make_shared<dtcue::move_command>(target_filename->first, target_filename->second));
+			}
+		}
+
+		if (!stale_output_filename.empty())
+		{
+			commands_list.push_back(std::make_shared<dtcue::external_command>("rm -f \'" + escape_single_quote(stale_output_filename) + "\'"));
+		}
+
+		if (journal)
+		{
+			commands_list.push_back(std::make_shared<dtcue::journal_record_command>(journal, journal_key, track_record));
+		}
+
+		if (context.progress)
+		{
+			context.progress->add_track(progress_album, track_job->cost);
+			commands_list.push_back(std::make_shared<dtcue::progress_record_command>(context.progress, progress_album, track_job->cost, track_bytes, output_filename));
+		}
+
+		for (auto part = track->parts.begin(); part != track->parts.end(); ++part)
+		{
+			track_job->inputs.push_back(part->filename);
+		}
+
+		track_job->outputs.push_back(output_filename);
+
+		for (auto target_filename = target_filenames.begin(); target_filename != target_filenames.end(); ++target_filename)
+		{
+			track_job->outputs.push_back(target_filename->second);
+		}
+
+		track_jobs.push_back(track_job);
+	}
+
+	std::vector<std::shared_ptr<dtcue::job> > jobs;
+	std::vector<std::shared_ptr<dtcue::job> > init_jobs;
+
+	for (auto command = context.init_commands.begin(); command != context.init_commands.end(); ++command)
+	{
+		std::shared_ptr<dtcue::job> init_job = std::make_shared<dtcue::job>();
+		init_job->commands.push_back(*command);
+		init_job->reserve_bytes = context.work_bytes[command->get()];
+		init_job->cost = init_job->reserve_bytes / 2352;
+
+		init_jobs.push_back(init_job);
+		jobs.push_back(init_job);
+	}
+
+	for (auto track_job = track_jobs.begin(); track_job != track_jobs.end(); ++track_job)
+	{
+		(*track_job)->prerequisites = init_jobs;
+		jobs.push_back(*track_job);
+	}
+
+	for (auto command = context.deinit_commands.begin(); command != context.deinit_commands.end(); ++command)
+	{
+		// cleanup is done even if splitting failed
+		std::shared_ptr<dtcue::job> deinit_job = std::make_shared<dtcue::job>();
+		deinit_job->commands.push_back(*command);
+		deinit_job->requires_success = false;
+		deinit_job->release_bytes = context.work_bytes[command->get()];
+		deinit_job->prerequisites.insert(deinit_job->prerequisites.end(), init_jobs.begin(), init_jobs.end());
+		deinit_job->prerequisites.insert(deinit_job->prerequisites.end(), track_jobs.begin(), track_jobs.end());
+
+		jobs.push_back(deinit_job);
+	}
+
+	if (context.dispatcher)
+	{
+		// only decoding and encoding is worth sending to workers, the rest is cheap and stays local
+		for (auto job = jobs.begin(); job != jobs.end(); ++job)
+		{
+			for (auto command = (*job)->commands.begin(); command != (*job)->commands.end(); ++command)
+			{
+				if (((*command)->usage() == dtcue::resource_usage::cpu_bound) && (!(*command)->script().empty()))
+				{
+					*command = std::make_shared<dtcue::remote_command>(context.dispatcher, *command);
+				}
+			}
+		}
+	}
+
+	executor.add(jobs);
+
+	return true;
+}
+
+// accepts either cue sheet or image with embedded cue sheet
+dtcue::cue load_cue(const std::string &filename)
+{
+	if (has_extension(filename, ".cue"))
+	{
+		return dtcue::parse_cue_file(filename);
+	}
+
+	std::experimental::optional<dtcue::cue> embedded = dtcue::read_embedded_cue(filename);
+
+	if (!embedded)
+	{
+		throw std::runtime_error("File '" + filename + "' doesn't have embedded cue sheet");
+	}
+
+	return *embedded;
+}
+
+void make_directory(const std::string &directory)
+{
+	if ((mkdir(directory.c_str(), 0777) != 0) && (errno != EEXIST))
+	{
+		throw std::runtime_error("Failed to create directory '" + directory + "': " + strerror(errno));
+	}
+}
+
+// returns false if some files of cue sheet are missing or still being written
+bool add_watched_cue_jobs(const std::string &cue_name, const dtcue::directory_watcher &watcher, const split_options &options, const split_context &defaults, dtcue::scheduler &executor)
+{
+	dtcue::cue cuesheet = dtcue::parse_cue_file(join_path(watcher.directory(), cue_name));
+
+	for (auto track = cuesheet.tracks.begin(); track != cuesheet.tracks.end(); ++track)
+	{
+		for (auto file = track->files.begin(); file != track->files.end(); ++file)
+		{
+			struct stat file_stat;
+			std::string file_path = ((!file->empty()) && ((*file)[0] == '/')) ? *file : join_path(watcher.directory(), *file);
+
+			if (watcher.is_being_written(*file) || (stat(file_path.c_str(), &file_stat) != 0))
+			{
+				return false;
+			}
+		}
+	}
+
+	// every album gets its own directories, so that intermediate files and journals of albums don't mix
+	std::string album = cue_name.substr(0, cue_name.length() - strlen(".cue"));
+
+	split_context context = defaults;
+	context.source_directory = watcher.directory();
+	context.output_directory = join_path(defaults.output_directory, album);
+	context.work_directory = (defaults.work_directory == defaults.output_directory) ? context.output_directory : join_path(defaults.work_directory, album);
+
+	if (!options.dry_run)
+	{
+		make_directory(context.output_directory);
+		make_directory(context.work_directory);
+	}
+
+	if (options.verbose)
+	{
+		printf("Splitting %s\n", join_path(watcher.directory(), cue_name).c_str());
+	}
+
+	if (!add_cue_jobs(cuesheet, options, context, executor))
+	{
+		fprintf(stderr, "Failed to split cue sheet %s\n", cue_name.c_str());
+	}
+
+	return true;
+}
+
+// signals which stop watching, see block_stop_signals()
+sigset_t watch_stop_signals()
+{
+	sigset_t result;
+	sigemptyset(&result);
+	sigaddset(&result, SIGINT);
+	sigaddset(&result, SIGTERM);
+
+	return result;
+}
+
+// has to be called before any thread is started, so that every thread inherits blocked signals
+// and they are received by directory watcher only; commands run meanwhile inherit them too,
+// thus running jobs are finished instead of being killed when watching is stopped
+void block_stop_signals()
+{
+	sigset_t stop_signals = watch_stop_signals();
+
+	int error = pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+	if (error != 0)
+	{
+		throw std::runtime_error(std::string("Failed to block signals: ") + strerror(error));
+	}
+}
+
+// keeps splitting cue sheets appearing in directory until interrupted by SIGINT or SIGTERM,
+// returns false if some of them failed
+bool watch_directory(const std::string &directory, const split_options &options, const split_context &defaults, dtcue::scheduler &executor)
+{
+	dtcue::directory_watcher watcher(directory, watch_stop_signals());
+
+	// cue sheets waiting for their files
+	std::set<std::string> waiting_cues;
+	std::vector<std::string> settled_files = watcher.existing_files();
+
+	executor.start(options.verbose, options.dry_run);
+
+	for (;;)
+	{
+		for (auto file = settled_files.begin(); file != settled_files.end(); ++file)
+		{
+			if (has_extension(*file, ".cue"))
+			{
+				waiting_cues.insert(*file);
+			}
+		}
+
+		settled_files.clear();
+
+		for (auto cue_name = waiting_cues.begin(); cue_name != waiting_cues.end(); )
+		{
+			bool done = true;
+
+			try
+			{
+				done = add_watched_cue_jobs(*cue_name, watcher, options, defaults, executor);
+			}
+			catch (const std::exception &exc)
+			{
+				fprintf(stderr, "Failed to split cue sheet %s: %s\n", cue_name->c_str(), exc.what());
+			}
+
+			if (done)
+			{
+				cue_name = waiting_cues.erase(cue_name);
+			}
+			else
+			{
+				++cue_name;
+			}
+		}
+
+		if (!watcher.wait(settled_files))
+		{
+			break;
+		}
+	}
+
+	return executor.finish();
+}
+
+void print_usage(const char *name)
+{
+	fprintf(stderr, "USAGE: %s [-v|--verbose] [-n|--dry-run] [--gap-discard|--gap-prepend|--gap-append|--gap-prepend-first-then-append] [-j|--jobs count] [--io-jobs count] [--cpu-jobs count] [--source-readers count] [--work-dir directory] [--output-dir directory] [--work-budget size] [--resume] [--stream-decode] [--verify] [--flac-copy] [--target format[:quality[:directory]]]... [--throughput size] [--deadline duration] [--cache-dir directory [--cache-size size]] [--status-file filename] [--disc-index filename] [--emit ninja|ninja-album|ninja-pools|make] [--serve address [--attempts count]] {cuesheet|image|--watch directory|--recompress directory [--idle-load value]|--index-library directory|--worker address}\n", name);
+}
+
+// accepts plain number of bytes or number with one of suffixes K, M, G, T
+uint64_t parse_size(const char *value)
+{
+	char *end = NULL;
+	unsigned long long result = strtoull(value, &end, 10);
+
+	if ((end == value) || (value[0] == '-'))
+	{
+		throw std::invalid_argument(std::string("Invalid size: ") + value);
+	}
+
+	switch (*end)
+	{
+	case 'T':
+		result *= 1024;
+		// fallthrough
+	case 'G':
+		result *= 1024;
+		// fallthrough
+	case 'M':
+		result *= 1024;
+		// fallthrough
+	case 'K':
+		result *= 1024;
+		++end;
+		break;
+	}
+
+	if (*end != '\0')
+	{
+		throw std::invalid_argument(std::string("Invalid size: ") + value);
+	}
+
+	return result;
+}
+
+// accepts plain number of seconds or number with one of suffixes s, m, h
+unsigned int parse_duration(const char *value)
+{
+	char *end = NULL;
+	unsigned long result = strtoul(value, &end, 10);
+
+	if ((end == value) || (value[0] == '-'))
+	{
+		throw std::invalid_argument(std::string("Invalid duration: ") + value);
+	}
+
+	switch (*end)
+	{
+	case 'h':
+		result *= 60;
+		// fallthrough
+	case 'm':
+		result *= 60;
+		// fallthrough
+	case 's':
+		++end;
+		break;
+	}
+
+	if (*end != '\0')
+	{
+		throw std::invalid_argument(std::string("Invalid duration: ") + value);
+	}
+
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	split_options options;
+	char *filename = NULL;
+	char *watched_directory = NULL;
+	char *recompressed_directory = NULL;
+	char *library_directory = NULL;
+	char *disc_index_filename = NULL;
+	const char *emit_format = NULL;
+	char *serve_address = NULL;
+	char *worker_address = NULL;
+	unsigned int remote_attempts = 3;
+	double idle_load = 1.0;
+	uint64_t target_rate = 0;
+	unsigned int deadline_seconds = 0;
+	char *status_filename = NULL;
+	char *cache_directory = NULL;
+	uint64_t cache_size = 0;
+	dtcue::scheduler_limits limits;
+	uint64_t work_budget = 0;
+
+	split_context context;
+
+	// failures of pipe readers are reported via return codes instead
+	signal(SIGPIPE, SIG_IGN);
+
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			if ((strcmp(argv[i], "-v") == 0)
+				|| (strcmp(argv[i], "--verbose") == 0))
+			{
+				options.verbose = true;
+			}
+			else if ((strcmp(argv[i], "-n") == 0)
+				|| (strcmp(argv[i], "--dry-run") == 0))
+			{
+				options.dry_run = true;
+			}
+			else if (strcmp(argv[i], "--gap-discard") == 0)
+			{
+				options.gap_action = dtcue::gap_action::discard;
+			}
+			else if (strcmp(argv[i], "--gap-prepend") == 0)
+			{
+				options.gap_action = dtcue::gap_action::prepend;
+			}
+			else if (strcmp(argv[i], "--gap-append") == 0)
+			{
+				options.gap_action = dtcue::gap_action::append;
+			}
+			else if (strcmp(argv[i], "--gap-prepend-first-then-append") == 0)
+			{
+				options.gap_action = dtcue::gap_action::prepend_first_then_append;
+			}
+			else if (((strcmp(argv[i], "-j") == 0) || (strcmp(argv[i], "--jobs") == 0)) && (i + 1 < argc))
+			{
+				limits.threads = std::stoul(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--io-jobs") == 0) && (i + 1 < argc))
+			{
+				limits.io_bound_commands = std::stoul(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--cpu-jobs") == 0) && (i + 1 < argc))
+			{
+				limits.cpu_bound_commands = std::stoul(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--source-readers") == 0) && (i + 1 < argc))
+			{
+				limits.source_readers = std::stoul(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--work-dir") == 0) && (i + 1 < argc))
+			{
+				context.work_directory = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--output-dir") == 0) && (i + 1 < argc))
+			{
+				context.output_directory = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--work-budget") == 0) && (i + 1 < argc))
+			{
+				work_budget = parse_size(argv[++i]);
+			}
+			else if (strcmp(argv[i], "--resume") == 0)
+			{
+				options.resume = true;
+			}
+			else if (strcmp(argv[i], "--stream-decode") == 0)
+			{
+				context.stream_decode = true;
+			}
+			else if (strcmp(argv[i], "--verify") == 0)
+			{
+				context.verify = true;
+			}
+			else if (strcmp(argv[i], "--flac-copy") == 0)
+			{
+				context.flac_copy = true;
+			}
+			else if ((strcmp(argv[i], "--target") == 0) && (i + 1 < argc))
+			{
+				context.targets.push_back(dtcue::parse_output_target(argv[++i]));
+			}
+			else if ((strcmp(argv[i], "--throughput") == 0) && (i + 1 < argc))
+			{
+				target_rate = parse_size(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--deadline") == 0) && (i + 1 < argc))
+			{
+				deadline_seconds = parse_duration(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--recompress") == 0) && (i + 1 < argc))
+			{
+				recompressed_directory = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--idle-load") == 0) && (i + 1 < argc))
+			{
+				idle_load = std::stod(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--cache-dir") == 0) && (i + 1 < argc))
+			{
+				cache_directory = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--cache-size") == 0) && (i + 1 < argc))
+			{
+				cache_size = parse_size(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--status-file") == 0) && (i + 1 < argc))
+			{
+				status_filename = argv[++i];
+			}
+			else if (strncmp(argv[i], "--emit=", 7) == 0)
+			{
+				emit_format = argv[i] + 7;
+			}
+			else if ((strcmp(argv[i], "--emit") == 0) && (i + 1 < argc))
+			{
+				emit_format = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--disc-index") == 0) && (i + 1 < argc))
+			{
+				disc_index_filename = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--index-library") == 0) && (i + 1 < argc))
+			{
+				library_directory = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--serve") == 0) && (i + 1 < argc))
+			{
+				serve_address = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--attempts") == 0) && (i + 1 < argc))
+			{
+				remote_attempts = std::stoul(argv[++i]);
+			}
+			else if ((strcmp(argv[i], "--worker") == 0) && (i + 1 < argc))
+			{
+				worker_address = argv[++i];
+			}
+			else if ((strcmp(argv[i], "--watch") == 0) && (i + 1 < argc))
+			{
+				watched_directory = argv[++i];
+			}
+			else if (filename == NULL)
+			{
+				filename = argv[i];
+			}
+			else
+			{
+				print_usage(argv[0]);
+				return -1;
+			}
+		}
+
+		// pools are shared by plans of several albums, so they are written without any cue sheet
+		bool emit_pools = (emit_format != NULL) && (dtcue::parse_build_format(emit_format) == dtcue::build_format::ninja_pools);
+
+		if (((filename != NULL) + (watched_directory != NULL) + (recompressed_directory != NULL) + (library_directory != NULL) + (worker_address != NULL) != (emit_pools ? 0 : 1))
+			|| ((library_directory != NULL) && (disc_index_filename == NULL))
+			|| ((emit_format != NULL) && (filename == NULL) && (!emit_pools))
+			// journal can't be updated by exported plan, and nothing may be removed when plan is only written
+			|| ((emit_format != NULL) && options.resume)
+			|| ((serve_address != NULL) && (((filename == NULL) && (watched_directory == NULL)) || (emit_format != NULL)))
+			// checksum of audio is computed by this process, it can't be taken from script run by worker
+			|| ((serve_address != NULL) && context.verify)
+			// workers run scripts at fixed compression level, and speed of remote encoding isn't measured
+			|| ((serve_address != NULL) && ((target_rate != 0) || (deadline_seconds != 0)))
+			// sinks of streamed image run at pace of their shared decoder, tuner can neither choose their level nor measure it
+			|| (context.stream_decode && ((target_rate != 0) || (deadline_seconds != 0)))
+			|| (remote_attempts == 0))
+		{
+			print_usage(argv[0]);
+			return -1;
+		}
+
+		if (emit_pools)
+		{
+			dtcue::write_build_graph(stdout, dtcue::build_format::ninja_pools, std::vector<std::shared_ptr<dtcue::job> >(), limits, std::string());
+			return 0;
+		}
+
+		if (worker_address != NULL)
+		{
+			return (dtcue::run_worker(worker_address, options.verbose) ? 0 : -1);
+		}
+
+		if (library_directory != NULL)
+		{
+			return (dtcue::index_library(library_directory, disc_index_filename, options.verbose) ? 0 : -1);
+		}
+
+		dtcue::build_format emit_build_format = dtcue::build_format::ninja;
+
+		if (emit_format != NULL)
+		{
+			emit_build_format = dtcue::parse_build_format(emit_format);
+
+			// plan is written to standard output instead of being run
+			options.verbose = false;
+		}
+
+		if (disc_index_filename != NULL)
+		{
+			context.library = std::make_shared<dtcue::disc_index>();
+			context.library->load(disc_index_filename);
+		}
+
+		if (recompressed_directory != NULL)
+		{
+			return (dtcue::recompress_when_idle(recompressed_directory, idle_load, options.verbose, options.dry_run) ? 0 : -1);
+		}
+
+		// no thread may be started before this
+		if (watched_directory != NULL)
+		{
+			block_stop_signals();
+		}
+
+		if (cache_directory != NULL)
+		{
+			context.cache = std::make_shared<dtcue::decode_cache>(cache_directory, cache_size);
+		}
+
+		if ((work_budget == 0) && is_tmpfs(context.work_directory.empty() ? "." : context.work_directory))
+		{
+			// don't let intermediate files exhaust memory
+			work_budget = available_space(context.work_directory.empty() ? "." : context.work_directory);
+		}
+
+		limits.work_budget = work_budget;
+
+		if ((target_rate != 0) || (deadline_seconds != 0))
+		{
+			unsigned int parallel_jobs = limits.threads;
+
+			if ((limits.cpu_bound_commands != 0) && (limits.cpu_bound_commands < parallel_jobs))
+			{
+				parallel_jobs = limits.cpu_bound_commands;
+			}
+
+			context.tuner = std::make_shared<dtcue::encoder_tuner>(target_rate, deadline_seconds, parallel_jobs);
+		}
+
+		if (serve_address != NULL)
+		{
+			context.dispatcher = std::make_shared<dtcue::job_dispatcher>(serve_address, remote_attempts, options.verbose);
+		}
+
+		// progress line would be mixed with printed commands in verbose mode
+		bool show_progress = isatty(STDERR_FILENO) && (!options.verbose);
+
+		if ((!options.dry_run) && (emit_format == NULL) && (show_progress || (status_filename != NULL)))
+		{
+			context.progress = std::make_shared<dtcue::progress_reporter>(show_progress, (status_filename != NULL) ? status_filename : "");
+		}
+
+		dtcue::scheduler executor(limits);
+
+		if (watched_directory != NULL)
+		{
+			if (context.progress)
+			{
+				context.progress->start();
+			}
+
+			bool result = watch_directory(watched_directory, options, context, executor);
+
+			if (context.progress)
+			{
+				context.progress->stop();
+			}
+
+			return (result ? 0 : -1);
+		}
+
+		if (!add_cue_jobs(load_cue(filename), options, context, executor))
+		{
+			return -1;
+		}
+
+		if (emit_format != NULL)
+		{
+			dtcue::write_build_graph(stdout, emit_build_format, executor.jobs(), limits, join_path(context.work_directory, ".dt-cue-split.stamps"));
+			return 0;
+		}
+
+		if (context.progress)
+		{
+			context.progress->start();
+		}
+
+		bool result = executor.run(options.verbose, options.dry_run);
+
+		if (context.progress)
+		{
+			context.progress->stop();
+		}
+
+		if (!result)
+		{
+			return -1;
 		}
 	}
 	catch (const std::exception &exc)
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-target.hpp"
+#include "cue-action.hpp"
+
+#include <dt-cue-scan.hpp>
+
+#include <sstream>
+#include <stdexcept>
+
+namespace dtcue {
+
+namespace {
+
+struct target_format
+{
+	const char *format;
+	const char *extension;
+	const char *default_quality;
+};
+
+const target_format target_formats[] =
+{
+	{ "opus", ".opus", "160" },
+	{ "vorbis", ".ogg", "6" },
+	{ "mp3", ".mp3", "2" }
+};
+
+// ID3v2 frames settable by lame directly, everything else is written into TXXX frames
+const std::pair<const char*, const char*> lame_tag_options[] =
+{
+	{ "TITLE", "--tt" },
+	{ "ARTIST", "--ta" },
+	{ "ALBUM", "--tl" },
+	{ "DATE", "--ty" },
+	{ "TRACKNUMBER", "--tn" },
+	{ "GENRE", "--tg" }
+};
+
+std::string make_lame_tag_arguments(const std::map<std::string, std::string> &tags)
+{
+	std::stringstream result;
+
+	for (auto tag = tags.begin(); tag != tags.end(); ++tag)
+	{
+		// lame writes ID3v2 text as Latin-1 unless told otherwise
+		if (!is_ascii(tag->second.data(), tag->second.data() + tag->second.size()))
+		{
+			result << " --id3v2-utf16";
+			break;
+		}
+	}
+
+	for (auto tag = tags.begin(); tag != tags.end(); ++tag)
+	{
+		const char *option = NULL;
+
+		for (size_t i = 0; i < sizeof(lame_tag_options) / sizeof(lame_tag_options[0]); ++i)
+		{
+			if (tag->first == lame_tag_options[i].first)
+			{
+				option = lame_tag_options[i].second;
+				break;
+			}
+		}
+
+		if (option != NULL)
+		{
+			result << " " << option << " \'" << escape_single_quote(tag->second) << "\'";
+		}
+		else
+		{
+			result << " --tv \'TXXX=" << escape_single_quote(tag->first) << "=" << escape_single_quote(tag->second) << "\'";
+		}
+	}
+
+	return result.str();
+}
+
+// Vorbis comments are used by both Opus and Vorbis encoders
+std::string make_comment_arguments(const std::string &option, const std::map<std::string, std::string> &tags)
+{
+	std::stringstream result;
+
+	for (auto tag = tags.begin(); tag != tags.end(); ++tag)
+	{
+		result << " " << option << " \'" << escape_single_quote(tag->first) << "=" << escape_single_quote(tag->second) << "\'";
+	}
+
+	return result.str();
+}
+
+} // unnamed namespace
+
+output_target parse_output_target(const std::string &spec)
+{
+	output_target result;
+
+	size_t quality_separator = spec.find(':');
+	size_t directory_separator = (quality_separator != std::string::npos) ? spec.find(':', quality_separator + 1) : std::string::npos;
+
+	result.format = spec.substr(0, quality_separator);
+
+	if (quality_separator != std::string::npos)
+	{
+		result.quality = spec.substr(quality_separator + 1, (directory_separator != std::string::npos) ? (directory_separator - quality_separator - 1) : std::string::npos);
+	}
+
+	if (directory_separator != std::string::npos)
+	{
+		result.directory = spec.substr(directory_separator + 1);
+	}
+
+	for (size_t i = 0; i < sizeof(target_formats) / sizeof(target_formats[0]); ++i)
+	{
+		if (result.format == target_formats[i].format)
+		{
+			result.extension = target_formats[i].extension;
+
+			if (result.quality.empty())
+			{
+				result.quality = target_formats[i].default_quality;
+			}
+
+			break;
+		}
+	}
+
+	if (result.extension.empty())
+	{
+		throw std::invalid_argument("Unsupported output format: " + result.format);
+	}
+
+	if (result.quality.find_first_not_of("0123456789.") != std::string::npos)
+	{
+		throw std::invalid_argument("Invalid quality for output format " + result.format + ": " + result.quality);
+	}
+
+	return result;
+}
+
+std::string make_target_encode_command(const output_target &target, const std::map<std::string, std::string> &tags, const std::string &output_filename)
+{
+	std::stringstream cmdstream;
+
+	if (target.format == "opus")
+	{
+		cmdstream << "opusenc --quiet --bitrate " << target.quality << make_comment_arguments("--comment", tags) << " - \'" << escape_single_quote(output_filename) << "\'";
+	}
+	else if (target.format == "vorbis")
+	{
+		cmdstream << "oggenc -Q -q " << target.quality << make_comment_arguments("-c", tags) << " -o \'" << escape_single_quote(output_filename) << "\' -";
+	}
+	else
+	{
+		cmdstream << "lame --quiet -V " << target.quality << " --id3v2-only" << make_lame_tag_arguments(tags) << " - \'" << escape_single_quote(output_filename) << "\'";
+	}
+
+	return cmdstream.str();
+}
+
+} // namespace dtcue
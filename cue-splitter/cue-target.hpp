@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_TARGET_HPP
+#define DT_CUE_TARGET_HPP
+
+#include <string>
+#include <map>
+
+namespace dtcue {
+
+// Additional format every track is encoded into, fed from the same decoded stream as FLAC encoder.
+struct output_target
+{
+	// "opus", "vorbis" or "mp3"
+	std::string format;
+
+	// including leading dot
+	std::string extension;
+
+	// bitrate in kbit/s for opus, quality for vorbis, VBR quality for mp3
+	std::string quality;
+
+	// finished tracks are placed here, empty string means output directory
+	std::string directory;
+};
+
+// parses "format[:quality[:directory]]", throws std::invalid_argument
+output_target parse_output_target(const std::string &spec);
+
+// command reading WAV stream from its standard input and writing tagged track into output file
+std::string make_target_encode_command(const output_target &target, const std::map<std::string, std::string> &tags, const std::string &output_filename);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_TARGET_HPP */
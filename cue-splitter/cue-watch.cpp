@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-watch.hpp"
+
+#include <stdexcept>
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+namespace dtcue {
+
+directory_watcher::directory_watcher(const std::string &directory, const sigset_t &stop_signals)
+	: m_directory(directory),
+	m_fd(-1),
+	m_signal_fd(-1)
+{
+	m_fd = inotify_init1(IN_CLOEXEC);
+	if (m_fd < 0)
+	{
+		throw std::runtime_error(std::string("Failed to initialize inotify: ") + strerror(errno));
+	}
+
+	// IN_CREATE is only used to learn which files are still being written
+	if (inotify_add_watch(m_fd, m_directory.c_str(), IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0)
+	{
+		int error = errno;
+		close(m_fd);
+		throw std::runtime_error("Failed to watch directory '" + m_directory + "': " + strerror(error));
+	}
+
+	// blocked signals stay pending until they are read, so none of them is lost between waits
+	m_signal_fd = signalfd(-1, &stop_signals, SFD_CLOEXEC);
+	if (m_signal_fd < 0)
+	{
+		int error = errno;
+		close(m_fd);
+		throw std::runtime_error(std::string("Failed to create signal descriptor: ") + strerror(error));
+	}
+}
+
+directory_watcher::~directory_watcher()
+{
+	close(m_signal_fd);
+	close(m_fd);
+}
+
+const std::string& directory_watcher::directory() const
+{
+	return m_directory;
+}
+
+std::vector<std::string> directory_watcher::existing_files() const
+{
+	std::vector<std::string> result;
+
+	DIR *dir = opendir(m_directory.c_str());
+	if (dir == NULL)
+	{
+		throw std::runtime_error("Failed to read directory '" + m_directory + "': " + strerror(errno));
+	}
+
+	for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir))
+	{
+		if ((entry->d_name[0] != '.') && ((entry->d_type == DT_REG) || (entry->d_type == DT_LNK) || (entry->d_type == DT_UNKNOWN)))
+		{
+			result.push_back(entry->d_name);
+		}
+	}
+
+	closedir(dir);
+
+	return result;
+}
+
+bool directory_watcher::wait(std::vector<std::string> &settled_files)
+{
+	struct pollfd descriptors[2];
+	descriptors[0].fd = m_signal_fd;
+	descriptors[0].events = POLLIN;
+	descriptors[1].fd = m_fd;
+	descriptors[1].events = POLLIN;
+
+	do
+	{
+		descriptors[0].revents = 0;
+		descriptors[1].revents = 0;
+
+		if ((poll(descriptors, 2, -1) < 0) && (errno != EINTR))
+		{
+			throw std::runtime_error(std::string("Failed to wait for inotify events: ") + strerror(errno));
+		}
+	}
+	while ((descriptors[0].revents == 0) && (descriptors[1].revents == 0));
+
+	if (descriptors[0].revents != 0)
+	{
+		struct signalfd_siginfo info;
+
+		if (read(m_signal_fd, &info, sizeof(info)) != static_cast<ssize_t>(sizeof(info)))
+		{
+			throw std::runtime_error(std::string("Failed to read signal: ") + strerror(errno));
+		}
+
+		return false;
+	}
+
+	alignas(struct inotify_event) char buffer[4096];
+
+	ssize_t length = read(m_fd, buffer, sizeof(buffer));
+	if (length < 0)
+	{
+		throw std::runtime_error(std::string("Failed to read inotify events: ") + strerror(errno));
+	}
+
+	for (ssize_t offset = 0; offset < length; )
+	{
+		const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+		offset += sizeof(struct inotify_event) + event->len;
+
+		// events were lost, fall back to whatever is present in directory now
+		if (event->mask & IN_Q_OVERFLOW)
+		{
+			std::vector<std::string> files = existing_files();
+			settled_files.insert(settled_files.end(), files.begin(), files.end());
+			continue;
+		}
+
+		if ((event->len == 0) || (event->mask & IN_ISDIR))
+		{
+			continue;
+		}
+
+		std::string name = event->name;
+
+		if (event->mask & IN_CREATE)
+		{
+			m_being_written.insert(name);
+		}
+		else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+		{
+			m_being_written.erase(name);
+			settled_files.push_back(name);
+		}
+	}
+
+	return true;
+}
+
+bool directory_watcher::is_being_written(const std::string &name) const
+{
+	return (m_being_written.find(name) != m_being_written.end());
+}
+
+} // namespace dtcue
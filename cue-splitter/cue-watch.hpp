@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_WATCH_HPP
+#define DT_CUE_WATCH_HPP
+
+#include <string>
+#include <set>
+#include <vector>
+
+#include <signal.h>
+
+namespace dtcue {
+
+// Reports files of directory once they are completely written or moved into it.
+// Waiting stops when one of stop signals arrives; they have to be blocked in every thread
+// before any thread is started, otherwise they may be delivered elsewhere and missed.
+class directory_watcher
+{
+public:
+	directory_watcher(const std::string &directory, const sigset_t &stop_signals);
+	~directory_watcher();
+
+	directory_watcher(const directory_watcher &other) = delete;
+	directory_watcher& operator=(const directory_watcher &other) = delete;
+
+	const std::string& directory() const;
+
+	// names of files present in directory, used to pick up files which appeared before watching started
+	std::vector<std::string> existing_files() const;
+
+	// blocks until some files are closed after writing or moved into directory and adds their names to settled_files,
+	// returns false if stop signal was received, including one which arrived while caller wasn't waiting
+	bool wait(std::vector<std::string> &settled_files);
+
+	// true for files created since watching started which are still open for writing
+	bool is_being_written(const std::string &name) const;
+
+private:
+	std::string m_directory;
+	int m_fd;
+	int m_signal_fd;
+
+	std::set<std::string> m_being_written;
+};
+
+} // namespace dtcue
+
+#endif /* DT_CUE_WATCH_HPP */
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cue-wave.hpp"
+
+#include <string.h>
+
+namespace dtcue {
+
+namespace {
+
+uint32_t read_le32(const unsigned char *data)
+{
+	return (static_cast<uint32_t>(data[0])
+		| (static_cast<uint32_t>(data[1]) << 8)
+		| (static_cast<uint32_t>(data[2]) << 16)
+		| (static_cast<uint32_t>(data[3]) << 24));
+}
+
+uint16_t read_le16(const unsigned char *data)
+{
+	return (static_cast<uint16_t>(data[0]) | (static_cast<uint16_t>(data[1]) << 8));
+}
+
+void write_le32(unsigned char *data, uint32_t value)
+{
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+	data[2] = (value >> 16) & 0xFF;
+	data[3] = (value >> 24) & 0xFF;
+}
+
+bool skip_bytes(FILE *input, uint64_t count)
+{
+	char buffer[4096];
+
+	while (count > 0)
+	{
+		size_t portion = (count < sizeof(buffer)) ? count : sizeof(buffer);
+
+		if (fread(buffer, 1, portion, input) != portion)
+		{
+			return false;
+		}
+
+		count -= portion;
+	}
+
+	return true;
+}
+
+} // unnamed namespace
+
+bool wave_format::same_samples(const wave_format &other) const
+{
+	return ((channels == other.channels)
+		&& (sample_rate == other.sample_rate)
+		&& (bits_per_sample == other.bits_per_sample)
+		&& (block_align == other.block_align));
+}
+
+bool read_wave_header(FILE *input, wave_format &format)
+{
+	unsigned char header[12];
+
+	if ((fread(header, 1, sizeof(header), input) != sizeof(header))
+		|| (memcmp(header, "RIFF", 4) != 0)
+		|| (memcmp(header + 8, "WAVE", 4) != 0))
+	{
+		return false;
+	}
+
+	format = wave_format();
+
+	for (;;)
+	{
+		unsigned char chunk_header[8];
+
+		if (fread(chunk_header, 1, sizeof(chunk_header), input) != sizeof(chunk_header))
+		{
+			return false;
+		}
+
+		uint32_t chunk_size = read_le32(chunk_header + 4);
+
+		if (memcmp(chunk_header, "data", 4) == 0)
+		{
+			if (format.fmt_chunk.empty())
+			{
+				return false;
+			}
+
+			// streaming encoders leave sizes unset
+			if (chunk_size != 0xFFFFFFFF)
+			{
+				format.data_size = chunk_size;
+			}
+
+			return true;
+		}
+		else if (memcmp(chunk_header, "fmt ", 4) == 0)
+		{
+			if (chunk_size < 16)
+			{
+				return false;
+			}
+
+			format.fmt_chunk.resize(chunk_size);
+
+			if (fread(&format.fmt_chunk[0], 1, chunk_size, input) != chunk_size)
+			{
+				return false;
+			}
+
+			const unsigned char *data = reinterpret_cast<const unsigned char*>(format.fmt_chunk.data());
+
+			format.channels        = read_le16(data + 2);
+			format.sample_rate     = read_le32(data + 4);
+			format.block_align     = read_le16(data + 12);
+			format.bits_per_sample = read_le16(data + 14);
+
+			if ((chunk_size % 2) != 0)
+			{
+				if (!skip_bytes(input, 1))
+				{
+					return false;
+				}
+			}
+		}
+		else
+		{
+			if (!skip_bytes(input, static_cast<uint64_t>(chunk_size) + (chunk_size % 2)))
+			{
+				return false;
+			}
+		}
+	}
+}
+
+bool write_wave_header(FILE *output, const wave_format &format)
+{
+	std::string header;
+	unsigned char value[4];
+
+	header.append("RIFF");
+	write_le32(value, 0xFFFFFFFF);
+	header.append(reinterpret_cast<const char*>(value), sizeof(value));
+	header.append("WAVE");
+
+	header.append("fmt ");
+	write_le32(value, format.fmt_chunk.size());
+	header.append(reinterpret_cast<const char*>(value), sizeof(value));
+	header.append(format.fmt_chunk);
+
+	if ((format.fmt_chunk.size() % 2) != 0)
+	{
+		header.push_back('\0');
+	}
+
+	header.append("data");
+	write_le32(value, 0xFFFFFFFF);
+	header.append(reinterpret_cast<const char*>(value), sizeof(value));
+
+	return (fwrite(header.data(), 1, header.size(), output) == header.size());
+}
+
+} // namespace dtcue
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2018-2019 i.Dark_Templar <darktemplar@dark-templar-archives.net>
+ *
+ * This file is part of DT Cue Tools.
+ *
+ * DT Cue Tools is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DT Cue Tools is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with DT Cue Tools.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DT_CUE_WAVE_HPP
+#define DT_CUE_WAVE_HPP
+
+#include <string>
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace dtcue {
+
+struct wave_format
+{
+	// contents of 'fmt ' chunk, copied as is
+	std::string fmt_chunk;
+
+	unsigned int channels;
+	unsigned int sample_rate;
+	unsigned int bits_per_sample;
+	unsigned int block_align;
+
+	// size of 'data' chunk, 0 if it's unknown (i.e. output of a pipe)
+	uint64_t data_size;
+
+	wave_format()
+		: channels(0),
+		sample_rate(0),
+		bits_per_sample(0),
+		block_align(0),
+		data_size(0)
+	{
+	}
+
+	bool same_samples(const wave_format &other) const;
+};
+
+// reads RIFF header and all chunks up to and including header of 'data' chunk
+bool read_wave_header(FILE *input, wave_format &format);
+
+// writes header suitable for streaming: chunk sizes are unknown and set to maximum
+bool write_wave_header(FILE *output, const wave_format &format);
+
+} // namespace dtcue
+
+#endif /* DT_CUE_WAVE_HPP */